@@ -57,6 +57,7 @@
 #include "priv_tytypes.h"
 #include "priv_storage.h"
 #include "priv_readdwarf.h"
+#include "priv_dicache.h"
 #if defined(VGO_linux) || defined(VGO_solaris)
 # include "priv_readelf.h"
 # include "priv_readdwarf3.h"
@@ -107,6 +108,7 @@
 /*------------------------------------------------------------*/
 
 static void caches__invalidate (void);
+static Bool load_deferred_DebugInfo ( DebugInfo* di );
 
 
 /*------------------------------------------------------------*/
@@ -221,6 +223,9 @@ static inline UInt ROL32 ( UInt x, UInt n )
    linked list of DebugInfos. */
 static DebugInfo* debugInfo_list = NULL;
 
+/* How many DebugInfos in debugInfo_list have .deferred set. */
+static UInt n_deferred_DebugInfos = 0;
+
 
 /* Find 'di' in the debugInfo_list and move it one step closer to the
    front of the list, so as to make subsequent searches for it
@@ -335,6 +340,7 @@ static void free_DebugInfo ( DebugInfo* di )
    GExpr* gexpr;
 
    vg_assert(di != NULL);
+   if (di->dicache_map)  ML_(dicache_forget)(di);
    if (di->fsm.maps)     VG_(deleteXA)(di->fsm.maps);
    if (di->fsm.filename) ML_(dinfo_free)(di->fsm.filename);
    if (di->fsm.dbgname)  ML_(dinfo_free)(di->fsm.dbgname);
@@ -444,6 +450,16 @@ static void discard_or_archive_DebugInfo ( DebugInfo* di )
        no OS mappings, even if their fsm.maps still contain mappings.
        Such (left over) mappings can overlap with real mappings.
        Search for FSMMAPSNOTCLEANEDUP: below for more details. */
+   /* A di whose reading was deferred has to be read now if it is to be
+      archived.  Otherwise there is nothing more to read. */
+   if (di->deferred) {
+      if (VG_(clo_keep_debuginfo)) {
+         load_deferred_DebugInfo(di);
+      } else {
+         di->deferred = False;
+         n_deferred_DebugInfos--;
+      }
+   }
    /* If a di has no dinfo, we can discard even if VG_(clo_keep_debuginfo). */
    const Bool   archive = VG_(clo_keep_debuginfo) && di->have_dinfo;
 
@@ -489,10 +505,29 @@ static void discard_or_archive_DebugInfo ( DebugInfo* di )
 }
 
 
+/* Does any r-x mapping of 'di' intersect [start,start+length) ? */
+static Bool rx_mappings_intersect ( const DebugInfo* di,
+                                    Addr start, SizeT length )
+{
+   Word i;
+   for (i = 0; i < VG_(sizeXA)(di->fsm.maps); i++) {
+      const DebugInfoMapping* map = VG_(indexXA)(di->fsm.maps, i);
+      if (map->rx
+          && map->size > 0
+          && !(start+length - 1 < map->avma
+               || map->avma + map->size - 1 < start))
+         return True;
+   }
+   return False;
+}
+
+
 /* Repeatedly scan debugInfo_list, looking for DebugInfos with text
    AVMAs intersecting [start,start+length), and call discard_DebugInfo
    to get rid of them.  This modifies the list, hence the multiple
    iterations.  Returns True iff any such DebugInfos were found.
+   The text of a DebugInfo whose reading was deferred is not known
+   yet, so its r-x mappings are used instead.
 */
 static Bool discard_syms_in_range ( Addr start, SizeT length )
 {
@@ -507,6 +542,13 @@ static Bool discard_syms_in_range ( Addr start, SizeT length )
       while (True) {
          if (curr == NULL)
             break;
+         if (curr->deferred) {
+            if (rx_mappings_intersect(curr, start, length)) {
+               found = True;
+               break;
+            }
+         }
+         else
          if (is_DebugInfo_archived(curr)
              || !curr->text_present
              || (curr->text_present
@@ -931,15 +973,154 @@ static void truncate_DebugInfoMapping_overlaps
    update the FSM and determine when an accept state has been reached.
 */
 
+/* Read the symbols and debug info for the avma ranges specified in
+   the (de-overlapped) _DebugInfoFsm mapping array of 'di', and make
+   them available to queries.  'di' is either allocated, or active
+   because its reading was deferred.  Returns False if nothing could be
+   read. */
+static Bool read_DebugInfo ( struct _DebugInfo* di )
+{
+   Bool  ok;
+   Bool  cacheable = False;
+   Bool  cached    = False;
+   ULong cache_key = 0;
+
+   vg_assert(!di->have_dinfo && !di->deferred);
+
+#  if defined(VGO_linux) || defined(VGO_solaris)
+   cacheable = ML_(dicache_key)( di, &cache_key );
+   if (di->dicache_helper > 0)
+      ML_(dicache_wait_helper)( di );
+   if (cacheable)
+      cached = ML_(dicache_load)( di, cache_key );
+   ok = cached || ML_(read_elf_debug_info)( di );
+#  elif defined(VGO_darwin)
+   ok = ML_(read_macho_debug_info)( di );
+#  else
+#    error "unknown OS"
+#  endif
+
+   if (ok) {
+
+      TRACE_SYMTAB("\n------ Canonicalising the "
+                   "acquired info ------\n");
+      /* invalidate the debug info caches. */
+      caches__invalidate();
+      /* prepare read data for use, unless it was kept that way */
+      if (!cached) {
+         ML_(canonicaliseTables)( di );
+         /* Check invariants listed in
+            Comment_on_IMPORTANT_REPRESENTATIONAL_INVARIANTS in
+            priv_storage.h. */
+         check_CFSI_related_invariants(di);
+         ML_(finish_CFSI_arrays)(di);
+#        if defined(VGO_linux) || defined(VGO_solaris)
+         if (cacheable)
+            ML_(dicache_save)( di, cache_key );
+#        endif
+      }
+
+      // Mark di's first epoch point as a valid epoch, unless that was
+      // done when its reading was deferred.  Because its last_epoch
+      // value is still invalid, this changes di's state from
+      // "allocated" to "active".
+      if (is_DebugInfo_allocated(di))
+         di->first_epoch = VG_(current_DiEpoch)();
+      vg_assert(is_DebugInfo_active(di));
+      show_epochs("di_notify_ACHIEVE_ACCEPT_STATE success");
+
+      /* notify m_redir about it */
+      TRACE_SYMTAB("\n------ Notifying m_redir ------\n");
+      VG_(redir_notify_new_DebugInfo)( di );
+      /* Note that we succeeded */
+      di->have_dinfo = True;
+      vg_assert(di->handle > 0);
+
+   } else {
+      TRACE_SYMTAB("\n------ ELF reading failed ------\n");
+      /* Something went wrong (eg. bad ELF file).  Should we delete
+         this DebugInfo?  No - it contains info on the rw/rx
+         mappings, at least. */
+      vg_assert(di->have_dinfo == False);
+   }
+
+   return ok;
+}
+
+
+/* May the reading of 'di' be deferred until a query needs it?  Not if
+   m_redir has to see the symbols of every object as it is loaded, nor
+   for Valgrind's own preloads, whose symbols tell m_redir what to do
+   (and whose reading may bring in such specifications). */
+static Bool may_defer_DebugInfo ( const DebugInfo* di )
+{
+   return VG_(strncmp)(VG_(basename)(di->fsm.filename),
+                       "vgpreload_", 10) != 0
+          && !VG_(redir_needs_all_symbols)();
+}
+
+
+/* With --debuginfo-helpers, start a helper process reading 'di' into
+   the --debuginfo-cache while the client runs on.  Its reading can
+   then be deferred, and be no more than mapping the file the helper
+   wrote by the time a query needs it.  Returns False if no helper was
+   started.  In the helper, does not return. */
+static Bool start_DebugInfo_helper ( DebugInfo* di )
+{
+#  if defined(VGO_linux) || defined(VGO_solaris)
+   ULong key;
+   Int   pid;
+   Bool  ok;
+
+   if (VG_(clo_debuginfo_helpers) == 0 || !ML_(dicache_key)( di, &key ))
+      return False;
+   pid = ML_(dicache_start_helper)( di, key );
+   if (pid != 0)
+      return pid > 0;
+
+   /* In the helper: as read_DebugInfo does, less the epochs and
+      m_redir, which are Valgrind's business. */
+   ok = ML_(read_elf_debug_info)( di );
+   if (ok) {
+      ML_(canonicaliseTables)( di );
+      check_CFSI_related_invariants(di);
+      ML_(finish_CFSI_arrays)(di);
+      ML_(dicache_save)( di, key );
+   }
+   VG_(exit_now)( ok ? 0 : 1 );
+#  else
+   return False;
+#  endif
+}
+
+
+/* Read the deferred debug info of all objects. */
+static void load_all_deferred_DebugInfos ( void )
+{
+   DebugInfo* di;
+
+   /* Reading may reorder debugInfo_list (VG_(find_DebugInfo) does so),
+      hence the restart after each one. */
+   while (n_deferred_DebugInfos > 0) {
+      for (di = debugInfo_list; di; di = di->next) {
+         if (di->deferred)
+            break;
+      }
+      vg_assert(di);
+      load_deferred_DebugInfo(di);
+   }
+}
+
+
 /* When the sequence of observations causes a DebugInfoFSM to move
    into the accept state, call here to actually get the debuginfo read
-   in.  Returns a ULong whose purpose is described in comments 
-   preceding VG_(di_notify_mmap) just below.
+   in -- or, with --lazy-debuginfo=yes or --debuginfo-helpers, to note
+   that it is to be read when first needed.  Returns a ULong whose purpose is described in
+   comments preceding VG_(di_notify_mmap) just below.
 */
 static ULong di_notify_ACHIEVE_ACCEPT_STATE ( struct _DebugInfo* di )
 {
    ULong di_handle;
-   Bool  ok;
 
    advance_current_DiEpoch("di_notify_ACHIEVE_ACCEPT_STATE");
 
@@ -964,52 +1145,32 @@ static ULong di_notify_ACHIEVE_ACCEPT_STATE ( struct _DebugInfo* di )
       See http://bugzilla.mozilla.org/show_bug.cgi?id=788974 */
    truncate_DebugInfoMapping_overlaps( di, di->fsm.maps );
 
-   /* And acquire new info. */
-#  if defined(VGO_linux) || defined(VGO_solaris)
-   ok = ML_(read_elf_debug_info)( di );
-#  elif defined(VGO_darwin)
-   ok = ML_(read_macho_debug_info)( di );
-#  else
-#    error "unknown OS"
-#  endif
-
-   if (ok) {
-
-      TRACE_SYMTAB("\n------ Canonicalising the "
-                   "acquired info ------\n");
-      /* invalidate the debug info caches. */
-      caches__invalidate();
-      /* prepare read data for use */
-      ML_(canonicaliseTables)( di );
-      /* Check invariants listed in
-         Comment_on_IMPORTANT_REPRESENTATIONAL_INVARIANTS in
-         priv_storage.h. */
-      check_CFSI_related_invariants(di);
-      ML_(finish_CFSI_arrays)(di);
-
-      // Mark di's first epoch point as a valid epoch.  Because its
-      // last_epoch value is still invalid, this changes di's state from
-      // "allocated" to "active".
+   if (may_defer_DebugInfo(di)
+       && (start_DebugInfo_helper(di) || VG_(clo_lazy_debuginfo))) {
+      /* Make di active as of now, as if it had been read, so that
+         queries about this epoch find it once it has been. */
+      TRACE_SYMTAB("\n------ Deferring the reading ------\n");
+      if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir))
+         VG_(message)(Vg_DebugMsg, "Deferring syms from %s\n",
+                                   di->fsm.filename );
       vg_assert(is_DebugInfo_allocated(di));
       di->first_epoch = VG_(current_DiEpoch)();
-      vg_assert(is_DebugInfo_active(di));
-      show_epochs("di_notify_ACHIEVE_ACCEPT_STATE success");
-
-      /* notify m_redir about it */
-      TRACE_SYMTAB("\n------ Notifying m_redir ------\n");
-      VG_(redir_notify_new_DebugInfo)( di );
-      /* Note that we succeeded */
-      di->have_dinfo = True;
+      di->deferred = True;
+      n_deferred_DebugInfos++;
+      show_epochs("di_notify_ACHIEVE_ACCEPT_STATE deferred");
       vg_assert(di->handle > 0);
       di_handle = di->handle;
 
+   } else if (read_DebugInfo( di )) {
+      di_handle = di->handle;
+      /* Reading it may have given m_redir specifications that the
+         symbols of the objects not read so far must be matched
+         against. */
+      if (n_deferred_DebugInfos > 0 && VG_(redir_needs_all_symbols)())
+         load_all_deferred_DebugInfos();
+
    } else {
-      TRACE_SYMTAB("\n------ ELF reading failed ------\n");
-      /* Something went wrong (eg. bad ELF file).  Should we delete
-         this DebugInfo?  No - it contains info on the rw/rx
-         mappings, at least. */
       di_handle = 0;
-      vg_assert(di->have_dinfo == False);
    }
 
    TRACE_SYMTAB("\n");
@@ -1023,6 +1184,78 @@ static ULong di_notify_ACHIEVE_ACCEPT_STATE ( struct _DebugInfo* di )
 }
 
 
+/* Read the debug info of 'di', which was deferred at its accept state.
+   Its epochs are not changed: it has been active since it was mapped,
+   and queries about any epoch since then should find what is read
+   now.  Returns False if nothing could be read, in which case 'di' is
+   back in the allocated state, as if reading had failed at its accept
+   state. */
+static Bool load_deferred_DebugInfo ( DebugInfo* di )
+{
+   struct vg_stat statbuf;
+   SysRes statres;
+   Bool   ok;
+
+   vg_assert(di->deferred);
+   vg_assert(is_DebugInfo_active(di));
+   vg_assert(n_deferred_DebugInfos > 0);
+   di->deferred = False;
+   n_deferred_DebugInfos--;
+
+   /* Don't read another file than the one that was mapped. */
+   statres = VG_(stat)(di->fsm.filename, &statbuf);
+   if (sr_isError(statres)
+       || statbuf.dev   != di->fsm.dev
+       || statbuf.ino   != di->fsm.ino
+       || statbuf.size  != di->fsm.size
+       || statbuf.mtime != di->fsm.mtime) {
+      ML_(symerr)(di, False, "file has changed since it was mapped");
+      ok = False;
+   } else {
+      ok = read_DebugInfo( di );
+   }
+
+   if (!ok)
+      di->first_epoch = DiEpoch_INVALID();
+   return ok;
+}
+
+
+/* Does any mapping of 'di' hold 'a' ? */
+static Bool mappings_hold ( const DebugInfo* di, Addr a )
+{
+   Word i;
+   for (i = 0; i < VG_(sizeXA)(di->fsm.maps); i++) {
+      const DebugInfoMapping* map = VG_(indexXA)(di->fsm.maps, i);
+      if (map->avma <= a && a - map->avma < map->size)
+         return True;
+   }
+   return False;
+}
+
+
+/* Read the deferred debug info of the objects with a mapping holding
+   'a', so that a query about 'a' finds it. */
+static void load_deferred_DebugInfos_at ( Addr a )
+{
+   DebugInfo* di;
+
+   if (LIKELY(n_deferred_DebugInfos == 0))
+      return;
+
+   /* As in load_all_deferred_DebugInfos, restart after each one. */
+   while (True) {
+      for (di = debugInfo_list; di; di = di->next) {
+         if (di->deferred && mappings_hold(di, a))
+            break;
+      }
+      if (!di)
+         break;
+      load_deferred_DebugInfo(di);
+   }
+}
+
+
 /* Notify the debuginfo system about a new mapping.  This is the way
    new debug information gets loaded.  If allow_SkFileV is True, it
    will try load debug info if the mapping at 'a' belongs to Valgrind;
@@ -1121,7 +1354,7 @@ ULong VG_(di_notify_mmap)( Addr a, Bool allow_SkFileV, Int use_fd )
    if (! VKI_S_ISREG(statbuf.mode))
       return 0;
 
-   /* no uses of statbuf below here. */
+   /* statbuf is only used below to note the identity of the file. */
 
    /* Now we have to guess if this is a text-like mapping, a data-like
       mapping, neither or both.  The rules are:
@@ -1280,7 +1513,7 @@ ULong VG_(di_notify_mmap)( Addr a, Bool allow_SkFileV, Int use_fd )
       This fix assumes that all mappings made once we've read debuginfo for
       an object are irrelevant.  I think that's OK, but need to check with
       mjw/thh.  */
-   if (di->have_dinfo) {
+   if (di->have_dinfo || di->deferred) {
       if (debug)
          VG_(dmsg)("di_notify_mmap-4x: "
                    "ignoring mapping because we already read debuginfo "
@@ -1306,9 +1539,13 @@ ULong VG_(di_notify_mmap)( Addr a, Bool allow_SkFileV, Int use_fd )
    di->fsm.have_rx_map |= is_rx_map;
    di->fsm.have_rw_map |= is_rw_map;
    di->fsm.have_ro_map |= is_ro_map;
+   di->fsm.dev   = statbuf.dev;
+   di->fsm.ino   = statbuf.ino;
+   di->fsm.size  = statbuf.size;
+   di->fsm.mtime = statbuf.mtime;
 
    /* So, finally, are we in an accept state? */
-   vg_assert(!di->have_dinfo);
+   vg_assert(!di->have_dinfo && !di->deferred);
    if (di->fsm.have_rx_map && di->fsm.have_rw_map) {
       /* Ok, so, finally, we found what we need, and we haven't
          already read debuginfo for this object.  So let's do so now.
@@ -1403,7 +1640,7 @@ void VG_(di_notify_vm_protect)( Addr a, SizeT len, UInt prot )
    Word i;
    for (di = debugInfo_list; di; di = di->next) {
       vg_assert(di->fsm.filename);
-      if (di->have_dinfo)
+      if (di->have_dinfo || di->deferred)
          continue; /* already have debuginfo for this object */
       if (!di->fsm.have_ro_map)
          continue; /* need to have a r-- mapping for this object */
@@ -1923,6 +2160,12 @@ static void search_all_symtabs ( DiEpoch ep, Addr ptr,
    DebugInfo* di;
    Bool       inRange;
 
+   /* Data symbols may be in a .bss beyond the object's mappings. */
+   if (findText)
+      load_deferred_DebugInfos_at(ptr);
+   else
+      load_all_deferred_DebugInfos();
+
    for (di = debugInfo_list; di != NULL; di = di->next) {
 
       if (!is_DI_valid_for_epoch(di, ep))
@@ -1983,6 +2226,7 @@ static void search_all_loctabs ( DiEpoch ep, Addr ptr,
 {
    Word       lno;
    DebugInfo* di;
+   load_deferred_DebugInfos_at(ptr);
    for (di = debugInfo_list; di != NULL; di = di->next) {
       if (!is_DI_valid_for_epoch(di, ep))
          continue;
@@ -2352,6 +2596,7 @@ Bool VG_(get_objname) ( DiEpoch ep, Addr a, const HChar** objname )
 
    /* Look in the debugInfo_list to find the name.  In most cases we
       expect this to produce a result. */
+   load_deferred_DebugInfos_at(a);
    for (di = debugInfo_list; di != NULL; di = di->next) {
       if (!is_DI_valid_for_epoch(di, ep))
          continue;
@@ -2388,6 +2633,7 @@ DebugInfo* VG_(find_DebugInfo) ( DiEpoch ep, Addr a )
    static UWord n_search = 0;
    DebugInfo* di;
    n_search++;
+   load_deferred_DebugInfos_at(a);
    for (di = debugInfo_list; di != NULL; di = di->next) {
       if (!is_DI_valid_for_epoch(di, ep))
          continue;
@@ -2485,6 +2731,7 @@ Bool VG_(lookup_symbol_SLOW)(DiEpoch ep,
 #  if defined(VG_PLAT_USES_PPCTOC)
    require_pToc = True;
 #  endif
+   load_all_deferred_DebugInfos();
    for (si = debugInfo_list; si; si = si->next) {
       if (debug)
          VG_(printf)("lookup_symbol_SLOW: considering %s\n", si->soname);
@@ -2935,6 +3182,8 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
 
    DiEpoch curr_epoch = VG_(current_DiEpoch)();
 
+   load_deferred_DebugInfos_at(ip);
+
    for (di = debugInfo_list; di != NULL; di = di->next) {
       Word j;
       n_steps++;
@@ -3059,8 +3308,10 @@ static inline CFSI_m_CacheEnt* cfsi_m_cache__find ( Addr ip )
 #     ifdef N_Q_M_STATS
       n_m++;
 #     endif
-      ce->ip = ip;
+      /* Search first: reading deferred debug info on the way
+         invalidates the cache. */
       find_DiCfSI( &ce->di, &ce->cfsi_m, ip );
+      ce->ip = ip;
    }
 
    if (UNLIKELY(ce->di == (DebugInfo*)1)) {
@@ -4000,6 +4251,7 @@ Bool consider_vars_in_frame ( /*MOD*/XArray* /* of HChar */ dname1,
    if (debug)
       VG_(printf)("QQQQ: cvif: ip,sp,fp %#lx,%#lx,%#lx\n", ip,sp,fp);
    /* first, find the DebugInfo that pertains to 'ip'. */
+   load_deferred_DebugInfos_at(ip);
    for (di = debugInfo_list; di; di = di->next) {
       n_steps++;
       if (!is_DI_valid_for_epoch(di, ep))
@@ -4139,6 +4391,7 @@ Bool VG_(get_data_description)(
       Loop over the DebugInfos we have.  Check data_addr against the
       outermost scope of all of them, as that should be a global
       scope. */
+   load_all_deferred_DebugInfos();
    for (di = debugInfo_list; di != NULL; di = di->next) {
       OSet*        global_scope;
       Word         gs_size;
@@ -4446,6 +4699,7 @@ VG_(di_get_stack_blocks_at_ip)( Addr ip, Bool arrays_only )
    if (debug)
       VG_(printf)("QQQQ: dgsbai: ip %#lx\n", ip);
    /* first, find the DebugInfo that pertains to 'ip'. */
+   load_deferred_DebugInfos_at(ip);
    for (di = debugInfo_list; di; di = di->next) {
       n_steps++;
       /* text segment missing? unlikely, but handle it .. */
@@ -4564,6 +4818,9 @@ VG_(di_get_global_blocks_from_dihandle) ( ULong di_handle, Bool  arrays_only )
       caller. */
    vg_assert(di != NULL);
 
+   if (di->deferred)
+      load_deferred_DebugInfo(di);
+
    /* we'll put the collected variables in here. */
    gvars = VG_(newXA)( ML_(dinfo_zalloc), "di.debuginfo.dggbfd.1",
                        ML_(dinfo_free), sizeof(GlobalBlock) );
@@ -4677,8 +4934,11 @@ VG_(di_get_global_blocks_from_dihandle) ( ULong di_handle, Bool  arrays_only )
 
 const DebugInfo* VG_(next_DebugInfo)(const DebugInfo* di)
 {
-   if (di == NULL)
+   if (di == NULL) {
+      /* The caller is going to look at all of them. */
+      load_all_deferred_DebugInfos();
       return debugInfo_list;
+   }
    return di->next;
 }
 
@@ -4804,6 +5064,9 @@ VgSectKind VG_(DebugInfo_sect_kind)( /*OUT*/const HChar** objname, Addr a)
    DebugInfo* di;
    VgSectKind res = Vg_SectUnknown;
 
+   /* As for data symbols, 'a' may be beyond the object's mappings. */
+   load_all_deferred_DebugInfos();
+
    for (di = debugInfo_list; di != NULL; di = di->next) {
 
       if (0)
@@ -0,0 +1,1026 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Processed debug info kept on disk between runs.    dicache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_aspacemgr.h"
+#include "pub_core_debuginfo.h"
+#include "pub_core_deduppoolalloc.h"
+#include "pub_core_hashtable.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"      // VG_(getpid), VG_(fork_quiet)
+#include "pub_core_libcsignal.h"    // VG_(sigprocmask)
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_xarray.h"
+
+#include "priv_misc.h"              // dinfo_zalloc/free/strdup
+#include "priv_image.h"
+#include "priv_d3basics.h"
+#include "priv_tytypes.h"
+#include "priv_storage.h"
+#include "priv_readelf.h"           // ML_(find_elf_buildid)
+#include "priv_dicache.h"           // self
+
+#include "config.h"                 // VERSION
+
+#if defined(VGO_linux) || defined(VGO_solaris)
+
+/* A file holds the tables of one object as they are after
+   ML_(finish_CFSI_arrays): symtab, loctab, inltab, the CFSI arrays and
+   the pools they index, and the section addresses.  It is mapped
+   privately and fixed up in place, so that the tables are used where
+   they lie rather than copied.  Only the two DedupPoolAllocs (FnDn and
+   DiCfSI_m) are built again, as their users index them through
+   VG_(indexEltNumber).  The string pool is not: strings are used in
+   the mapping.
+
+   Addresses are those of the run that wrote the file, and are moved by
+   the difference between where the object's first mapping is now and
+   where it was then.  The relative layout of the mappings is part of
+   the key, so this one difference applies to all of them.
+
+   In the file, pointers to strings are stored as 1 + their offset in
+   the strings part, or 0 for NULL, and DiSym::sec_names as 1 + the
+   index of the first name in the sec_names part, whose lists end
+   with 0.  Files are written to a temporary name and renamed, so that
+   readers only ever see complete ones. */
+
+#define DC_MAGIC   "VGDICACH"
+#define DC_VERSION 1
+
+typedef
+   enum {
+      P_SECTS,          // text_present .. ehframe_size[] of DebugInfo
+      P_SYMTAB,
+      P_SECNAMES,       // UWord
+      P_LOCTAB,
+      P_LOCTAB_FNDN_IX, // sizeof_fndn_ix bytes each
+      P_INLTAB,
+      P_FNDN,           // elements 1 .. n of fndnpool
+      P_CFSI_BASE,
+      P_CFSI_M_IX,      // sizeof_cfsi_m_ix bytes each
+      P_CFSI_M,         // elements 1 .. n of cfsi_m_pool
+      P_CFSI_EXPRS,
+      P_STRS,           // chars
+      N_PARTS
+   }
+   PartNo;
+
+typedef
+   struct {
+      ULong off;        // in the file, a multiple of 8
+      ULong n;          // of elements
+   }
+   Part;
+
+typedef
+   struct {
+      HChar magic[8];
+      UInt  version;
+      UInt  header_szB;    // sizeof(FileHeader), as a check
+      ULong key;           // as in the file name
+      ULong base;          // avma of the first mapping when written
+      ULong soname;        // string refs
+      ULong dbgname;
+      ULong dbg_size;      // dbgname's size and mtime when written
+      ULong dbg_mtime;
+      ULong sizeof_fndn_ix;
+      ULong sizeof_cfsi_m_ix;
+      ULong maxinl_codesz;
+      ULong cfsi_minavma;
+      ULong cfsi_maxavma;
+      Part  part[N_PARTS];
+   }
+   FileHeader;
+
+/* The part of DebugInfo describing its sections, copied as it is */
+#define SECTS_OFF offsetof(DebugInfo, text_present)
+#define SECTS_SZB (offsetof(DebugInfo, symtab) - SECTS_OFF)
+
+static SizeT elt_szB ( const FileHeader* fh, PartNo p )
+{
+   switch (p) {
+      case P_SECTS:          return SECTS_SZB;
+      case P_SYMTAB:         return sizeof(DiSym);
+      case P_SECNAMES:       return sizeof(UWord);
+      case P_LOCTAB:         return sizeof(DiLoc);
+      case P_LOCTAB_FNDN_IX: return fh->sizeof_fndn_ix;
+      case P_INLTAB:         return sizeof(DiInlLoc);
+      case P_FNDN:           return sizeof(FnDn);
+      case P_CFSI_BASE:      return sizeof(Addr);
+      case P_CFSI_M_IX:      return fh->sizeof_cfsi_m_ix;
+      case P_CFSI_M:         return sizeof(DiCfSI_m);
+      case P_CFSI_EXPRS:     return sizeof(CfiExpr);
+      case P_STRS:           return 1;
+      default:               vg_assert(0);
+   }
+}
+
+/* 0: not yet checked, 1: in use, -1: not in use */
+static Int   state      = 0;
+static ULong global_key = 0;
+
+/* Stats */
+static ULong n_loaded    = 0;
+static ULong n_saved     = 0;
+static ULong n_uncached  = 0;   // for want of a build-id
+static ULong n_started   = 0;   // helpers
+static ULong n_waited    = 0;   // helpers still running when needed
+static ULong n_failed    = 0;   // helpers which exited with an error
+
+/* 64-bit FNV-1a, as in m_transcache.c */
+static ULong hash_bytes ( ULong h, const void* p, SizeT n )
+{
+   const UChar* b = p;
+   SizeT        i;
+
+   for (i = 0; i < n; i++) {
+      h ^= b[i];
+      h *= 0x100000001b3ULL;
+   }
+   return h;
+}
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+static ULong hash_str ( ULong h, const HChar* s )
+{
+   return hash_bytes(h, s ? s : "", VG_(strlen)(s ? s : "") + 1);
+}
+
+static Bool dicache_in_use ( void )
+{
+   struct vg_stat st;
+   ULong          h = HASH_INIT;
+   UInt           sizes[8];
+
+   if (state != 0)
+      return state > 0;
+   state = -1;
+   if (VG_(clo_debuginfo_cache) == NULL) {
+      if (VG_(clo_debuginfo_helpers) > 0)
+         VG_(umsg)("Warning: helpers need a --debuginfo-cache, "
+                   "ignoring --debuginfo-helpers\n");
+      return False;
+   }
+   if (VG_(clo_read_var_info)) {
+      VG_(umsg)("Warning: variable info cannot be kept, "
+                "ignoring --debuginfo-cache\n");
+      return False;
+   }
+   if (sr_isError(VG_(stat)(VG_(clo_debuginfo_cache), &st))
+       || !VKI_S_ISDIR(st.mode)) {
+      VG_(umsg)("Warning: %s is not a directory, "
+                "ignoring --debuginfo-cache\n", VG_(clo_debuginfo_cache));
+      return False;
+   }
+
+   h = hash_str(h, VERSION);
+   h = hash_str(h, VG_PLATFORM);
+   sizes[0] = DC_VERSION;
+   sizes[1] = sizeof(FileHeader);
+   sizes[2] = SECTS_SZB;
+   sizes[3] = sizeof(DiSym);
+   sizes[4] = sizeof(DiLoc);
+   sizes[5] = sizeof(DiInlLoc);
+   sizes[6] = sizeof(DiCfSI_m);
+   sizes[7] = sizeof(CfiExpr);
+   h = hash_bytes(h, sizes, sizeof(sizes));
+   /* The options that change what is read */
+   h = hash_bytes(h, &VG_(clo_read_inline_info),
+                  sizeof(VG_(clo_read_inline_info)));
+   h = hash_bytes(h, &VG_(clo_allow_mismatched_debuginfo),
+                  sizeof(VG_(clo_allow_mismatched_debuginfo)));
+   h = hash_str(h, VG_(clo_extra_debuginfo_path));
+   h = hash_str(h, VG_(clo_debuginfo_server));
+   global_key = h;
+   state = 1;
+   return True;
+}
+
+static const DebugInfoMapping* first_map ( const DebugInfo* di )
+{
+   return VG_(indexXA)(di->fsm.maps, 0);
+}
+
+static Bool make_key ( const DebugInfo* di, /*OUT*/ULong* key )
+{
+   struct vg_stat st;
+   HChar*         buildid;
+   ULong          h;
+   Word           i;
+
+   if (!dicache_in_use())
+      return False;
+   if (di->trace_symtab || di->trace_cfi || di->ddump_syms
+       || di->ddump_line || di->ddump_frames
+       || VG_(sizeXA)(di->fsm.maps) == 0)
+      return False;
+   buildid = ML_(find_elf_buildid)(di->fsm.filename);
+   if (buildid == NULL) {
+      n_uncached++;
+      return False;
+   }
+
+   h = hash_str(global_key, buildid);
+   /* A separate debug file installed since, in the place it is most
+      likely to be, changes what would be read.  One found elsewhere is
+      checked against the file when it is loaded. */
+   if (VG_(strlen)(buildid) > 2) {
+      HChar path[VG_(strlen)(buildid) + 64];
+      VG_(sprintf)(path, "/usr/lib/debug/.build-id/%c%c/%s.debug",
+                   buildid[0], buildid[1], buildid + 2);
+      if (!sr_isError(VG_(stat)(path, &st))) {
+         h = hash_bytes(h, &st.dev, sizeof(st.dev));
+         h = hash_bytes(h, &st.ino, sizeof(st.ino));
+         h = hash_bytes(h, &st.size, sizeof(st.size));
+         h = hash_bytes(h, &st.mtime, sizeof(st.mtime));
+      }
+   }
+   ML_(dinfo_free)(buildid);
+
+   for (i = 0; i < VG_(sizeXA)(di->fsm.maps); i++) {
+      const DebugInfoMapping* map = VG_(indexXA)(di->fsm.maps, i);
+      ULong rel = map->avma - first_map(di)->avma;
+      ULong foff = map->foff;
+      ULong size = map->size;
+      UChar prot = (map->rx ? 1 : 0) | (map->rw ? 2 : 0) | (map->ro ? 4 : 0);
+      h = hash_bytes(h, &rel, sizeof(rel));
+      h = hash_bytes(h, &foff, sizeof(foff));
+      h = hash_bytes(h, &size, sizeof(size));
+      h = hash_bytes(h, &prot, sizeof(prot));
+   }
+   *key = h;
+   return True;
+}
+
+Bool ML_(dicache_key) ( DebugInfo* di, /*OUT*/ULong* key )
+{
+   if (di->dicache_keyed == 0)
+      di->dicache_keyed = make_key(di, &di->dicache_key) ? 1 : -1;
+   *key = di->dicache_key;
+   return di->dicache_keyed > 0;
+}
+
+static void cache_path ( /*OUT*/HChar* path, ULong key )
+{
+   VG_(sprintf)(path, "%s/%016llx.vgdc", VG_(clo_debuginfo_cache), key);
+}
+
+/*------------------------------------------------------------*/
+/*--- Loading                                              ---*/
+/*------------------------------------------------------------*/
+
+static Bool parts_ok ( const FileHeader* fh, SizeT file_szB )
+{
+   UInt p;
+
+   for (p = 0; p < N_PARTS; p++) {
+      const Part* part = &fh->part[p];
+      ULong       szB  = part->n * elt_szB(fh, p);
+      if (part->off % 8 != 0
+          || part->off < sizeof(FileHeader) || part->off > file_szB
+          || part->n > file_szB || szB > file_szB - part->off)
+         return False;
+   }
+   return fh->part[P_SECTS].n == 1;
+}
+
+/* Turn a string ref into a pointer, or fail */
+#define STR(_ref, _dst)                                            \
+   do {                                                            \
+      UWord _r = (UWord)(_ref);                                    \
+      if (_r > n_strs) goto bad;                                   \
+      (_dst) = _r == 0 ? NULL : strs + _r - 1;                     \
+   } while (0)
+
+/* The index of a fndn_ix or cfsi_m_ix entry */
+static UInt get_ix ( const void* tab, UInt szB, UWord i )
+{
+   switch (szB) {
+      case 1: return ((const UChar*)tab)[i];
+      case 2: return ((const UShort*)tab)[i];
+      case 4: return ((const UInt*)tab)[i];
+      default: vg_assert(0);
+   }
+}
+
+/* Whether the children of expression 'i' are earlier expressions, as
+   the readers build them: this also keeps the evaluator from looping */
+static Bool cfsi_expr_ok ( const CfiExpr* e, UWord i )
+{
+#  define IX_OK(_ix) ((_ix) >= 0 && (UWord)(_ix) < i)
+   switch (e[i].tag) {
+      case Cex_Undef: case Cex_Const: case Cex_CfiReg: case Cex_DwReg:
+         return True;
+      case Cex_Deref:
+         return IX_OK(e[i].Cex.Deref.ixAddr);
+      case Cex_Unop:
+         return IX_OK(e[i].Cex.Unop.ix);
+      case Cex_Binop:
+         return IX_OK(e[i].Cex.Binop.ixL) && IX_OK(e[i].Cex.Binop.ixR);
+      default:
+         return False;
+   }
+#  undef IX_OK
+}
+
+/* Whether the expressions 'm' uses are among the 'n_exprs' loaded */
+static Bool cfsi_m_ok ( const DiCfSI_m* m, UWord n_exprs )
+{
+#  define HOW_OK(_how, _expr, _off) \
+      ((_how) != (_expr) || ((_off) >= 0 && (UWord)(_off) < n_exprs))
+   if (!HOW_OK(m->cfa_how, CFIC_EXPR, m->cfa_off)
+       || !HOW_OK(m->ra_how, CFIR_EXPR, m->ra_off))
+      return False;
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   return HOW_OK(m->sp_how, CFIR_EXPR, m->sp_off)
+          && HOW_OK(m->bp_how, CFIR_EXPR, m->bp_off);
+#  elif defined(VGA_arm)
+   return HOW_OK(m->r14_how, CFIR_EXPR, m->r14_off)
+          && HOW_OK(m->r13_how, CFIR_EXPR, m->r13_off)
+          && HOW_OK(m->r12_how, CFIR_EXPR, m->r12_off)
+          && HOW_OK(m->r11_how, CFIR_EXPR, m->r11_off)
+          && HOW_OK(m->r7_how, CFIR_EXPR, m->r7_off);
+#  elif defined(VGA_arm64)
+   return HOW_OK(m->sp_how, CFIR_EXPR, m->sp_off)
+          && HOW_OK(m->x30_how, CFIR_EXPR, m->x30_off)
+          && HOW_OK(m->x29_how, CFIR_EXPR, m->x29_off);
+#  elif defined(VGA_s390x)
+   return HOW_OK(m->sp_how, CFIR_EXPR, m->sp_off)
+          && HOW_OK(m->fp_how, CFIR_EXPR, m->fp_off)
+          && HOW_OK(m->f0_how, CFIR_EXPR, m->f0_off)
+          && HOW_OK(m->f1_how, CFIR_EXPR, m->f1_off)
+          && HOW_OK(m->f2_how, CFIR_EXPR, m->f2_off)
+          && HOW_OK(m->f3_how, CFIR_EXPR, m->f3_off)
+          && HOW_OK(m->f4_how, CFIR_EXPR, m->f4_off)
+          && HOW_OK(m->f5_how, CFIR_EXPR, m->f5_off)
+          && HOW_OK(m->f6_how, CFIR_EXPR, m->f6_off)
+          && HOW_OK(m->f7_how, CFIR_EXPR, m->f7_off);
+#  elif defined(VGA_mips32) || defined(VGA_mips64) || defined(VGA_nanomips)
+   return HOW_OK(m->sp_how, CFIR_EXPR, m->sp_off)
+          && HOW_OK(m->fp_how, CFIR_EXPR, m->fp_off);
+#  else
+   return True;
+#  endif
+#  undef HOW_OK
+}
+
+/* Whether the section fields read into 's' are as the reader leaves
+   them: flags which are True or False, sections which do not wrap
+   around, and no more ehframe sections than there is room for */
+static Bool sects_ok ( const DebugInfo* s )
+{
+   UInt i;
+
+#  define SECT_OK(_s) \
+      (s->_s##_present == False \
+       || (s->_s##_present == True \
+           && s->_s##_avma + s->_s##_size >= s->_s##_avma))
+   if (!(SECT_OK(text) && SECT_OK(data) && SECT_OK(sdata)
+         && SECT_OK(rodata) && SECT_OK(bss) && SECT_OK(sbss)
+         && SECT_OK(exidx) && SECT_OK(extab) && SECT_OK(plt)
+         && SECT_OK(got) && SECT_OK(gotplt) && SECT_OK(opd)))
+      return False;
+#  undef SECT_OK
+   if (s->n_ehframe > N_EHFRAME_SECTS)
+      return False;
+   for (i = 0; i < s->n_ehframe; i++)
+      if (s->ehframe_avma[i] + s->ehframe_size[i] < s->ehframe_avma[i])
+         return False;
+   return True;
+}
+
+/* Move the section addresses of di by 'delta' */
+static void relocate_sects ( DebugInfo* di, Addr delta )
+{
+   UInt i;
+
+#  define RELOC3(_s) \
+      if (di->_s##_present) { \
+         di->_s##_avma += delta; \
+         di->_s##_bias += delta; \
+         di->_s##_debug_bias += delta; \
+      }
+   RELOC3(text)
+   RELOC3(data)
+   RELOC3(sdata)
+   RELOC3(rodata)
+   RELOC3(bss)
+   RELOC3(sbss)
+#  undef RELOC3
+   if (di->exidx_present) {
+      di->exidx_avma += delta;
+      di->exidx_bias += delta;
+   }
+   if (di->extab_present) {
+      di->extab_avma += delta;
+      di->extab_bias += delta;
+   }
+   if (di->plt_present)    di->plt_avma += delta;
+   if (di->got_present)    di->got_avma += delta;
+   if (di->gotplt_present) di->gotplt_avma += delta;
+   if (di->opd_present)    di->opd_avma += delta;
+   for (i = 0; i < di->n_ehframe; i++)
+      di->ehframe_avma[i] += delta;
+}
+
+Bool ML_(dicache_load) ( DebugInfo* di, ULong key )
+{
+   HChar             path[VG_(strlen)(VG_(clo_debuginfo_cache)) + 32];
+   struct vg_stat    st;
+   SysRes            sres;
+   Int               fd;
+   SizeT             szB;
+   UChar*            map;
+   const FileHeader* fh;
+   const HChar*      strs;
+   UWord             n_strs, n_fndn, n_cfsi_m, i;
+   Addr              delta;
+   const HChar*      soname;
+   const HChar*      dbgname;
+   DedupPoolAlloc*   fndnpool    = NULL;
+   DedupPoolAlloc*   cfsi_m_pool = NULL;
+   DebugInfo*        sects       = NULL;
+
+   vg_assert(state > 0);
+   cache_path(path, key);
+   sres = VG_(open)(path, VKI_O_RDONLY, 0);
+   if (sr_isError(sres))
+      return False;
+   fd = sr_Res(sres);
+   if (VG_(fstat)(fd, &st) != 0 || st.size < (Long)sizeof(FileHeader)) {
+      VG_(close)(fd);
+      return False;
+   }
+   szB  = st.size;
+   sres = VG_(am_mmap_file_float_valgrind)(szB, VKI_PROT_READ|VKI_PROT_WRITE,
+                                           fd, 0);
+   VG_(close)(fd);
+   if (sr_isError(sres))
+      return False;
+   map = (UChar*)(Addr)sr_Res(sres);
+   fh  = (const FileHeader*)map;
+
+   if (VG_(memcmp)(fh->magic, DC_MAGIC, 8) != 0
+       || fh->version != DC_VERSION
+       || fh->header_szB != sizeof(FileHeader)
+       || fh->key != key
+       || (fh->sizeof_fndn_ix != 1 && fh->sizeof_fndn_ix != 2
+           && fh->sizeof_fndn_ix != 4)
+       || (fh->sizeof_cfsi_m_ix != 1 && fh->sizeof_cfsi_m_ix != 2
+           && fh->sizeof_cfsi_m_ix != 4)
+       || !parts_ok(fh, szB))
+      goto bad;
+
+#  define PART(_p) ((void*)(map + fh->part[_p].off))
+#  define N(_p)    ((UWord)fh->part[_p].n)
+   strs     = PART(P_STRS);
+   n_strs   = N(P_STRS);
+   n_fndn   = N(P_FNDN);
+   n_cfsi_m = N(P_CFSI_M);
+   if (n_strs == 0 || strs[n_strs - 1] != 0)
+      goto bad;
+   STR(fh->soname, soname);
+   STR(fh->dbgname, dbgname);
+   if (dbgname != NULL
+       && (sr_isError(VG_(stat)(dbgname, &st))
+           || (ULong)st.size != fh->dbg_size || st.mtime != fh->dbg_mtime))
+      goto bad;
+   delta = first_map(di)->avma - (Addr)fh->base;
+
+   /* The section fields go to a scratch DebugInfo first, and to di
+      only once they are found good. */
+   sects = ML_(dinfo_zalloc)("di.dicache.sects", sizeof(DebugInfo));
+   VG_(memcpy)((UChar*)sects + SECTS_OFF, PART(P_SECTS), SECTS_SZB);
+   if (!sects_ok(sects))
+      goto bad;
+
+   /* Check and fix up the tables, in the mapping only: di is left
+      alone until they are all found good. */
+   {
+      UWord*    secnames = PART(P_SECNAMES);
+      DiSym*    symtab   = PART(P_SYMTAB);
+      DiLoc*    loctab   = PART(P_LOCTAB);
+      DiInlLoc* inltab   = PART(P_INLTAB);
+      FnDn*     fndn     = PART(P_FNDN);
+      Addr*     base     = PART(P_CFSI_BASE);
+      const DiCfSI_m* cfsi_m = PART(P_CFSI_M);
+      const CfiExpr*  exprs  = PART(P_CFSI_EXPRS);
+
+      if (N(P_SECNAMES) > 0 && secnames[N(P_SECNAMES) - 1] != 0)
+         goto bad;
+      for (i = 0; i < N(P_SECNAMES); i++) {
+         const HChar* s;
+         STR(secnames[i], s);
+         secnames[i] = (UWord)s;
+      }
+      for (i = 0; i < N(P_SYMTAB); i++) {
+         DiSym* sym = &symtab[i];
+         UWord  r   = (UWord)sym->sec_names;
+         STR(sym->pri_name, sym->pri_name);
+         if (sym->pri_name == NULL || r > N(P_SECNAMES))
+            goto bad;
+         sym->sec_names = r == 0 ? NULL : (const HChar**)&secnames[r - 1];
+         sym->avmas.main += delta;
+#        if defined(VGA_ppc64be) || defined(VGA_ppc64le)
+         if (GET_TOCPTR_AVMA(sym->avmas) != 0)
+            SET_TOCPTR_AVMA(sym->avmas, GET_TOCPTR_AVMA(sym->avmas) + delta);
+#        endif
+#        if defined(VGA_ppc64le)
+         if (GET_LOCAL_EP_AVMA(sym->avmas) != 0)
+            SET_LOCAL_EP_AVMA(sym->avmas,
+                              GET_LOCAL_EP_AVMA(sym->avmas) + delta);
+#        endif
+      }
+      for (i = 0; i < N(P_LOCTAB); i++)
+         loctab[i].addr += delta;
+      if (N(P_LOCTAB_FNDN_IX) != N(P_LOCTAB))
+         goto bad;
+      for (i = 0; i < N(P_LOCTAB_FNDN_IX); i++)
+         if (get_ix(PART(P_LOCTAB_FNDN_IX), fh->sizeof_fndn_ix, i) > n_fndn)
+            goto bad;
+      for (i = 0; i < N(P_INLTAB); i++) {
+         DiInlLoc* inl = &inltab[i];
+         STR(inl->inlinedfn, inl->inlinedfn);
+         if (inl->fndn_ix > n_fndn)
+            goto bad;
+         inl->addr_lo += delta;
+         inl->addr_hi += delta;
+      }
+      for (i = 0; i < n_fndn; i++) {
+         STR(fndn[i].filename, fndn[i].filename);
+         STR(fndn[i].dirname, fndn[i].dirname);
+      }
+      if (N(P_CFSI_M_IX) != N(P_CFSI_BASE))
+         goto bad;
+      for (i = 0; i < N(P_CFSI_BASE); i++) {
+         base[i] += delta;
+         if (get_ix(PART(P_CFSI_M_IX), fh->sizeof_cfsi_m_ix, i) > n_cfsi_m)
+            goto bad;
+      }
+      for (i = 0; i < N(P_CFSI_EXPRS); i++)
+         if (!cfsi_expr_ok(exprs, i))
+            goto bad;
+      for (i = 0; i < n_cfsi_m; i++)
+         if (!cfsi_m_ok(&cfsi_m[i], N(P_CFSI_EXPRS)))
+            goto bad;
+   }
+
+   /* Build the pools again, in the same order, so that the indexes in
+      the tables still refer to the same elements.  The elements were
+      all different when written; if they are not now, the file is
+      bad. */
+   if (n_fndn > 0) {
+      const FnDn* fndn = PART(P_FNDN);
+      fndnpool = VG_(newDedupPA)(500, vg_alignof(FnDn),
+                                 ML_(dinfo_zalloc),
+                                 "di.dicache.fndnpool",
+                                 ML_(dinfo_free));
+      for (i = 0; i < n_fndn; i++)
+         if (VG_(allocFixedEltDedupPA)(fndnpool, sizeof(FnDn),
+                                       &fndn[i]) != i + 1)
+            goto bad;
+      VG_(freezeDedupPA)(fndnpool, ML_(dinfo_shrink_block));
+   }
+   if (n_cfsi_m > 0) {
+      const DiCfSI_m* m = PART(P_CFSI_M);
+      cfsi_m_pool = VG_(newDedupPA)(1000 * sizeof(DiCfSI_m),
+                                    vg_alignof(DiCfSI_m),
+                                    ML_(dinfo_zalloc),
+                                    "di.dicache.cfsi_m_pool",
+                                    ML_(dinfo_free));
+      for (i = 0; i < n_cfsi_m; i++)
+         if (VG_(allocFixedEltDedupPA)(cfsi_m_pool, sizeof(DiCfSI_m),
+                                       &m[i]) != i + 1)
+            goto bad;
+      VG_(freezeDedupPA)(cfsi_m_pool, ML_(dinfo_shrink_block));
+   }
+
+   /* All good: point di at the tables */
+   VG_(memcpy)((UChar*)di + SECTS_OFF, (UChar*)sects + SECTS_OFF, SECTS_SZB);
+   ML_(dinfo_free)(sects);
+   relocate_sects(di, delta);
+   if (soname)
+      di->soname = ML_(dinfo_strdup)("di.dicache.soname", soname);
+   if (dbgname)
+      di->fsm.dbgname = ML_(dinfo_strdup)("di.dicache.dbgname", dbgname);
+
+   di->symtab         = PART(P_SYMTAB);
+   di->symtab_used    = di->symtab_size = N(P_SYMTAB);
+   di->loctab         = PART(P_LOCTAB);
+   di->loctab_used    = di->loctab_size = N(P_LOCTAB);
+   di->sizeof_fndn_ix = fh->sizeof_fndn_ix;
+   di->loctab_fndn_ix = PART(P_LOCTAB_FNDN_IX);
+   di->inltab         = PART(P_INLTAB);
+   di->inltab_used    = di->inltab_size = N(P_INLTAB);
+   di->maxinl_codesz  = fh->maxinl_codesz;
+   di->cfsi_base      = PART(P_CFSI_BASE);
+   di->cfsi_m_ix      = PART(P_CFSI_M_IX);
+   di->sizeof_cfsi_m_ix = fh->sizeof_cfsi_m_ix;
+   di->cfsi_used      = di->cfsi_size = N(P_CFSI_BASE);
+   di->cfsi_minavma   = fh->cfsi_minavma + delta;
+   di->cfsi_maxavma   = fh->cfsi_maxavma + delta;
+
+   di->fndnpool       = fndnpool;
+   di->cfsi_m_pool    = cfsi_m_pool;
+   if (N(P_CFSI_EXPRS) > 0) {
+      const CfiExpr* e = PART(P_CFSI_EXPRS);
+      di->cfsi_exprs = VG_(newXA)(ML_(dinfo_zalloc), "di.dicache.exprs",
+                                  ML_(dinfo_free), sizeof(CfiExpr));
+      VG_(hintSizeXA)(di->cfsi_exprs, N(P_CFSI_EXPRS));
+      for (i = 0; i < N(P_CFSI_EXPRS); i++)
+         VG_(addToXA)(di->cfsi_exprs, &e[i]);
+   }
+#  undef N
+#  undef PART
+
+   di->dicache_map     = map;
+   di->dicache_map_szB = szB;
+   n_loaded++;
+   if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir))
+      VG_(message)(Vg_DebugMsg, "Reading syms of %s from %s\n",
+                                di->fsm.filename, path);
+   return True;
+
+  bad:
+   if (sects)
+      ML_(dinfo_free)(sects);
+   if (fndnpool)
+      VG_(deleteDedupPA)(fndnpool);
+   if (cfsi_m_pool)
+      VG_(deleteDedupPA)(cfsi_m_pool);
+   if (VG_(clo_verbosity) > 1)
+      VG_(umsg)("debuginfo cache %s is damaged or out of date, "
+                "ignoring it\n", path);
+   VG_(am_munmap_valgrind)((Addr)map, szB);
+   return False;
+}
+
+#undef STR
+
+/*------------------------------------------------------------*/
+/*--- Saving                                               ---*/
+/*------------------------------------------------------------*/
+
+/* The strings of the file, each written once */
+typedef
+   struct _StrNode {
+      struct _StrNode* next;   // VgHashNode
+      UWord            key;    // the string, in di's strpool or mapping
+      UWord            ref;    // 1 + its offset in the strings part
+   }
+   StrNode;
+
+typedef
+   struct {
+      VgHashTable* ht;
+      XArray*      list;       // of StrNode*, in the order of their refs
+      UWord        szB;
+   }
+   Strs;
+
+static UWord str_ref ( Strs* s, const HChar* str )
+{
+   StrNode* n;
+
+   if (str == NULL)
+      return 0;
+   n = VG_(HT_lookup)(s->ht, (UWord)str);
+   if (n == NULL) {
+      n = VG_(malloc)("di.dicache.strnode", sizeof(StrNode));
+      n->key = (UWord)str;
+      n->ref = s->szB + 1;
+      s->szB += VG_(strlen)(str) + 1;
+      VG_(HT_add_node)(s->ht, n);
+      VG_(addToXA)(s->list, &n);
+   }
+   return n->ref;
+}
+
+void ML_(dicache_save) ( const DebugInfo* di, ULong key )
+{
+   HChar       path[VG_(strlen)(VG_(clo_debuginfo_cache)) + 32];
+   HChar       tmp[VG_(strlen)(VG_(clo_debuginfo_cache)) + 48];
+   FileHeader* fh;
+   UChar*      buf;
+   Strs        strs;
+   UWord       n_secnames = 0, n_fndn, n_cfsi_m, n_exprs, i, j;
+   SizeT       szB;
+   UInt        p;
+   SysRes      sres;
+   Int         fd;
+   Bool        ok;
+
+   vg_assert(state > 0);
+   vg_assert(di->cfsi_rd == NULL);
+   if (di->varinfo != NULL || di->fpo != NULL)
+      return;
+   if (VG_(sizeXA)(di->fsm.maps) == 0)
+      return;
+
+   n_fndn   = di->fndnpool ? VG_(sizeDedupPA)(di->fndnpool) : 0;
+   n_cfsi_m = di->cfsi_m_pool ? VG_(sizeDedupPA)(di->cfsi_m_pool) : 0;
+   n_exprs  = di->cfsi_exprs ? VG_(sizeXA)(di->cfsi_exprs) : 0;
+   for (i = 0; i < di->symtab_used; i++) {
+      const HChar** sn = di->symtab[i].sec_names;
+      if (sn == NULL)
+         continue;
+      while (*sn++)
+         n_secnames++;
+      n_secnames++;
+   }
+
+   /* Lay out the parts, all but the strings, which come last */
+   fh = VG_(calloc)("di.dicache.header", 1, sizeof(FileHeader));
+   fh->sizeof_fndn_ix   = di->loctab_used > 0 ? di->sizeof_fndn_ix : 1;
+   fh->sizeof_cfsi_m_ix = di->cfsi_used > 0 ? di->sizeof_cfsi_m_ix : 1;
+   fh->part[P_SECTS].n          = 1;
+   fh->part[P_SYMTAB].n         = di->symtab_used;
+   fh->part[P_SECNAMES].n       = n_secnames;
+   fh->part[P_LOCTAB].n         = di->loctab_used;
+   fh->part[P_LOCTAB_FNDN_IX].n = di->loctab_used;
+   fh->part[P_INLTAB].n         = di->inltab_used;
+   fh->part[P_FNDN].n           = n_fndn;
+   fh->part[P_CFSI_BASE].n      = di->cfsi_used;
+   fh->part[P_CFSI_M_IX].n      = di->cfsi_used;
+   fh->part[P_CFSI_M].n         = n_cfsi_m;
+   fh->part[P_CFSI_EXPRS].n     = n_exprs;
+   szB = sizeof(FileHeader);
+   for (p = 0; p < P_STRS; p++) {
+      fh->part[p].off = szB;
+      szB += VG_ROUNDUP(fh->part[p].n * elt_szB(fh, p), 8);
+   }
+   fh->part[P_STRS].off = szB;
+
+   buf = ML_(dinfo_zalloc)("di.dicache.buf", szB);
+   VG_(memcpy)(buf, fh, sizeof(FileHeader));
+   VG_(free)(fh);
+   fh = (FileHeader*)buf;
+   strs.ht   = VG_(HT_construct)("di.dicache.strs");
+   strs.list = VG_(newXA)(VG_(malloc), "di.dicache.strlist", VG_(free),
+                          sizeof(StrNode*));
+   strs.szB  = 0;
+
+#  define PART(_p) ((void*)(buf + fh->part[_p].off))
+   VG_(memcpy)(PART(P_SECTS), (const UChar*)di + SECTS_OFF, SECTS_SZB);
+   {
+      UWord*    secnames = PART(P_SECNAMES);
+      DiSym*    symtab   = PART(P_SYMTAB);
+      DiInlLoc* inltab   = PART(P_INLTAB);
+      FnDn*     fndn     = PART(P_FNDN);
+
+      VG_(memcpy)(symtab, di->symtab, di->symtab_used * sizeof(DiSym));
+      for (i = 0, j = 0; i < di->symtab_used; i++) {
+         const HChar** sn = di->symtab[i].sec_names;
+         symtab[i].pri_name = (const HChar*)str_ref(&strs,
+                                                    di->symtab[i].pri_name);
+         if (sn == NULL)
+            continue;
+         symtab[i].sec_names = (const HChar**)(j + 1);
+         while (*sn)
+            secnames[j++] = str_ref(&strs, *sn++);
+         secnames[j++] = 0;
+      }
+      vg_assert(j == n_secnames);
+      VG_(memcpy)(PART(P_LOCTAB), di->loctab,
+                  di->loctab_used * sizeof(DiLoc));
+      VG_(memcpy)(PART(P_LOCTAB_FNDN_IX), di->loctab_fndn_ix,
+                  di->loctab_used * fh->sizeof_fndn_ix);
+      VG_(memcpy)(inltab, di->inltab, di->inltab_used * sizeof(DiInlLoc));
+      for (i = 0; i < di->inltab_used; i++)
+         inltab[i].inlinedfn
+            = (const HChar*)str_ref(&strs, di->inltab[i].inlinedfn);
+      for (i = 0; i < n_fndn; i++) {
+         const FnDn* f = VG_(indexEltNumber)(di->fndnpool, i + 1);
+         fndn[i].filename = (const HChar*)str_ref(&strs, f->filename);
+         fndn[i].dirname  = (const HChar*)str_ref(&strs, f->dirname);
+      }
+      VG_(memcpy)(PART(P_CFSI_BASE), di->cfsi_base,
+                  di->cfsi_used * sizeof(Addr));
+      VG_(memcpy)(PART(P_CFSI_M_IX), di->cfsi_m_ix,
+                  di->cfsi_used * fh->sizeof_cfsi_m_ix);
+      for (i = 0; i < n_cfsi_m; i++)
+         VG_(memcpy)((DiCfSI_m*)PART(P_CFSI_M) + i,
+                     VG_(indexEltNumber)(di->cfsi_m_pool, i + 1),
+                     sizeof(DiCfSI_m));
+      for (i = 0; i < n_exprs; i++)
+         VG_(memcpy)((CfiExpr*)PART(P_CFSI_EXPRS) + i,
+                     VG_(indexXA)(di->cfsi_exprs, i), sizeof(CfiExpr));
+   }
+#  undef PART
+
+   VG_(memcpy)(fh->magic, DC_MAGIC, 8);
+   fh->version       = DC_VERSION;
+   fh->header_szB    = sizeof(FileHeader);
+   fh->key           = key;
+   fh->base          = first_map(di)->avma;
+   fh->soname        = str_ref(&strs, di->soname);
+   fh->dbgname       = str_ref(&strs, di->fsm.dbgname);
+   if (di->fsm.dbgname) {
+      struct vg_stat st;
+      if (sr_isError(VG_(stat)(di->fsm.dbgname, &st)))
+         goto out;
+      fh->dbg_size  = st.size;
+      fh->dbg_mtime = st.mtime;
+   }
+   fh->maxinl_codesz = di->maxinl_codesz;
+   fh->cfsi_minavma  = di->cfsi_minavma;
+   fh->cfsi_maxavma  = di->cfsi_maxavma;
+   fh->part[P_STRS].n = strs.szB;
+
+   cache_path(path, key);
+   VG_(sprintf)(tmp, "%s.%d", path, VG_(getpid)());
+   sres = VG_(open)(tmp, VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                    VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sr_isError(sres))
+      goto out;
+   fd = sr_Res(sres);
+   ok = VG_(write)(fd, buf, szB) == (Int)szB;
+   for (i = 0; ok && i < VG_(sizeXA)(strs.list); i++) {
+      const StrNode* n = *(StrNode**)VG_(indexXA)(strs.list, i);
+      Int            len = VG_(strlen)((const HChar*)n->key) + 1;
+      ok = VG_(write)(fd, (const HChar*)n->key, len) == len;
+   }
+   VG_(close)(fd);
+   if (ok && VG_(rename)(tmp, path) == 0) {
+      n_saved++;
+      if (VG_(clo_verbosity) > 2)
+         VG_(dmsg)("dicache: %s -> %s\n", di->fsm.filename, path);
+   } else {
+      VG_(unlink)(tmp);
+   }
+
+  out:
+   VG_(HT_destruct)(strs.ht, VG_(free));
+   VG_(deleteXA)(strs.list);
+   ML_(dinfo_free)(buf);
+}
+
+/*------------------------------------------------------------*/
+/*--- Helper processes                                     ---*/
+/*------------------------------------------------------------*/
+
+/* The pids of the helpers not waited for yet.  The helper of an object
+   that is discarded before it is needed stays here until reaped. */
+static Int helpers[64];
+static Int n_helpers = 0;
+
+/* Take 'pid' off the list.  False if it was not there, because it has
+   been reaped already. */
+static Bool forget_helper ( Int pid )
+{
+   Int i;
+
+   for (i = 0; i < n_helpers; i++) {
+      if (helpers[i] == pid) {
+         helpers[i] = helpers[--n_helpers];
+         return True;
+      }
+   }
+   return False;
+}
+
+/* Reap, without waiting, the helpers which have finished.  The wait
+   fails if the client has forked since the helper was started: its
+   child has no helpers to wait for. */
+static void reap_helpers ( void )
+{
+   Int i = 0, r, status;
+
+   while (i < n_helpers) {
+      r = VG_(waitpid)(helpers[i], &status, VKI_WNOHANG | __VKI_WCLONE);
+      if (r == 0) {
+         i++;
+         continue;
+      }
+      if (r == helpers[i] && status != 0)
+         n_failed++;
+      helpers[i] = helpers[--n_helpers];
+   }
+}
+
+Int ML_(dicache_start_helper) ( DebugInfo* di, ULong key )
+{
+   HChar          path[VG_(strlen)(VG_(clo_debuginfo_cache)) + 32];
+   struct vg_stat st;
+   vki_sigset_t   all;
+   Int            pid;
+
+   vg_assert(state > 0);
+   vg_assert((UInt)VG_(clo_debuginfo_helpers)
+             <= sizeof(helpers) / sizeof(helpers[0]));
+   if (VG_(clo_debuginfo_helpers) == 0)
+      return -1;
+   reap_helpers();
+   if (n_helpers >= VG_(clo_debuginfo_helpers))
+      return -1;
+   /* Nothing to do if an earlier run, or another helper, wrote the
+      file. */
+   cache_path(path, key);
+   if (!sr_isError(VG_(stat)(path, &st)))
+      return -1;
+
+   pid = VG_(fork_quiet)();
+   if (pid < 0)
+      return -1;
+   if (pid == 0) {
+      /* The helper.  It gets none of the client's signals, which
+         Valgrind would otherwise try to deliver to the client. */
+      VG_(sigfillset)(&all);
+      VG_(sigprocmask)(VKI_SIG_SETMASK, &all, NULL);
+      return 0;
+   }
+
+   helpers[n_helpers++] = pid;
+   di->dicache_helper = pid;
+   n_started++;
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg, "Reading syms from %s in helper %d\n",
+                                di->fsm.filename, pid);
+   return pid;
+}
+
+void ML_(dicache_wait_helper) ( DebugInfo* di )
+{
+   Int pid = di->dicache_helper;
+   Int r, status;
+
+   vg_assert(pid > 0);
+   di->dicache_helper = 0;
+   if (!forget_helper(pid))
+      return;
+   r = VG_(waitpid)(pid, &status, VKI_WNOHANG | __VKI_WCLONE);
+   if (r == 0) {
+      n_waited++;
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg, "Waiting for helper %d to read %s\n",
+                                   pid, di->fsm.filename);
+      r = VG_(waitpid)(pid, &status, __VKI_WCLONE);
+   }
+   if (r == pid && status != 0)
+      n_failed++;
+}
+
+#endif // defined(VGO_linux) || defined(VGO_solaris)
+
+void ML_(dicache_forget) ( DebugInfo* di )
+{
+   vg_assert(di->dicache_map != NULL);
+   di->symtab         = NULL;
+   di->loctab         = NULL;
+   di->loctab_fndn_ix = NULL;
+   di->inltab         = NULL;
+   di->cfsi_base      = NULL;
+   di->cfsi_m_ix      = NULL;
+   VG_(am_munmap_valgrind)((Addr)di->dicache_map, di->dicache_map_szB);
+   di->dicache_map     = NULL;
+   di->dicache_map_szB = 0;
+}
+
+void VG_(print_debuginfo_cache_stats) ( void )
+{
+#  if defined(VGO_linux) || defined(VGO_solaris)
+   if (state <= 0)
+      return;
+   VG_(message)(Vg_DebugMsg,
+                "dicache: %'llu objects read from the cache, %'llu written, "
+                "%'llu without a build-id\n",
+                n_loaded, n_saved, n_uncached);
+   if (n_started > 0)
+      VG_(message)(Vg_DebugMsg,
+                   "dicache: %'llu helpers started, %'llu waited for, "
+                   "%'llu failed\n",
+                   n_started, n_waited, n_failed);
+#  endif
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,70 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Processed debug info kept on disk between runs.              ---*/
+/*---                                                priv_dicache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PRIV_DICACHE_H
+#define __PRIV_DICACHE_H
+
+#include "pub_core_basics.h"      // ULong
+#include "pub_core_debuginfo.h"   // DebugInfo
+
+/* With --debuginfo-cache=DIR, the tables of an ELF object, as they are
+   once read and canonicalised, are kept in a file in DIR named after
+   the object's build-id and the layout of its mappings.  Later runs
+   map that file and use the tables in place, instead of reading the
+   object's symbols, line numbers and CFI again. */
+
+/* Compute in *key the name of di's file in the cache.  False if di
+   cannot be kept: the option is not given, di has no build-id, or
+   reading it is being traced, say.  The answer is kept in di. */
+extern Bool ML_(dicache_key) ( DebugInfo* di, /*OUT*/ULong* key );
+
+/* Fill in di from the cache file 'key', if there is a good one.
+   Returns False, leaving di untouched, if not. */
+extern Bool ML_(dicache_load) ( DebugInfo* di, ULong key );
+
+/* Write di, just read and canonicalised, to the cache file 'key'. */
+extern void ML_(dicache_save) ( const DebugInfo* di, ULong key );
+
+/* Called as di is freed: unmap the cache file its tables are in, and
+   set the fields pointing there to NULL. */
+extern void ML_(dicache_forget) ( DebugInfo* di );
+
+/* With --debuginfo-helpers=N, fork a process to read di and write the
+   cache file 'key', so that Valgrind can defer reading di until a
+   query needs it and then just map that file.  Returns -1 if none was
+   started: N helpers are busy, or the file exists already.  Returns
+   the helper's pid, also noted in di->dicache_helper, in Valgrind,
+   and 0 in the helper, which is then to read di, save it and exit. */
+extern Int ML_(dicache_start_helper) ( DebugInfo* di, ULong key );
+
+/* Wait until the helper of di has finished with its file. */
+extern void ML_(dicache_wait_helper) ( DebugInfo* di );
+
+#endif /* ndef __PRIV_DICACHE_H */
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
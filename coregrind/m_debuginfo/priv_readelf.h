@@ -52,6 +52,11 @@ extern Bool ML_(is_elf_object_file)( const void* image, SizeT n_image,
 */
 extern Bool ML_(read_elf_debug_info) ( DebugInfo* di );
 
+/* The build-id of the ELF object in the local file 'filename', as a
+   string of hex digits to be freed with ML_(dinfo_free), or NULL if it
+   has none. */
+extern HChar* ML_(find_elf_buildid) ( const HChar* filename );
+
 
 #endif /* ndef __PRIV_READELF_H */
 
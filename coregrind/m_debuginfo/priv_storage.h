@@ -585,6 +585,13 @@ struct _DebugInfoFSM
    Bool  have_rx_map; /* did we see a r?x mapping yet for the file? */
    Bool  have_rw_map; /* did we see a rw? mapping yet for the file? */
    Bool  have_ro_map; /* did we see a r-- mapping yet for the file? */
+   /* The identity of the file when it was last mapped, so that its
+      debug info is not read from another file if reading is deferred
+      (--lazy-debuginfo=yes) and the file is replaced meanwhile. */
+   ULong dev;
+   ULong ino;
+   Long  size;
+   ULong mtime;
 };
 
 
@@ -676,6 +683,13 @@ struct _DebugInfo {
       invalid and should not be consulted. */
    Bool  have_dinfo; /* initially False */
 
+   /* With --lazy-debuginfo=yes or --debuginfo-helpers, the reading
+      may be deferred at the accept state, until a query first needs
+      this object.  While .deferred is True, the DebugInfo is active
+      (its .first_epoch is that of the mapping) but .have_dinfo is
+      still False. */
+   Bool  deferred; /* initially False */
+
    /* All the rest of the fields in this structure are filled in once
       we have committed to reading the symbols and debug info (that
       is, at the point where .have_dinfo is set to True). */
@@ -1046,6 +1060,22 @@ struct _DebugInfo {
       This helps performance a lot during ML_(addLineInfo) etc., which can
       easily be invoked hundreds of thousands of times. */
    DebugInfoMapping* last_rx_map;
+
+   /* If the tables above were found in the --debuginfo-cache rather
+      than read from the object, the cache file they are in, mapped
+      privately, and its size.  See dicache.c. */
+   UChar* dicache_map;
+   SizeT  dicache_map_szB;
+
+   /* The name of this object's file in the --debuginfo-cache, once
+      ML_(dicache_key) has been asked for it: .dicache_keyed is 1 if
+      .dicache_key holds it, -1 if the object cannot be kept there, 0
+      if not asked yet.  And with --debuginfo-helpers, the pid of the
+      helper process writing that file while reading is deferred, or
+      0. */
+   Int    dicache_keyed;
+   ULong  dicache_key;
+   Int    dicache_helper;
 };
 
 /* --------------------- functions --------------------- */
@@ -1218,6 +1218,18 @@ HChar* find_buildid(DiImage* img, Bool rel_ok, Bool search_shdrs)
    return buildid;
 }
 
+HChar* ML_(find_elf_buildid) ( const HChar* filename )
+{
+   DiImage* img = ML_(img_from_local_file)(filename);
+   HChar*   buildid;
+
+   if (img == NULL)
+      return NULL;
+   buildid = find_buildid(img, False, False);
+   ML_(img_done)(img);
+   return buildid;
+}
+
 
 /* Try and open a separate debug file, ignoring any where the CRC does
    not match the value from the main object file.  Returned DiImage
@@ -592,6 +592,14 @@ Bool VG_(gdbserver_init_done) (void)
    return gdbserver_called > 0;
 }
 
+Bool VG_(gdbserver_instrumenting) (void)
+{
+   return gdbserver_called > 0
+      && (valgrind_single_stepping()
+          || VG_(clo_vgdb) == Vg_VgdbFull
+          || VG_(HT_count_nodes) (gs_addresses) > 0);
+}
+
 Bool VG_(gdbserver_stop_at) (VgdbStopAt stopat)
 {
    return gdbserver_called > 0 && VgdbStopAtiS(stopat, VG_(clo_vgdb_stop_at));
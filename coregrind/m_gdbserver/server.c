@@ -169,6 +169,7 @@ void VG_(print_all_stats) (Bool memory_stats, Bool tool_stats)
 
    VG_(print_translation_stats)();
    VG_(print_tt_tc_stats)();
+   VG_(print_debuginfo_cache_stats)();
    VG_(print_scheduler_stats)();
    VG_(print_ExeContext_stats)( False /* with_stacktraces */ );
    VG_(print_errormgr_stats)();
@@ -235,6 +236,7 @@ int handle_gdb_valgrind_command (char *mon, OutputSink *sink_wanted_at_return)
 "  v.info location <addr>  : show information about location <addr>\n"
 "  v.info n_errs_found [msg] : show the nr of errors found so far and the given msg\n"
 "  v.info open_fds         : show open file descriptors (only if --track-fds=yes)\n"
+"  v.info transtab         : show recycling and growth of the translation cache\n"
 "  v.kill                  : kill the Valgrind process\n"
 "  v.clo <clo_option>...   : changes one or more dynamic command line options\n"
 "     with no clo_option, show the dynamically changeable options.\n"
@@ -369,7 +371,7 @@ int handle_gdb_valgrind_command (char *mon, OutputSink *sink_wanted_at_return)
       wcmd = strtok_r (NULL, " ", &ssaveptr);
       switch (kwdid = VG_(keyword_id)
               ("all_errors n_errs_found last_error gdbserver_status memory"
-               " scheduler stats open_fds exectxt location unwind",
+               " scheduler stats open_fds exectxt location unwind transtab",
                wcmd, kwd_report_all)) {
       case -2:
       case -1:
@@ -471,6 +473,10 @@ int handle_gdb_valgrind_command (char *mon, OutputSink *sink_wanted_at_return)
          ret = 1;
          break;
       }
+      case 11: /* transtab */
+         VG_(print_tt_tc_sector_stats)(False /* brief */);
+         ret = 1;
+         break;
 
       default:
          vg_assert(0);
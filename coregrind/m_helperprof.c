@@ -0,0 +1,370 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Profiling the helpers called by instrumented code.          ---*/
+/*---                                               m_helperprof.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_hashtable.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_machine.h"       // VG_(fnptr_to_fnentry)
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_helperprof.h"    // self
+
+/* Each helper has a node, found by its address when a superblock is
+   instrumented.  The generated code increments the node's call count
+   inline, before the call.  With --profile-helpers=cycles, one call in
+   SAMPLE_EVERY is also bracketed by calls to helperprof_start and
+   helperprof_stop, guarded so that the others cost no more than the
+   increment; the cycles of a helper are estimated from those of its
+   sampled calls.  Nodes are never freed, since translations hold their
+   addresses. */
+
+#define SAMPLE_EVERY 64
+
+typedef
+   struct _Helper {
+      struct _Helper* next;
+      UWord           addr;      // key
+      const HChar*    name;
+      ULong           calls;     // updated by the generated code
+      ULong           samples;
+      ULong           cycles;    // of the samples
+   }
+   Helper;
+
+static VgHashTable* helpers    = NULL;
+static UInt         n_profiles = 0;
+
+/*------------------------------------------------------------*/
+/*--- Reading the cycle counter                            ---*/
+/*------------------------------------------------------------*/
+
+#if defined(VGA_x86) || defined(VGA_amd64)
+#  define HAVE_CYCLES 1
+static inline ULong read_cycles ( void )
+{
+   UInt lo, hi;
+   __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+   return ((ULong)hi << 32) | lo;
+}
+#elif defined(VGA_arm64)
+/* The virtual timer ticks at a fixed rate, not at the core's clock,
+   but still serves to compare helpers with each other. */
+#  define HAVE_CYCLES 1
+static inline ULong read_cycles ( void )
+{
+   ULong v;
+   __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r"(v));
+   return v;
+}
+#else
+#  define HAVE_CYCLES 0
+static inline ULong read_cycles ( void )
+{
+   return 0;
+}
+#endif
+
+static Helper* timed       = NULL;
+static ULong   timed_start = 0;
+
+static VG_REGPARM(1) void helperprof_start ( Helper* h )
+{
+   timed       = h;
+   timed_start = read_cycles();
+}
+
+/* If the helper in between did not return (a longjmp out of it, say),
+   the next start overrides this sample. */
+static VG_REGPARM(1) void helperprof_stop ( Helper* h )
+{
+   ULong now = read_cycles();
+
+   if (timed == h) {
+      h->samples++;
+      h->cycles += now - timed_start;
+      timed = NULL;
+   }
+}
+
+/*------------------------------------------------------------*/
+/*--- Instrumentation                                      ---*/
+/*------------------------------------------------------------*/
+
+#if defined(VG_BIGENDIAN)
+#  define END Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+#  define END Iend_LE
+#else
+#  error "Unknown endianness"
+#endif
+
+static Bool timing ( void )
+{
+   static Int warned = 0;
+
+   if (VG_(clo_profile_helpers) < 2)
+      return False;
+   if (!HAVE_CYCLES) {
+      if (!warned) {
+         warned = 1;
+         VG_(umsg)("Warning: cannot read a cycle counter on this "
+                   "platform, counting helper calls only\n");
+      }
+      return False;
+   }
+   return True;
+}
+
+static Helper* helper_for ( const IRCallee* cee )
+{
+   Helper* h;
+
+   if (helpers == NULL)
+      helpers = VG_(HT_construct)("helperprof.helpers");
+   h = VG_(HT_lookup)(helpers, (UWord)cee->addr);
+   if (h == NULL) {
+      h = VG_(calloc)("helperprof.helper", 1, sizeof(Helper));
+      h->addr = (UWord)cee->addr;
+      h->name = VG_(strdup)("helperprof.name", cee->name);
+      VG_(HT_add_node)(helpers, h);
+   }
+   return h;
+}
+
+static IRTemp assign ( IRSB* sb, IRType ty, IRExpr* e )
+{
+   IRTemp t = newIRTemp(sb->tyenv, ty);
+   addStmtToIRSB(sb, IRStmt_WrTmp(t, e));
+   return t;
+}
+
+static Bool is_true ( const IRExpr* guard )
+{
+   return guard->tag == Iex_Const
+          && guard->Iex.Const.con->tag == Ico_U1
+          && guard->Iex.Const.con->Ico.U1;
+}
+
+/* Add to sb the counting of a call to 'h' made if 'guard' holds, and
+   return the guard of the timing of that call, or NULL if it is not
+   to be timed. */
+static IRExpr* add_count ( IRSB* sb, Helper* h, IRExpr* guard )
+{
+   IRExpr* calls = mkIRExpr_HWord((HWord)&h->calls);
+   IRExpr* inc;
+   IRTemp  old, sum, due;
+
+   inc = is_true(guard)
+            ? IRExpr_Const(IRConst_U64(1))
+            : IRExpr_RdTmp(assign(sb, Ity_I64,
+                                  IRExpr_Unop(Iop_1Uto64, guard)));
+   old = assign(sb, Ity_I64, IRExpr_Load(END, Ity_I64, calls));
+   sum = assign(sb, Ity_I64,
+                IRExpr_Binop(Iop_Add64, IRExpr_RdTmp(old), inc));
+   addStmtToIRSB(sb, IRStmt_Store(END, calls, IRExpr_RdTmp(sum)));
+   if (!timing())
+      return NULL;
+
+   /* Time the call if it is made and is the SAMPLE_EVERY'th: that is,
+      if ((sum & (SAMPLE_EVERY-1)) | (inc ^ 1)) == 0. */
+   due = assign(sb, Ity_I64,
+                IRExpr_Binop(Iop_And64, IRExpr_RdTmp(sum),
+                             IRExpr_Const(IRConst_U64(SAMPLE_EVERY - 1))));
+   if (!is_true(guard)) {
+      IRTemp not_made
+         = assign(sb, Ity_I64,
+                  IRExpr_Binop(Iop_Xor64, inc, IRExpr_Const(IRConst_U64(1))));
+      due = assign(sb, Ity_I64,
+                   IRExpr_Binop(Iop_Or64, IRExpr_RdTmp(due),
+                                IRExpr_RdTmp(not_made)));
+   }
+   return IRExpr_RdTmp(assign(sb, Ity_I1,
+                              IRExpr_Binop(Iop_CmpEQ64, IRExpr_RdTmp(due),
+                                           IRExpr_Const(IRConst_U64(0)))));
+}
+
+static void add_timer ( IRSB* sb, Helper* h, IRExpr* due, Bool start )
+{
+   IRDirty* di
+      = start ? unsafeIRDirty_0_N(1, "helperprof_start",
+                                  VG_(fnptr_to_fnentry)(helperprof_start),
+                                  mkIRExprVec_1(mkIRExpr_HWord((HWord)h)))
+              : unsafeIRDirty_0_N(1, "helperprof_stop",
+                                  VG_(fnptr_to_fnentry)(helperprof_stop),
+                                  mkIRExprVec_1(mkIRExpr_HWord((HWord)h)));
+   di->guard = due;
+   addStmtToIRSB(sb, IRStmt_Dirty(di));
+}
+
+IRSB* VG_(helperprof_instrument) ( IRSB* sb_in )
+{
+   IRSB* sb = deepCopyIRSBExceptStmts(sb_in);
+   Int   i;
+
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      IRStmt*  st = sb_in->stmts[i];
+      IRDirty* d;
+      Helper*  h;
+      IRExpr*  due;
+
+      if (st->tag != Ist_Dirty) {
+         addStmtToIRSB(sb, st);
+         continue;
+      }
+      d   = st->Ist.Dirty.details;
+      h   = helper_for(d->cee);
+      due = add_count(sb, h, d->guard);
+      if (due)
+         add_timer(sb, h, due, True);
+      addStmtToIRSB(sb, st);
+      if (due)
+         add_timer(sb, h, due, False);
+   }
+   return sb;
+}
+
+/*------------------------------------------------------------*/
+/*--- Showing the profile                                  ---*/
+/*------------------------------------------------------------*/
+
+/* The cycles spent in all of h's calls, as estimated from those of
+   its samples. */
+static ULong est_cycles ( const Helper* h )
+{
+   if (h->samples == 0)
+      return 0;
+   return (ULong)((Double)h->cycles * h->calls / h->samples);
+}
+
+static Int cmp_calls ( const void* v1, const void* v2 )
+{
+   const Helper* h1 = *(const Helper* const*)v1;
+   const Helper* h2 = *(const Helper* const*)v2;
+   if (h1->calls != h2->calls)
+      return h1->calls > h2->calls ? -1 : 1;
+   return VG_(strcmp)(h1->name, h2->name);
+}
+
+static Int cmp_cycles ( const void* v1, const void* v2 )
+{
+   const Helper* h1 = *(const Helper* const*)v1;
+   const Helper* h2 = *(const Helper* const*)v2;
+   ULong         c1 = est_cycles(h1);
+   ULong         c2 = est_cycles(h2);
+   if (c1 != c2)
+      return c1 > c2 ? -1 : 1;
+   return cmp_calls(v1, v2);
+}
+
+void VG_(helperprof_show) ( ULong ecs_done )
+{
+   /* The number of helpers to show for a mid-run profile */
+#  define N_MAX_INTERVAL 20
+   Helper** all;
+   UInt     n_all, n_show, r;
+   ULong    calls_total = 0, cycles_total = 0;
+   Bool     cycles = timing();
+   HChar    ecs_txt[50];    // large enough
+
+   if (ecs_done > 0)
+      VG_(sprintf)(ecs_txt, "%'llu ecs done", ecs_done);
+   else
+      VG_(strcpy)(ecs_txt, "for the entire run");
+
+   all = helpers ? (Helper**)VG_(HT_to_array)(helpers, &n_all) : NULL;
+   if (all == NULL)
+      n_all = 0;
+   for (r = 0; r < n_all; r++) {
+      calls_total  += all[r]->calls;
+      cycles_total += est_cycles(all[r]);
+   }
+   if (n_all > 0)
+      VG_(ssort)(all, n_all, sizeof(Helper*),
+                 cycles ? cmp_cycles : cmp_calls);
+   n_show = ecs_done > 0 && n_all > N_MAX_INTERVAL ? N_MAX_INTERVAL : n_all;
+
+   VG_(printf)("\n");
+   VG_(printf)("<<< BEGIN Helper Profile #%u (%s)\n",
+               ++n_profiles, ecs_txt);
+   VG_(printf)("<<<\n");
+   VG_(printf)("\n");
+   VG_(printf)("Total calls = %'llu\n", calls_total);
+   if (cycles)
+      VG_(printf)("Total cycles = %'llu (estimated, 1 call in %d timed)\n",
+                  cycles_total, SAMPLE_EVERY);
+   VG_(printf)("\n");
+
+   if (cycles)
+      VG_(printf)("rank  -------calls-------   ---------cycles---------"
+                  "   per-call  helper\n");
+   else
+      VG_(printf)("rank  -------calls-------   helper\n");
+   for (r = 0; r < n_show; r++) {
+      const Helper* h = all[r];
+      /* Careful: do not divide by zero. */
+      Double pc_calls = calls_total == 0
+                           ? 0.0 : h->calls * 100.0 / calls_total;
+      if (h->calls == 0)
+         break;
+      if (cycles && h->samples > 0) {
+         ULong  est = est_cycles(h);
+         Double pc_cycles = cycles_total == 0
+                               ? 0.0 : est * 100.0 / cycles_total;
+         VG_(printf)("%3u: %'13llu %5.2f%%   %'15llu %5.2f%%   %8.1f  %s\n",
+                     r, h->calls, pc_calls, est, pc_cycles,
+                     (Double)h->cycles / h->samples, h->name);
+      } else if (cycles) {
+         /* Too few calls to have been timed */
+         VG_(printf)("%3u: %'13llu %5.2f%%   %15s %6s   %8s  %s\n",
+                     r, h->calls, pc_calls, "-", "-", "-", h->name);
+      } else {
+         VG_(printf)("%3u: %'13llu %5.2f%%   %s\n",
+                     r, h->calls, pc_calls, h->name);
+      }
+   }
+
+   VG_(printf)("\n");
+   VG_(printf)(">>>\n");
+   VG_(printf)(">>> END Helper Profile #%u (%s)\n",
+               n_profiles, ecs_txt);
+   VG_(printf)(">>>\n");
+   VG_(printf)("\n");
+
+   for (r = 0; r < n_all; r++) {
+      all[r]->calls   = 0;
+      all[r]->samples = 0;
+      all[r]->cycles  = 0;
+   }
+   if (all)
+      VG_(free)(all);
+#  undef N_MAX_INTERVAL
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                           m_helperprof.c ---*/
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,207 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Counting guest instructions, with events at given counts.   ---*/
+/*---                                                   m_icount.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_machine.h"       // VG_(fnptr_to_fnentry)
+#include "pub_core_mallocfree.h"
+#include "pub_core_transtab.h"      // VG_(ok_to_discard_translations)
+#include "pub_core_icount.h"        // self
+
+/* The generated code loads 'icount' once per superblock, stores it
+   back at each exit, and before each instruction compares the count
+   so far with 'icount_next', the earliest scheduled event (~0 if there
+   is none).  Only when it is due does it call icount_fire.  So between
+   events the cost is a few inline instructions per guest instruction,
+   and no helper calls. */
+
+static ULong icount      = 0;
+static ULong icount_next = ~0ULL;
+
+/* Pending events, a binary min-heap on (at, seq).  seq keeps events
+   scheduled for the same count in the order they were scheduled. */
+typedef
+   struct {
+      ULong      at;
+      ULong      seq;
+      VgICountFn fn;
+      void*      opaque;
+   }
+   Event;
+
+static Event* heap      = NULL;
+static UInt   heap_used = 0;
+static UInt   heap_size = 0;
+static ULong  heap_seq  = 0;
+
+static Bool event_lt ( const Event* a, const Event* b )
+{
+   return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+}
+
+static void heap_push ( Event e )
+{
+   UInt i;
+
+   if (heap_used == heap_size) {
+      heap_size = heap_size ? 2 * heap_size : 16;
+      heap = VG_(realloc)("icount.heap", heap, heap_size * sizeof(Event));
+   }
+   for (i = heap_used++; i > 0 && event_lt(&e, &heap[(i - 1) / 2]);
+        i = (i - 1) / 2)
+      heap[i] = heap[(i - 1) / 2];
+   heap[i] = e;
+}
+
+static Event heap_pop ( void )
+{
+   Event top = heap[0];
+   Event last;
+   UInt  i, c;
+
+   vg_assert(heap_used > 0);
+   last = heap[--heap_used];
+   for (i = 0; (c = 2 * i + 1) < heap_used; i = c) {
+      if (c + 1 < heap_used && event_lt(&heap[c + 1], &heap[c]))
+         c++;
+      if (!event_lt(&heap[c], &last))
+         break;
+      heap[i] = heap[c];
+   }
+   heap[i] = last;
+   return top;
+}
+
+void VG_(icount_at) ( ULong at, VgICountFn fn, void* opaque )
+{
+   Event e;
+
+   vg_assert(fn);
+   e.at     = at;
+   e.seq    = heap_seq++;
+   e.fn     = fn;
+   e.opaque = opaque;
+   heap_push(e);
+   icount_next = heap[0].at;
+}
+
+ULong VG_(icount_now) ( void )
+{
+   return icount;
+}
+
+/* Called, before an instruction, when 'now' instructions have
+   completed and the earliest event is due.  Callbacks may discard
+   translations, to instrument differently from then on: as for
+   gdbserver's breakpoints, the block calling this carries on to its
+   end, and only later blocks are translated again. */
+static void icount_fire ( ULong now )
+{
+   icount = now;
+   VG_(ok_to_discard_translations) = True;
+   while (heap_used > 0 && heap[0].at <= now) {
+      Event e = heap_pop();
+      icount_next = heap_used > 0 ? heap[0].at : ~0ULL;
+      e.fn(now, e.opaque);
+   }
+   VG_(ok_to_discard_translations) = False;
+   icount_next = heap_used > 0 ? heap[0].at : ~0ULL;
+}
+
+/*------------------------------------------------------------*/
+/*--- Instrumentation                                      ---*/
+/*------------------------------------------------------------*/
+
+#if defined(VG_BIGENDIAN)
+#  define END Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+#  define END Iend_LE
+#else
+#  error "Unknown endianness"
+#endif
+
+/* The count after the first ic->n instructions of the superblock */
+static IRExpr* icount_sofar ( VgICountSB* ic, IRSB* sbOut )
+{
+   IRTemp t;
+
+   if (ic->n == 0)
+      return IRExpr_RdTmp(ic->base);
+   t = newIRTemp(sbOut->tyenv, Ity_I64);
+   addStmtToIRSB(sbOut,
+                 IRStmt_WrTmp(t, IRExpr_Binop(Iop_Add64,
+                                              IRExpr_RdTmp(ic->base),
+                                              IRExpr_Const(IRConst_U64(ic->n)))));
+   return IRExpr_RdTmp(t);
+}
+
+void VG_(icount_sb_start) ( VgICountSB* ic, IRSB* sbOut )
+{
+   ic->base = newIRTemp(sbOut->tyenv, Ity_I64);
+   ic->n    = 0;
+   addStmtToIRSB(sbOut,
+                 IRStmt_WrTmp(ic->base,
+                              IRExpr_Load(END, Ity_I64,
+                                          mkIRExpr_HWord((HWord)&icount))));
+}
+
+void VG_(icount_imark) ( VgICountSB* ic, IRSB* sbOut )
+{
+   IRExpr*  now  = icount_sofar(ic, sbOut);
+   IRTemp   next = newIRTemp(sbOut->tyenv, Ity_I64);
+   IRTemp   due  = newIRTemp(sbOut->tyenv, Ity_I1);
+   IRDirty* di;
+
+   addStmtToIRSB(sbOut,
+                 IRStmt_WrTmp(next,
+                              IRExpr_Load(END, Ity_I64,
+                                          mkIRExpr_HWord((HWord)&icount_next))));
+   addStmtToIRSB(sbOut,
+                 IRStmt_WrTmp(due, IRExpr_Binop(Iop_CmpLE64U,
+                                                IRExpr_RdTmp(next), now)));
+   di = unsafeIRDirty_0_N(0, "icount_fire",
+                          VG_(fnptr_to_fnentry)(icount_fire),
+                          mkIRExprVec_1(now));
+   di->guard = IRExpr_RdTmp(due);
+   addStmtToIRSB(sbOut, IRStmt_Dirty(di));
+   ic->n++;
+}
+
+void VG_(icount_exit) ( VgICountSB* ic, IRSB* sbOut )
+{
+   addStmtToIRSB(sbOut,
+                 IRStmt_Store(END, mkIRExpr_HWord((HWord)&icount),
+                              icount_sofar(ic, sbOut)));
+}
+
+void VG_(icount_sb_end) ( VgICountSB* ic, IRSB* sbOut )
+{
+   VG_(icount_exit)(ic, sbOut);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -1129,6 +1129,35 @@ Int VG_(connect_via_socket)( const HChar* str )
 }
 
 
+/* Connect to the UNIX domain stream socket at path.  Returns the
+   socket, or minus the error number if path is too long or the
+   connection fails. */
+Int VG_(connect_via_unix_socket)( const HChar* path )
+{
+   Int sd, res;
+   struct vki_sockaddr_un servAddr;
+
+   if (VG_(strlen)(path) >= sizeof(servAddr.sun_path))
+      return -VKI_EINVAL;
+   VG_(memset)(&servAddr, 0, sizeof(servAddr));
+   servAddr.sun_family = VKI_AF_UNIX;
+   VG_(strcpy)(servAddr.sun_path, path);
+
+   sd = VG_(socket)(VKI_AF_UNIX, VKI_SOCK_STREAM, 0);
+   if (sd < 0)
+      return sd;
+
+   res = my_connect(sd, (struct vki_sockaddr_in *)&servAddr,
+                    sizeof(servAddr));
+   if (res < 0) {
+      VG_(close)(sd);
+      return res;
+   }
+
+   return sd;
+}
+
+
 /* Let d = one or more digits.  Accept either:
    d.d.d.d  or  d.d.d.d:d
 */
@@ -1185,14 +1214,14 @@ Int VG_(socket) ( Int domain, Int type, Int protocol )
    args[1] = type;
    args[2] = protocol;
    res = VG_(do_syscall2)(__NR_socketcall, VKI_SYS_SOCKET, (UWord)&args);
-   return sr_isError(res) ? -1 : sr_Res(res);
+   return sr_isError(res) ? -(Int)sr_Err(res) : sr_Res(res);
 
 #  elif defined(VGP_amd64_linux) || defined(VGP_arm_linux) \
         || defined(VGP_mips32_linux) || defined(VGP_mips64_linux) \
         || defined(VGP_arm64_linux) || defined(VGP_nanomips_linux)
    SysRes res;
    res = VG_(do_syscall3)(__NR_socket, domain, type, protocol );
-   return sr_isError(res) ? -1 : sr_Res(res);
+   return sr_isError(res) ? -(Int)sr_Err(res) : sr_Res(res);
 
 #  elif defined(VGO_darwin)
    SysRes res;
@@ -1206,7 +1235,7 @@ Int VG_(socket) ( Int domain, Int type, Int protocol )
                                sizeof(optval));
        // ignore setsockopt() error
    }
-   return sr_isError(res) ? -1 : sr_Res(res);
+   return sr_isError(res) ? -(Int)sr_Err(res) : sr_Res(res);
 
 #  elif defined(VGO_solaris)
    /* XXX There doesn't seem to be an easy way to convince the send syscall to
@@ -1220,7 +1249,7 @@ Int VG_(socket) ( Int domain, Int type, Int protocol )
    SysRes res;
    res = VG_(do_syscall5)(__NR_so_socket, domain, type, protocol,
                           0 /*devpath*/, VKI_SOV_DEFAULT /*version*/);
-   return sr_isError(res) ? -1 : sr_Res(res);
+   return sr_isError(res) ? -(Int)sr_Err(res) : sr_Res(res);
 
 #  else
 #    error "Unknown arch"
@@ -1228,6 +1257,37 @@ Int VG_(socket) ( Int domain, Int type, Int protocol )
 }
 
 
+Int VG_(socketpair) ( Int domain, Int type, Int protocol, Int sv[2] )
+{
+#  if defined(VGP_x86_linux) || defined(VGP_ppc32_linux) \
+      || defined(VGP_ppc64be_linux) || defined(VGP_ppc64le_linux) \
+      || defined(VGP_s390x_linux)
+   SysRes res;
+   UWord  args[4];
+   args[0] = domain;
+   args[1] = type;
+   args[2] = protocol;
+   args[3] = (UWord)sv;
+   res = VG_(do_syscall2)(__NR_socketcall, VKI_SYS_SOCKETPAIR, (UWord)&args);
+   return sr_isError(res) ? -(Int)sr_Err(res) : 0;
+
+#  elif defined(VGP_amd64_linux) || defined(VGP_arm_linux) \
+        || defined(VGP_mips32_linux) || defined(VGP_mips64_linux) \
+        || defined(VGP_arm64_linux) || defined(VGP_nanomips_linux) \
+        || defined(VGO_darwin)
+   SysRes res;
+   res = VG_(do_syscall4)(__NR_socketpair, domain, type, protocol, (UWord)sv);
+   return sr_isError(res) ? -(Int)sr_Err(res) : 0;
+
+#  elif defined(VGO_solaris)
+   /* Not needed so far. */
+   return -VKI_ENOSYS;
+
+#  else
+#    error "Unknown arch"
+#  endif
+}
+
 static
 Int my_connect ( Int sockfd, struct vki_sockaddr_in* serv_addr, Int addrlen )
 {
@@ -1240,26 +1300,26 @@ Int my_connect ( Int sockfd, struct vki_sockaddr_in* serv_addr, Int addrlen )
    args[1] = (UWord)serv_addr;
    args[2] = addrlen;
    res = VG_(do_syscall2)(__NR_socketcall, VKI_SYS_CONNECT, (UWord)&args);
-   return sr_isError(res) ? -1 : sr_Res(res);
+   return sr_isError(res) ? -(Int)sr_Err(res) : sr_Res(res);
 
 #  elif defined(VGP_amd64_linux) || defined(VGP_arm_linux) \
         || defined(VGP_mips32_linux) || defined(VGP_mips64_linux) \
         || defined(VGP_arm64_linux) || defined(VGP_nanomips_linux)
    SysRes res;
    res = VG_(do_syscall3)(__NR_connect, sockfd, (UWord)serv_addr, addrlen);
-   return sr_isError(res) ? -1 : sr_Res(res);
+   return sr_isError(res) ? -(Int)sr_Err(res) : sr_Res(res);
 
 #  elif defined(VGO_darwin)
    SysRes res;
    res = VG_(do_syscall3)(__NR_connect_nocancel,
                           sockfd, (UWord)serv_addr, addrlen);
-   return sr_isError(res) ? -1 : sr_Res(res);
+   return sr_isError(res) ? -(Int)sr_Err(res) : sr_Res(res);
 
 #  elif defined(VGO_solaris)
    SysRes res;
    res = VG_(do_syscall4)(__NR_connect, sockfd, (UWord)serv_addr, addrlen,
                           VKI_SOV_DEFAULT /*version*/);
-   return sr_isError(res) ? -1 : sr_Res(res);
+   return sr_isError(res) ? -(Int)sr_Err(res) : sr_Res(res);
 
 #  else
 #    error "Unknown arch"
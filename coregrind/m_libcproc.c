@@ -877,6 +877,8 @@ Int VG_(ptrace) ( Int request, Int pid, void *addr, void *data )
    Fork
    ------------------------------------------------------------------ */
 
+/* Returns the child's pid in the parent and 0 in the child, or minus
+   the error number if there is no child. */
 Int VG_(fork) ( void )
 {
 #  if defined(VGP_arm64_linux) || defined(VGP_nanomips_linux)
@@ -884,21 +886,21 @@ Int VG_(fork) ( void )
    res = VG_(do_syscall5)(__NR_clone, VKI_SIGCHLD,
                           (UWord)NULL, (UWord)NULL, (UWord)NULL, (UWord)NULL);
    if (sr_isError(res))
-      return -1;
+      return -(Int)sr_Err(res);
    return sr_Res(res);
 
 #  elif defined(VGO_linux)
    SysRes res;
    res = VG_(do_syscall0)(__NR_fork);
    if (sr_isError(res))
-      return -1;
+      return -(Int)sr_Err(res);
    return sr_Res(res);
 
 #  elif defined(VGO_darwin)
    SysRes res;
    res = VG_(do_syscall0)(__NR_fork); /* __NR_fork is UX64 */
    if (sr_isError(res))
-      return -1;
+      return -(Int)sr_Err(res);
    /* on success: wLO = child pid; wHI = 1 for child, 0 for parent */
    if (sr_ResHI(res) != 0) {
       return 0;  /* this is child: return 0 instead of child pid */
@@ -913,7 +915,7 @@ Int VG_(fork) ( void )
    SysRes res;
    res = VG_(do_syscall2)(__NR_forksys, 0 /*subcode (fork)*/, 0 /*flags*/);
    if (sr_isError(res))
-      return -1;
+      return -(Int)sr_Err(res);
    /* On success:
         val = a pid of the child in the parent, a pid of the parent in the
               child,
@@ -928,11 +930,36 @@ Int VG_(fork) ( void )
 #  endif
 }
 
+/* Fork a child which sends no signal when it exits, so that the client
+   neither sees a SIGCHLD it did not ask for nor reaps the child with
+   its own wait calls: wait for it with VG_(waitpid)(pid, &status,
+   __VKI_WCLONE).  Returns -1 where that cannot be done. */
+Int VG_(fork_quiet) ( void )
+{
+#  if defined(VGO_linux)
+   SysRes res;
+#  if defined(VGP_s390x_linux)
+   /* s390x has the stack pointer first */
+   res = VG_(do_syscall5)(__NR_clone, (UWord)NULL, 0,
+                          (UWord)NULL, (UWord)NULL, (UWord)NULL);
+#  else
+   res = VG_(do_syscall5)(__NR_clone, 0,
+                          (UWord)NULL, (UWord)NULL, (UWord)NULL, (UWord)NULL);
+#  endif
+   if (sr_isError(res))
+      return -1;
+   return sr_Res(res);
+
+#  else
+   return -1;
+#  endif
+}
+
 /* ---------------------------------------------------------------------
    Timing stuff
    ------------------------------------------------------------------ */
 
-UInt VG_(read_millisecond_timer) ( void )
+ULong VG_(read_microsecond_timer) ( void )
 {
    /* 'now' and 'base' are in microseconds */
    static ULong base = 0;
@@ -975,7 +1002,12 @@ UInt VG_(read_millisecond_timer) ( void )
    if (base == 0)
       base = now;
 
-   return (now - base) / 1000;
+   return now - base;
+}
+
+UInt VG_(read_millisecond_timer) ( void )
+{
+   return VG_(read_microsecond_timer)() / 1000;
 }
 
 #  if defined(VGO_linux) || defined(VGO_solaris)
@@ -48,18 +48,21 @@
 #include "pub_core_libcproc.h"
 #include "pub_core_libcsignal.h"
 #include "pub_core_sbprofile.h"
+#include "pub_core_helperprof.h"
 #include "pub_core_mach.h"
 #include "pub_core_machine.h"
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
 #include "pub_core_debuginfo.h"
 #include "pub_core_redir.h"
+#include "pub_core_replay.h"
 #include "pub_core_scheduler.h"
 #include "pub_core_seqmatch.h"      // For VG_(string_match)
 #include "pub_core_signals.h"
 #include "pub_core_stacks.h"        // For VG_(register_stack)
 #include "pub_core_syswrap.h"
 #include "pub_core_tooliface.h"
+#include "pub_core_transcache.h"
 #include "pub_core_translate.h"     // For VG_(translate)
 #include "pub_core_trampoline.h"
 #include "pub_core_transtab.h"
@@ -115,6 +118,12 @@ static void usage_NORETURN ( int need_help )
 "    --log-fd=<number>         log messages to file descriptor [2=stderr]\n"
 "    --log-file=<file>         log messages to <file>\n"
 "    --log-socket=ipaddr:port  log messages to socket ipaddr:port\n"
+"    --record-syscalls=<file>  log syscall results, async signals and the\n"
+"                              thread schedule to <file>\n"
+"    --replay-syscalls=<file>  re-run the execution logged in <file>, without\n"
+"                              doing its I/O and sleeps again\n"
+"    --translation-cache=<dir> keep translations in <dir> and reuse them in\n"
+"                              later runs (some tools only)\n"
 "\n"
 "  user options for Valgrind tools that report errors:\n"
 "    --xml=yes                 emit error output in XML (some tools only)\n"
@@ -136,6 +145,14 @@ static void usage_NORETURN ( int need_help )
 "                              This allows saved stack traces (e.g. memory leaks)\n"
 "                              to include file/line info for code that has been\n"
 "                              dlclose'd (or similar)\n"
+"    --lazy-debuginfo=no|yes   read symbols etc of an object only when they\n"
+"                              are first needed [no, or yes for tools that\n"
+"                              make no use of them]\n"
+"    --debuginfo-cache=<dir>   keep the symbols etc read from objects with a\n"
+"                              build-id in <dir>, and reuse them in later runs\n"
+"    --debuginfo-helpers=<number>\n"
+"                              with --debuginfo-cache, read up to <number>\n"
+"                              objects at once in helper processes [0]\n"
 "    --show-below-main=no|yes  continue stack traces below main() [no]\n"
 "    --default-suppressions=yes|no\n"
 "                              load default suppressions [yes]\n"
@@ -207,6 +224,12 @@ static void usage_NORETURN ( int need_help )
 "           program counters in max <number> frames) [0]\n"
 "    --num-transtab-sectors=<number> size of translated code cache [%d]\n"
 "           more sectors may increase performance, but use more memory.\n"
+"    --max-transtab-size=<number> when code translated again after being\n"
+"           thrown out of the cache is frequent, grow the cache up to\n"
+"           <number> MB [0, meaning twice its initial size]\n"
+"    --keep-hot-translations=<number> when the oldest part of the cache is\n"
+"           reused, keep the translations run at least <number> times since\n"
+"           they were made [0, meaning none]\n"
 "    --avg-transtab-entry-size=<number> avg size in bytes of a translated\n"
 "           basic block [0, meaning use tool provided default]\n"
 "    --aspace-minaddr=0xPP     avoid mapping memory below 0xPP [guessed]\n"
@@ -245,6 +268,10 @@ static void usage_NORETURN ( int need_help )
 "    --profile-flags=<XXXXXXXX> ditto, but for profiling (X = 0|1) [00000000]\n"
 "    --profile-interval=<number> show profile every <number> event checks\n"
 "                                [0, meaning only at the end of the run]\n"
+"    --profile-helpers=no|calls|cycles\n"
+"                              profile the dirty helpers called by the\n"
+"                              instrumented code: count their calls, or also\n"
+"                              time a sample of them [no]\n"
 "    --trace-notbelow=<number> only show BBs above <number> [999999999]\n"
 "    --trace-notabove=<number> only show BBs below <number> [0]\n"
 "    --trace-syscalls=no|yes   show all system calls? [no]\n"
@@ -599,6 +626,7 @@ static void process_option (Clo_Mode mode,
    else if VG_BOOL_CLO(arg, "--run-cxx-freeres",  VG_(clo_run_cxx_freeres)) {}
    else if VG_BOOL_CLOM(cloPD, arg, "--show-below-main",  VG_(clo_show_below_main)) {}
    else if VG_BOOL_CLO(arg, "--keep-debuginfo",   VG_(clo_keep_debuginfo)) {}
+   else if VG_BOOL_CLO(arg, "--lazy-debuginfo",   VG_(clo_lazy_debuginfo)) {}
    else if VG_BOOL_CLOM(cloPD, arg, "--time-stamp",       VG_(clo_time_stamp)) {}
    else if VG_BOOL_CLO(arg, "--track-fds",        VG_(clo_track_fds)) {}
    else if VG_BOOL_CLOM(cloPD, arg, "--trace-children",   VG_(clo_trace_children)) {}
@@ -660,6 +688,10 @@ static void process_option (Clo_Mode mode,
    else if VG_BINT_CLO(arg, "--num-transtab-sectors",
                        VG_(clo_num_transtab_sectors),
                        MIN_N_SECTORS, MAX_N_SECTORS) {}
+   else if VG_BINT_CLO(arg, "--max-transtab-size",
+                       VG_(clo_max_transtab_size), 0, 1024*1024) {}
+   else if VG_BINT_CLO(arg, "--keep-hot-translations",
+                       VG_(clo_keep_hot_translations), 0, 1000000000) {}
    else if VG_BINT_CLO(arg, "--avg-transtab-entry-size",
                        VG_(clo_avg_transtab_entry_size),
                        50, 5000) {}
@@ -748,6 +780,15 @@ static void process_option (Clo_Mode mode,
       pos->xml_to = VgLogTo_Socket;
    }
 
+   else if VG_STR_CLO(arg, "--record-syscalls", VG_(clo_record_fname)) {}
+   else if VG_STR_CLO(arg, "--replay-syscalls", VG_(clo_replay_fname)) {}
+   else if VG_STR_CLO(arg, "--translation-cache",
+                      VG_(clo_translation_cache)) {}
+   else if VG_STR_CLO(arg, "--debuginfo-cache",
+                      VG_(clo_debuginfo_cache)) {}
+   else if VG_BINT_CLO(arg, "--debuginfo-helpers",
+                       VG_(clo_debuginfo_helpers), 0, 64) {}
+
    else if VG_STR_CLO(arg, "--debuginfo-server",
                       VG_(clo_debuginfo_server)) {}
 
@@ -836,6 +877,12 @@ static void process_option (Clo_Mode mode,
 
    else if VG_INT_CLO (arg, "--profile-interval",
                        VG_(clo_profyle_interval)) {}
+   else if VG_XACT_CLO(arg, "--profile-helpers=no",
+                       VG_(clo_profile_helpers), 0) {}
+   else if VG_XACT_CLO(arg, "--profile-helpers=calls",
+                       VG_(clo_profile_helpers), 1) {}
+   else if VG_XACT_CLO(arg, "--profile-helpers=cycles",
+                       VG_(clo_profile_helpers), 2) {}
 
    else if VG_XACT_CLOM(cloPD, arg, "--gen-suppressions=no",
                        VG_(clo_gen_suppressions), 0) {}
@@ -1679,6 +1726,9 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    // Activate var info readers, if the tool asked for it:
    if (VG_(needs).var_info)
       VG_(clo_read_var_info) = True;
+   // And read debug info lazily if it asked for none:
+   if (VG_(needs).no_debuginfo)
+      VG_(clo_lazy_debuginfo) = True;
 
    //--------------------------------------------------------------
    // If --tool and --help/--help-debug was given, now give the core+tool
@@ -1738,6 +1788,16 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
       }
    }
 
+   //--------------------------------------------------------------
+   // Open the syscall record/replay log
+   //   p: main_process_cmd_line_options() [for VG_(clo_record_fname)]
+   //   p: setup_client_stack()  [for VG_(client_auxv)]
+   //--------------------------------------------------------------
+   if (VG_(clo_record_fname) || VG_(clo_replay_fname)) {
+      VG_(debugLog)(1, "main", "Open the record/replay log\n");
+      VG_(replay_init)();
+   }
+
    //--------------------------------------------------------------
    // Initialise translation table and translation cache
    //   p: aspacem         [??]
@@ -1745,6 +1805,7 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    //--------------------------------------------------------------
    VG_(debugLog)(1, "main", "Initialise TT/TC\n");
    VG_(init_tt_tc)();
+   VG_(transcache_init)();
 
    //--------------------------------------------------------------
    // Initialise the redirect table.
@@ -2199,6 +2260,8 @@ void shutdown_actions_NORETURN( ThreadId tid,
    if (VG_(clo_track_fds))
       VG_(show_open_fds)("at exit");
 
+   VG_(replay_shutdown)();
+
    /* Call the tool's finalisation function.  This makes Memcheck's
       leak checker run, and possibly chuck a bunch of leak errors into
       the error management machinery. */
@@ -2232,6 +2295,8 @@ void shutdown_actions_NORETURN( ThreadId tid,
    if (VG_(clo_stats))
       VG_(print_all_stats)(VG_(clo_verbosity) >= 1, /* Memory stats */
                            False /* tool prints stats in the tool fini */);
+   else if (VG_(clo_verbosity) > 1 && !VG_(clo_xml))
+      VG_(print_tt_tc_sector_stats)(True /* brief */);
 
    /* Show a profile of the heap(s) at shutdown.  Optionally, first
       throw away all the debug info, as that makes it easy to spot
@@ -2247,6 +2312,9 @@ void shutdown_actions_NORETURN( ThreadId tid,
    if (VG_(clo_profyle_sbs) && VG_(clo_profyle_interval) == 0) {
       VG_(get_and_show_SB_profile)(0/*denoting end-of-run*/);
    }
+   if (VG_(clo_profile_helpers) && VG_(clo_profyle_interval) == 0) {
+      VG_(helperprof_show)(0/*denoting end-of-run*/);
+   }
 
    /* Print Vex storage stats */
    if (0)
@@ -760,6 +760,24 @@ void VG_(redir_notify_new_DebugInfo)( const DebugInfo* newdi )
    handle_require_text_symbols(newdi);
 }
 
+/* Must the symbols of each object be read as soon as it is mapped?
+   Only if there are specs to match them against, or text symbols that
+   --require-text-symbol= asks for, or a variable that
+   --sim-hints=no-nptl-pthread-stackcache has to find.  Otherwise
+   m_debuginfo may leave the reading until something asks about the
+   object (--lazy-debuginfo=yes). */
+Bool VG_(redir_needs_all_symbols)( void )
+{
+   TopSpec* ts;
+   for (ts = topSpecs; ts; ts = ts->next) {
+      if (ts->specs)
+         return True;
+   }
+   return VG_(sizeXA)(VG_(clo_req_tsyms)) > 0
+          || SimHintiS(SimHint_no_nptl_pthread_stackcache,
+                       VG_(clo_sim_hints));
+}
+
 /* Add a new target for an indirect function. Adds a new redirection
    for the indirection function with address old_from that redirects
    the ordinary function with address new_from to the target address
@@ -0,0 +1,761 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Syscall, signal and schedule record/replay.       m_replay.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_vkiscnums.h"
+#include "pub_core_threadstate.h"
+#include "pub_core_aspacemgr.h"
+#include "pub_core_clientstate.h"   // VG_(client_auxv)
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_scheduler.h"     // VG_(get_bbs_done)
+#include "pub_core_replay.h"        // self
+
+/* The log is a header followed by a stream of events, in the order
+   they happened:
+
+      header:  "VGREPLAY" version:4 sizeof(SysRes):4
+      event:   kind:4 tid:4 bbs:8 body
+
+   where bbs is the scheduler's count of blocks executed when the
+   event happened, and the body depends on the kind:
+
+      SYSCALL  sysno:8 SysRes nwrites:4 { addr:8 len:8 bytes }*
+      RESTART  sysno:8
+      SIGNAL   vki_siginfo_t
+      SCHED    (none) -- tid took the big lock from another thread
+      RANDOM   16 bytes of AT_RANDOM
+
+   The log is only meaningful to the same Valgrind build and tool
+   running the same client with the same arguments. */
+
+#define REPLAY_MAGIC    "VGREPLAY"
+#define REPLAY_VERSION  1
+
+enum { EvSyscall = 1, EvRestart, EvSignal, EvSched, EvRandom };
+
+typedef
+   struct {
+      UInt   kind;
+      UInt   tid;
+      ULong  bbs;
+   }
+   EventHdr;
+
+ReplayMode VG_(replay_mode) = ReplayOff;
+
+typedef
+   struct {
+      Bool  in_kernel;   // between pre and post of a syscall
+      Word  sysno;       // ... which is this one
+      UInt  next_sys;    // replay: next SYSCALL/RESTART event
+      UInt  next_sig;    // replay: next SIGNAL event
+      UInt  checking;    // replay: event of a syscall done for real
+   }
+   ReplayThread;
+
+/* Indexed by tid; allocated once a log is open. */
+static ReplayThread* threads;
+
+/* The thread that took the big lock last. */
+static ThreadId sched_tid = VG_INVALID_THREADID;
+
+
+/*====================================================================*/
+/*=== Which syscalls are replayed                                  ===*/
+/*====================================================================*/
+
+/* Syscalls whose only effects on the client are their result and the
+   memory they write.  These are skipped in replay; everything else
+   (memory management, file descriptors, threads, processes) is done
+   for real, and is expected to come out the same. */
+static Bool is_replayable ( Word sysno )
+{
+#  if defined(VGO_linux)
+   switch (sysno) {
+#     if defined(__NR_read)
+      case __NR_read:
+#     endif
+#     if defined(__NR_pread64)
+      case __NR_pread64:
+#     endif
+#     if defined(__NR_readv)
+      case __NR_readv:
+#     endif
+#     if defined(__NR_preadv)
+      case __NR_preadv:
+#     endif
+#     if defined(__NR_write)
+      case __NR_write:
+#     endif
+#     if defined(__NR_pwrite64)
+      case __NR_pwrite64:
+#     endif
+#     if defined(__NR_writev)
+      case __NR_writev:
+#     endif
+#     if defined(__NR_pwritev)
+      case __NR_pwritev:
+#     endif
+#     if defined(__NR_stat)
+      case __NR_stat:
+#     endif
+#     if defined(__NR_lstat)
+      case __NR_lstat:
+#     endif
+#     if defined(__NR_fstat)
+      case __NR_fstat:
+#     endif
+#     if defined(__NR_newfstatat)
+      case __NR_newfstatat:
+#     endif
+#     if defined(__NR_statx)
+      case __NR_statx:
+#     endif
+#     if defined(__NR_lseek)
+      case __NR_lseek:
+#     endif
+#     if defined(__NR_getdents64)
+      case __NR_getdents64:
+#     endif
+#     if defined(__NR_readlink)
+      case __NR_readlink:
+#     endif
+#     if defined(__NR_readlinkat)
+      case __NR_readlinkat:
+#     endif
+#     if defined(__NR_getcwd)
+      case __NR_getcwd:
+#     endif
+#     if defined(__NR_access)
+      case __NR_access:
+#     endif
+#     if defined(__NR_faccessat)
+      case __NR_faccessat:
+#     endif
+#     if defined(__NR_clock_gettime)
+      case __NR_clock_gettime:
+#     endif
+#     if defined(__NR_clock_getres)
+      case __NR_clock_getres:
+#     endif
+#     if defined(__NR_gettimeofday)
+      case __NR_gettimeofday:
+#     endif
+#     if defined(__NR_time)
+      case __NR_time:
+#     endif
+#     if defined(__NR_times)
+      case __NR_times:
+#     endif
+#     if defined(__NR_nanosleep)
+      case __NR_nanosleep:
+#     endif
+#     if defined(__NR_clock_nanosleep)
+      case __NR_clock_nanosleep:
+#     endif
+#     if defined(__NR_getrandom)
+      case __NR_getrandom:
+#     endif
+#     if defined(__NR_getpid)
+      case __NR_getpid:
+#     endif
+#     if defined(__NR_getppid)
+      case __NR_getppid:
+#     endif
+#     if defined(__NR_uname)
+      case __NR_uname:
+#     endif
+#     if defined(__NR_sysinfo)
+      case __NR_sysinfo:
+#     endif
+#     if defined(__NR_getrusage)
+      case __NR_getrusage:
+#     endif
+#     if defined(__NR_poll)
+      case __NR_poll:
+#     endif
+#     if defined(__NR_ppoll)
+      case __NR_ppoll:
+#     endif
+#     if defined(__NR_select)
+      case __NR_select:
+#     endif
+#     if defined(__NR_pselect6)
+      case __NR_pselect6:
+#     endif
+#     if defined(__NR_epoll_wait)
+      case __NR_epoll_wait:
+#     endif
+#     if defined(__NR_epoll_pwait)
+      case __NR_epoll_pwait:
+#     endif
+#     if defined(__NR_recvfrom)
+      case __NR_recvfrom:
+#     endif
+#     if defined(__NR_recvmsg)
+      case __NR_recvmsg:
+#     endif
+#     if defined(__NR_sendto)
+      case __NR_sendto:
+#     endif
+#     if defined(__NR_sendmsg)
+      case __NR_sendmsg:
+#     endif
+         return True;
+      default:
+         return False;
+   }
+#  else
+   return False;
+#  endif
+}
+
+/* Syscalls done for real whose results are ids the kernel hands out,
+   or depend on exactly when another thread got into the kernel, and
+   so are not expected to match the log. */
+static Bool result_may_differ ( Word sysno )
+{
+#  if defined(VGO_linux)
+   switch (sysno) {
+#     if defined(__NR_set_tid_address)
+      case __NR_set_tid_address:
+#     endif
+#     if defined(__NR_futex)
+      case __NR_futex:
+#     endif
+#     if defined(__NR_gettid)
+      case __NR_gettid:
+#     endif
+#     if defined(__NR_clone)
+      case __NR_clone:
+#     endif
+#     if defined(__NR_clone3)
+      case __NR_clone3:
+#     endif
+#     if defined(__NR_fork)
+      case __NR_fork:
+#     endif
+#     if defined(__NR_vfork)
+      case __NR_vfork:
+#     endif
+         return True;
+      default:
+         return False;
+   }
+#  else
+   return False;
+#  endif
+}
+
+/* A syscall that was cut short by a signal is replayed whatever it
+   was, since doing it for real could block with nothing to wake it. */
+static Bool was_interrupted ( SysRes res )
+{
+   return sr_isError(res) && sr_Err(res) == VKI_EINTR;
+}
+
+
+/*====================================================================*/
+/*=== Recording                                                    ===*/
+/*====================================================================*/
+
+#define OUT_BUF_SIZE  (64 * 1024)
+
+static Int    log_fd = -1;
+static UChar* out_buf;
+static UInt   out_used;
+
+/* Client memory written by the syscall whose post-handler is running,
+   as a run of { addr len bytes } ready to go into the log. */
+static UChar* writes;
+static SizeT  writes_used, writes_size;
+static UInt   n_writes;
+
+static void out_flush ( void )
+{
+   UChar* p = out_buf;
+   while (out_used > 0) {
+      Int n = VG_(write)(log_fd, p, out_used);
+      if (n <= 0) {
+         VG_(umsg)("record: cannot write the log, recording stopped\n");
+         VG_(replay_mode) = ReplayOff;
+         out_used = 0;
+         return;
+      }
+      p += n;
+      out_used -= n;
+   }
+}
+
+static void out_bytes ( const void* p, SizeT n )
+{
+   const UChar* b = p;
+   while (n > 0) {
+      SizeT chunk = OUT_BUF_SIZE - out_used;
+      if (chunk > n)
+         chunk = n;
+      VG_(memcpy)(out_buf + out_used, b, chunk);
+      out_used += chunk;
+      b += chunk;
+      n -= chunk;
+      if (out_used == OUT_BUF_SIZE)
+         out_flush();
+   }
+}
+
+static void out_event ( UInt kind, ThreadId tid )
+{
+   EventHdr h;
+   h.kind = kind;
+   h.tid  = tid;
+   h.bbs  = VG_(get_bbs_done)();
+   out_bytes(&h, sizeof(h));
+}
+
+void VG_(record_mem_write) ( ThreadId tid, Addr a, SizeT len )
+{
+   ULong a64 = a, len64 = len;
+   SizeT need = writes_used + 16 + len;
+
+   if (!threads[tid].in_kernel || !is_replayable(threads[tid].sysno) || len == 0)
+      return;
+   if (need > writes_size) {
+      while (need > writes_size)
+         writes_size = writes_size ? 2 * writes_size : 4096;
+      writes = VG_(realloc)("replay.writes", writes, writes_size);
+   }
+   VG_(memcpy)(writes + writes_used, &a64, 8);
+   VG_(memcpy)(writes + writes_used + 8, &len64, 8);
+   VG_(memcpy)(writes + writes_used + 16, (void*)a, len);
+   writes_used = need;
+   n_writes++;
+}
+
+void VG_(record_signal) ( ThreadId tid, const vki_siginfo_t* info )
+{
+   if (VG_(replay_mode) != ReplayRecord)
+      return;
+   out_event(EvSignal, tid);
+   out_bytes(info, sizeof(*info));
+}
+
+#if defined(VGO_linux)
+#define AT_RANDOM_ 25
+
+/* The 16 random bytes the kernel gives every process seed the stack
+   protector and pointer guard, so they are part of the log too. */
+static UChar* find_at_random ( void )
+{
+   UWord* auxv = VG_(client_auxv);
+   if (auxv == NULL)
+      return NULL;
+   for (; auxv[0] != 0; auxv += 2)
+      if (auxv[0] == AT_RANDOM_)
+         return (UChar*)auxv[1];
+   return NULL;
+}
+#endif
+
+
+/*====================================================================*/
+/*=== Replaying                                                    ===*/
+/*====================================================================*/
+
+typedef
+   struct {
+      EventHdr     hdr;
+      const UChar* body;
+   }
+   Event;
+
+static UChar* log_data;
+static Event* events;
+static UInt   n_events;
+
+/* Index of the next SCHED event still to be consumed. */
+static UInt next_sched;
+static Bool warned_result;
+
+/* Replay: when threads started waiting for their turn at the lock. */
+static UInt wait_start_ms;
+#define REPLAY_MAX_WAIT_MS  30000
+
+static void diverged ( const HChar* what, ThreadId tid )
+{
+   VG_(umsg)("replay: thread %u no longer follows the log (%s); "
+             "continuing without it\n", tid, what);
+   VG_(replay_mode) = ReplayOff;
+}
+
+static UInt find_next ( UInt from, UInt kind1, UInt kind2, ThreadId tid )
+{
+   UInt i;
+   for (i = from; i < n_events; i++)
+      if ((events[i].hdr.kind == kind1 || events[i].hdr.kind == kind2)
+          && (tid == VG_INVALID_THREADID || events[i].hdr.tid == tid))
+         break;
+   return i;
+}
+
+static Bool load_log ( const HChar* name )
+{
+   struct vg_stat st;
+   SysRes sres;
+   Int    fd;
+   SizeT  size, off, cap;
+   UInt   version, sr_size;
+
+   sres = VG_(open)(name, VKI_O_RDONLY, 0);
+   if (sr_isError(sres))
+      return False;
+   fd = sr_Res(sres);
+   if (VG_(fstat)(fd, &st) != 0) {
+      VG_(close)(fd);
+      return False;
+   }
+   size = st.size;
+   log_data = VG_(malloc)("replay.log", size + 1);
+   for (off = 0; off < size; ) {
+      Int n = VG_(read)(fd, log_data + off, size - off);
+      if (n <= 0)
+         break;
+      off += n;
+   }
+   VG_(close)(fd);
+   if (off != size || size < 16
+       || VG_(memcmp)(log_data, REPLAY_MAGIC, 8) != 0)
+      return False;
+   VG_(memcpy)(&version, log_data + 8, 4);
+   VG_(memcpy)(&sr_size, log_data + 12, 4);
+   if (version != REPLAY_VERSION || sr_size != sizeof(SysRes))
+      return False;
+
+   cap = 1024;
+   events = VG_(malloc)("replay.events", cap * sizeof(Event));
+   for (off = 16; off < size; ) {
+      Event e;
+      SizeT body;
+      if (off + sizeof(EventHdr) > size)
+         return False;
+      VG_(memcpy)(&e.hdr, log_data + off, sizeof(EventHdr));
+      off += sizeof(EventHdr);
+      e.body = log_data + off;
+      switch (e.hdr.kind) {
+         case EvSyscall: {
+            UInt n;
+            body = 8 + sizeof(SysRes) + 4;
+            if (off + body > size)
+               return False;
+            VG_(memcpy)(&n, log_data + off + 8 + sizeof(SysRes), 4);
+            while (n-- > 0) {
+               ULong len;
+               if (off + body + 16 > size)
+                  return False;
+               VG_(memcpy)(&len, log_data + off + body + 8, 8);
+               body += 16 + len;
+            }
+            break;
+         }
+         case EvRestart: body = 8;                     break;
+         case EvSignal:  body = sizeof(vki_siginfo_t); break;
+         case EvSched:   body = 0;                     break;
+         case EvRandom:  body = 16;                    break;
+         default:        return False;
+      }
+      if (off + body > size || e.hdr.tid >= VG_N_THREADS)
+         return False;
+      off += body;
+      if (n_events == cap) {
+         cap *= 2;
+         events = VG_(realloc)("replay.events", events, cap * sizeof(Event));
+      }
+      events[n_events++] = e;
+   }
+   return True;
+}
+
+ReplayAction VG_(replay_pre_syscall) ( ThreadId tid, Word sysno,
+                                       /*OUT*/SysRes* res )
+{
+   const UChar* p;
+   ULong logged;
+   UInt  i, n;
+
+   threads[tid].sysno = sysno;
+   if (VG_(replay_mode) == ReplayRecord) {
+      threads[tid].in_kernel = True;
+      return ReplayRun;
+   }
+   if (VG_(replay_mode) != ReplayReplay)
+      return ReplayRun;
+
+   i = find_next(threads[tid].next_sys, EvSyscall, EvRestart, tid);
+   if (i == n_events) {
+      diverged("end of the log", tid);
+      return ReplayRun;
+   }
+   p = events[i].body;
+   VG_(memcpy)(&logged, p, 8);
+   if ((Word)logged != sysno) {
+      diverged(VG_SYSNUM_STRING(sysno), tid);
+      return ReplayRun;
+   }
+   threads[tid].next_sys = i + 1;
+   if (events[i].hdr.kind == EvRestart)
+      return ReplayRestart;
+
+   VG_(memcpy)(res, p + 8, sizeof(SysRes));
+   if (!is_replayable(sysno) && !was_interrupted(*res)) {
+      threads[tid].in_kernel = True;
+      threads[tid].checking  = i;
+      return ReplayRun;
+   }
+
+   VG_(memcpy)(&n, p + 8 + sizeof(SysRes), 4);
+   p += 8 + sizeof(SysRes) + 4;
+   while (n-- > 0) {
+      ULong addr, len;
+      VG_(memcpy)(&addr, p, 8);
+      VG_(memcpy)(&len, p + 8, 8);
+      if (!VG_(am_is_valid_for_client)(addr, len, VKI_PROT_WRITE)) {
+         diverged(VG_SYSNUM_STRING(sysno), tid);
+         return ReplayRun;
+      }
+      VG_(memcpy)((void*)(Addr)addr, p + 16, len);
+      p += 16 + len;
+   }
+   return ReplayResult;
+}
+
+void VG_(replay_post_syscall) ( ThreadId tid, Word sysno, SysRes res )
+{
+   if (!threads[tid].in_kernel)
+      return;
+   threads[tid].in_kernel = False;
+
+   if (VG_(replay_mode) == ReplayRecord) {
+      ULong sysno64 = sysno;
+      out_event(EvSyscall, tid);
+      out_bytes(&sysno64, 8);
+      out_bytes(&res, sizeof(SysRes));
+      out_bytes(&n_writes, 4);
+      out_bytes(writes, writes_used);
+   } else if (VG_(replay_mode) == ReplayReplay) {
+      SysRes logged;
+      VG_(memcpy)(&logged, events[threads[tid].checking].body + 8, sizeof(SysRes));
+      if (!sr_EQ(sysno, res, logged) && !result_may_differ(sysno)
+          && !warned_result) {
+         VG_(umsg)("replay: %s returned a different result than in the "
+                   "log; replay may diverge\n", VG_SYSNUM_STRING(sysno));
+         warned_result = True;
+      }
+   }
+   writes_used = 0;
+   n_writes    = 0;
+}
+
+void VG_(replay_syscall_restarted) ( ThreadId tid )
+{
+   if (!threads[tid].in_kernel)
+      return;
+   threads[tid].in_kernel = False;
+   writes_used = 0;
+   n_writes    = 0;
+   if (VG_(replay_mode) == ReplayRecord) {
+      ULong sysno64 = threads[tid].sysno;
+      out_event(EvRestart, tid);
+      out_bytes(&sysno64, 8);
+   }
+}
+
+Bool VG_(replay_signal) ( ThreadId tid, /*OUT*/vki_siginfo_t* info )
+{
+   UInt i;
+
+   if (VG_(replay_mode) != ReplayReplay)
+      return False;
+   i = find_next(threads[tid].next_sig, EvSignal, EvSignal, tid);
+   threads[tid].next_sig = i;
+   if (i == n_events || events[i].hdr.bbs > VG_(get_bbs_done)())
+      return False;
+   VG_(memcpy)(info, events[i].body, sizeof(*info));
+   threads[tid].next_sig = i + 1;
+   return True;
+}
+
+Int VG_(replay_slice) ( ThreadId tid, Int max )
+{
+   ULong now = VG_(get_bbs_done)();
+   UInt  i;
+
+   if (VG_(replay_mode) != ReplayReplay)
+      return max;
+   i = find_next(threads[tid].next_sig, EvSignal, EvSignal, tid);
+   threads[tid].next_sig = i;
+   if (i == n_events)
+      return max;
+   if (events[i].hdr.bbs <= now)
+      return 0;
+   if (events[i].hdr.bbs - now < (ULong)max)
+      return (Int)(events[i].hdr.bbs - now);
+   return max;
+}
+
+Bool VG_(replay_acquire) ( ThreadId tid )
+{
+   ULong now = VG_(get_bbs_done)();
+   UInt  i;
+
+   if (VG_(replay_mode) == ReplayRecord) {
+      if (tid != sched_tid) {
+         out_event(EvSched, tid);
+         sched_tid = tid;
+      }
+      return True;
+   }
+   if (VG_(replay_mode) != ReplayReplay)
+      return True;
+
+   /* The log hands the lock over at the block count it was handed
+      over at in the recording; in between, it stays with whoever has
+      it. */
+   i = find_next(next_sched, EvSched, EvSched, VG_INVALID_THREADID);
+   next_sched = i;
+   if (i < n_events && events[i].hdr.bbs <= now) {
+      if (events[i].hdr.tid == tid) {
+         next_sched = i + 1;
+         sched_tid  = tid;
+         wait_start_ms = 0;
+         return True;
+      }
+   } else if (tid == sched_tid) {
+      wait_start_ms = 0;
+      return True;
+   }
+
+   /* Not our turn.  If nobody has got the lock for a long time, the
+      thread the log is waiting for is never coming. */
+   if (wait_start_ms == 0) {
+      wait_start_ms = VG_(read_millisecond_timer)() + 1;
+   } else if (VG_(read_millisecond_timer)() + 1 - wait_start_ms
+              > REPLAY_MAX_WAIT_MS) {
+      diverged("thread schedule", tid);
+      return True;
+   }
+   return False;
+}
+
+
+/*====================================================================*/
+/*=== Setup and shutdown                                           ===*/
+/*====================================================================*/
+
+static void replay_atfork_child ( ThreadId tid )
+{
+   /* The log describes the parent only. */
+   if (VG_(replay_mode) == ReplayRecord) {
+      out_used = 0;
+      VG_(close)(log_fd);
+      log_fd = -1;
+   }
+   VG_(replay_mode) = ReplayOff;
+}
+
+void VG_(replay_init) ( void )
+{
+   if (VG_(clo_record_fname) != NULL && VG_(clo_replay_fname) != NULL)
+      VG_(fmsg_bad_option)("--record-syscalls",
+         "--record-syscalls and --replay-syscalls cannot be combined\n");
+
+   threads = VG_(calloc)("replay.threads", VG_N_THREADS,
+                         sizeof(ReplayThread));
+
+   if (VG_(clo_record_fname) != NULL) {
+      HChar* name = VG_(expand_file_name)("--record-syscalls",
+                                          VG_(clo_record_fname));
+      UInt   version = REPLAY_VERSION, sr_size = sizeof(SysRes);
+      SysRes sres = VG_(open)(name, VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                              VKI_S_IRUSR|VKI_S_IWUSR);
+      if (sr_isError(sres))
+         VG_(fmsg_bad_option)("--record-syscalls",
+                              "Cannot create %s\n", name);
+      log_fd  = VG_(safe_fd)(sr_Res(sres));
+      out_buf = VG_(malloc)("replay.out_buf", OUT_BUF_SIZE);
+      VG_(replay_mode) = ReplayRecord;
+      out_bytes(REPLAY_MAGIC, 8);
+      out_bytes(&version, 4);
+      out_bytes(&sr_size, 4);
+#     if defined(VGO_linux)
+      {
+         UChar* rnd = find_at_random();
+         if (rnd != NULL) {
+            out_event(EvRandom, VG_INVALID_THREADID);
+            out_bytes(rnd, 16);
+         }
+      }
+#     endif
+      VG_(free)(name);
+   }
+
+   if (VG_(clo_replay_fname) != NULL) {
+      if (!load_log(VG_(clo_replay_fname)))
+         VG_(fmsg_bad_option)("--replay-syscalls",
+            "%s is not a log written by this build's --record-syscalls\n",
+            VG_(clo_replay_fname));
+      VG_(replay_mode) = ReplayReplay;
+#     if defined(VGO_linux)
+      {
+         UChar* rnd = find_at_random();
+         UInt   i   = find_next(0, EvRandom, EvRandom, VG_INVALID_THREADID);
+         if (rnd != NULL && i < n_events)
+            VG_(memcpy)(rnd, events[i].body, 16);
+      }
+#     endif
+   }
+
+   if (VG_(replay_mode) != ReplayOff)
+      VG_(atfork)(NULL, NULL, replay_atfork_child);
+}
+
+void VG_(replay_shutdown) ( void )
+{
+   if (VG_(replay_mode) == ReplayRecord) {
+      out_flush();
+      VG_(close)(log_fd);
+      log_fd = -1;
+   }
+   VG_(replay_mode) = ReplayOff;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -79,7 +79,9 @@
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
 #include "pub_core_replacemalloc.h"
+#include "pub_core_replay.h"
 #include "pub_core_sbprofile.h"
+#include "pub_core_helperprof.h"
 #include "pub_core_signals.h"
 #include "pub_core_stacks.h"
 #include "pub_core_stacktrace.h"    // For VG_(get_and_pp_StackTrace)()
@@ -150,6 +152,11 @@ static ULong stats__n_xIndir_misses = 0;
 static UInt sanity_fast_count = 0;
 static UInt sanity_slow_count = 0;
 
+ULong VG_(get_bbs_done)(void)
+{
+   return bbs_done;
+}
+
 void VG_(print_scheduler_stats)(void)
 {
    VG_(message)(Vg_DebugMsg,
@@ -247,7 +254,7 @@ void print_sched_event ( ThreadId tid, const HChar* what )
    VG_(message)(Vg_DebugMsg, "  SCHED[%u]: %s\n", tid, what );
 }
 
-/* For showing SB profiles, if the user asks to see them. */
+/* For showing SB and helper profiles, if the user asks to see them. */
 static
 void maybe_show_sb_profile ( void )
 {
@@ -259,7 +266,10 @@ void maybe_show_sb_profile ( void )
    vg_assert(delta >= 0);
    if ((ULong)delta >= VG_(clo_profyle_interval)) {
       bbs_done_lastcheck = bbs_done;
-      VG_(get_and_show_SB_profile)(bbs_done);
+      if (VG_(clo_profyle_sbs))
+         VG_(get_and_show_SB_profile)(bbs_done);
+      if (VG_(clo_profile_helpers))
+         VG_(helperprof_show)(bbs_done);
    }
 }
 
@@ -348,6 +358,21 @@ void VG_(acquire_BigLock)(ThreadId tid, const HChar* who)
       point is, technically, wrong. */
    VG_(acquire_BigLock_LL)(NULL);
 
+   /* Log who gets the lock when recording.  When replaying, only the
+      thread the log names may have it at this point; anyone else lets
+      go and tries again. */
+   if (UNLIKELY(VG_(replay_mode) != ReplayOff)) {
+      while (!VG_(replay_acquire)(tid)) {
+         VG_(release_BigLock_LL)(NULL);
+#        if defined(VGO_linux) || defined(VGO_darwin)
+         VG_(do_syscall0)(__NR_sched_yield);
+#        elif defined(VGO_solaris)
+         VG_(do_syscall0)(__NR_yield);
+#        endif
+         VG_(acquire_BigLock_LL)(NULL);
+      }
+   }
+
    tst = VG_(get_ThreadState)(tid);
 
    vg_assert(tst->status != VgTs_Runnable);
@@ -1158,6 +1183,7 @@ void handle_chain_me ( ThreadId tid, void* place_to_chain, Bool toFastEP )
    Addr ip             = VG_(get_IP)(tid);
    SECno to_sNo         = INV_SNO;
    TTEno to_tteNo       = INV_TTE;
+   ULong recycled       = VG_(get_sectors_recycled)();
 
    found = VG_(search_transtab)( NULL, &to_sNo, &to_tteNo,
                                  ip, False/*dont_upd_fast_cache*/ );
@@ -1168,6 +1194,12 @@ void handle_chain_me ( ThreadId tid, void* place_to_chain, Bool toFastEP )
          found = VG_(search_transtab)( NULL, &to_sNo, &to_tteNo,
                                        ip, False ); 
          vg_assert2(found, "handle_chain_me: missing tt_fast entry");
+         // Making the translation may have recycled the sector
+         // holding place_to_chain, whose code may then be gone, or
+         // overwritten by the hot translations kept there.  Leave the
+         // block unchained; it gets here again when it is next run.
+         if (VG_(get_sectors_recycled)() != recycled)
+            return;
       } else {
 	 // If VG_(translate)() fails, it's because it had to throw a
 	 // signal because the client jumped to a bad address.  That
@@ -1279,6 +1311,8 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 {
    /* Holds the remaining size of this thread's "timeslice". */
    Int dispatch_ctr = 0;
+   /* Part of the timeslice held back from the current run (replay). */
+   Int held_ctr = 0;
 
    ThreadState *tst = VG_(get_ThreadState)(tid);
    static Bool vgdb_startup_action_done = False;
@@ -1423,10 +1457,26 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
          VG_(message)(Vg_DebugMsg, "thread %u: running for %d bbs\n", 
                                    tid, dispatch_ctr - 1 );
 
+      /* When replaying, stop exactly where the log delivers this
+         thread's next signal, and put the rest of the slice back
+         afterwards. */
+      held_ctr = 0;
+      if (UNLIKELY(VG_(replay_mode) == ReplayReplay)) {
+         Int allowed;
+         while ((allowed = VG_(replay_slice)(tid, dispatch_ctr)) == 0
+                && !VG_(is_exiting)(tid))
+            VG_(poll_signals)(tid);
+         if (VG_(is_exiting)(tid))
+            break;
+         held_ctr = dispatch_ctr - allowed;
+         dispatch_ctr = allowed;
+      }
+
       HWord trc[2]; /* "two_words" */
       run_thread_for_a_while( &trc[0],
                               &dispatch_ctr,
                               tid, 0/*ignored*/, False );
+      dispatch_ctr += held_ctr;
 
       if (VG_(clo_trace_sched) && VG_(clo_verbosity) > 2) {
          const HChar *name = name_of_sched_event(trc[0]);
@@ -1542,7 +1592,7 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 
       case VG_TRC_INNER_COUNTERZERO:
 	 /* Timeslice is out.  Let a new thread be scheduled. */
-	 vg_assert(dispatch_ctr == 0);
+	 vg_assert(dispatch_ctr == 0 || held_ctr > 0);
 	 break;
 
       case VG_TRC_FAULT_SIGNAL:
@@ -1735,7 +1785,8 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 
       } /* switch (trc) */
 
-      if (UNLIKELY(VG_(clo_profyle_sbs)) && VG_(clo_profyle_interval) > 0)
+      if (UNLIKELY(VG_(clo_profyle_sbs) || VG_(clo_profile_helpers))
+          && VG_(clo_profyle_interval) > 0)
          maybe_show_sb_profile();
    }
 
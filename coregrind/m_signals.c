@@ -216,6 +216,7 @@
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
 #include "pub_core_scheduler.h"
+#include "pub_core_replay.h"
 #include "pub_core_signals.h"
 #include "pub_core_sigframe.h"      // For VG_(sigframe_create)()
 #include "pub_core_stacks.h"        // For VG_(change_stack)()
@@ -2519,8 +2520,11 @@ void async_signalhandler ( Int sigNo,
       => resume the scheduler for such a thread, so that the scheduler
       can let the thread die. */
    if (tst->exitreason != VgSrc_FatalSig 
-       && !is_sig_ign(info, tid))
+       && !is_sig_ign(info, tid)) {
+      if (UNLIKELY(VG_(replay_mode) == ReplayRecord))
+         VG_(record_signal)(tid, info);
       deliver_signal(tid, info, uc);
+   }
 
    /* It's crucial that (1) and (2) happen in the order (1) then (2)
       and not the other way around.  (1) fixes up the guest thread
@@ -3006,19 +3010,35 @@ void VG_(poll_signals)(ThreadId tid)
 
    block_all_host_signals(&saved_mask); // protect signal queue
 
-   /* First look for any queued pending signals */
-   sip = next_queued(tid, &pollset); /* this thread */
+   /* When replaying, the signals delivered are the ones the log
+      delivers at this point; whatever turned up for real is
+      dropped. */
+   if (UNLIKELY(VG_(replay_mode) == ReplayReplay)) {
+      vki_sigset_t dropset;
+      VG_(sigfillset)(&dropset);
+      VG_(sigdelset)(&dropset, VG_SIGVGKILL);
+      while ((sip = next_queued(tid, &dropset)) != NULL)
+         sip->si_signo = 0;
+      while ((sip = next_queued(0, &dropset)) != NULL)
+         sip->si_signo = 0;
+      while (VG_(sigtimedwait_zero)(&dropset, &si) > 0)
+         ;
+      sip = VG_(replay_signal)(tid, &si) ? &si : NULL;
+   } else {
+      /* First look for any queued pending signals */
+      sip = next_queued(tid, &pollset); /* this thread */
 
-   if (sip == NULL)
-      sip = next_queued(0, &pollset); /* process-wide */
+      if (sip == NULL)
+         sip = next_queued(0, &pollset); /* process-wide */
 
-   /* If there was nothing queued, ask the kernel for a pending signal */
-   if (sip == NULL && VG_(sigtimedwait_zero)(&pollset, &si) > 0) {
-      if (VG_(clo_trace_signals))
-         VG_(dmsg)("poll_signals: got signal %d for thread %u exitreason %s\n",
-                   si.si_signo, tid,
-                   VG_(name_of_VgSchedReturnCode)(tst->exitreason));
-      sip = &si;
+      /* If there was nothing queued, ask the kernel for a pending signal */
+      if (sip == NULL && VG_(sigtimedwait_zero)(&pollset, &si) > 0) {
+         if (VG_(clo_trace_signals))
+            VG_(dmsg)("poll_signals: got signal %d for thread %u exitreason %s\n",
+                      si.si_signo, tid,
+                      VG_(name_of_VgSchedReturnCode)(tst->exitreason));
+         sip = &si;
+      }
    }
 
    if (sip != NULL) {
@@ -3027,8 +3047,11 @@ void VG_(poll_signals)(ThreadId tid)
          VG_(dmsg)("Polling found signal %d for tid %u exitreason %s\n",
                    sip->si_signo, tid,
                    VG_(name_of_VgSchedReturnCode)(tst->exitreason));
-      if (!is_sig_ign(sip, tid))
+      if (!is_sig_ign(sip, tid)) {
+         if (UNLIKELY(VG_(replay_mode) == ReplayRecord))
+            VG_(record_signal)(tid, sip);
 	 deliver_signal(tid, sip, NULL);
+      }
       else if (VG_(clo_trace_signals))
          VG_(dmsg)("   signal %d ignored\n", sip->si_signo);
 	 
@@ -31,6 +31,7 @@
 #define __PRIV_TYPES_N_MACROS_H
 
 #include "pub_core_basics.h"    // Addr
+#include "pub_core_replay.h"    // VG_(record_mem_write)
 
 /* requires #include "pub_core_options.h" */
 /* requires #include "pub_core_signals.h" */
@@ -623,8 +624,12 @@ static inline UWord getERR ( SyscallStatus* st ) {
 #define PRE_MEM_WRITE(zzname, zzaddr, zzlen) \
    VG_TRACK( pre_mem_write, Vg_CoreSysCall, tid, zzname, zzaddr, zzlen)
 
-#define POST_MEM_WRITE(zzaddr, zzlen) \
-   VG_TRACK( post_mem_write, Vg_CoreSysCall, tid, zzaddr, zzlen)
+#define POST_MEM_WRITE(zzaddr, zzlen)                                 \
+   do {                                                               \
+      if (UNLIKELY(VG_(replay_mode) == ReplayRecord))                 \
+         VG_(record_mem_write)(tid, zzaddr, zzlen);                   \
+      VG_TRACK( post_mem_write, Vg_CoreSysCall, tid, zzaddr, zzlen);  \
+   } while (0)
 
 
 #define PRE_FIELD_READ(zzname, zzfield) \
@@ -1225,10 +1225,16 @@ void ML_(buf_and_len_pre_check) ( ThreadId tid, Addr buf_p, Addr buflen_p,
 void ML_(buf_and_len_post_check) ( ThreadId tid, SysRes res,
                                    Addr buf_p, Addr buflen_p, const HChar* s )
 {
-   if (!sr_isError(res) && VG_(tdict).track_post_mem_write) {
+   /* --record-syscalls needs the writes even when the tool does not */
+   if (!sr_isError(res)
+       && (VG_(tdict).track_post_mem_write
+           || VG_(replay_mode) == ReplayRecord)) {
       UInt buflen_out = deref_UInt( tid, buflen_p, s);
-      if (buflen_out > 0 && buf_p != (Addr)NULL) {
-         VG_(tdict).track_post_mem_write( Vg_CoreSysCall, tid, buf_p, buflen_out );
+      if (buf_p != (Addr)NULL) {
+         /* The kernel wrote the length back as well as the buffer */
+         POST_MEM_WRITE( buflen_p, sizeof(UInt) );
+         if (buflen_out > 0)
+            POST_MEM_WRITE( buf_p, buflen_out );
       }
    }
 }
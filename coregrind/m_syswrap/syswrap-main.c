@@ -49,6 +49,7 @@
 #include "pub_core_mallocfree.h"
 #include "pub_core_syswrap.h"
 #include "pub_core_gdbserver.h"     // VG_(gdbserver_report_syscall)
+#include "pub_core_replay.h"        // VG_(replay_pre_syscall)
 
 #include "priv_types_n_macros.h"
 #include "priv_syswrap-main.h"
@@ -1979,14 +1980,48 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
          and PostOnFail are ok. */
       vg_assert(0 == (sci->flags & ~(SfMayBlock | SfPostOnFail | SfPollAfter)));
 
-      if (sci->flags & SfMayBlock) {
+      /* When recording or replaying, find out whether the kernel
+         needs to see this one at all. */
+      ReplayAction replay = ReplayRun;
+      SysRes       replay_sres;
+      if (UNLIKELY(VG_(replay_mode) != ReplayOff))
+         replay = VG_(replay_pre_syscall)(tid, sysno, &replay_sres);
+
+      /* Give up the lock where the recording did, so that the other
+         threads get their turn in the same order. */
+      if (replay != ReplayRun && (sci->flags & SfMayBlock)) {
+         VG_(release_BigLock)(tid, VgTs_WaitSys,
+                              "VG_(client_syscall)[replay]");
+         VG_(acquire_BigLock)(tid, "VG_(client_syscall)[replay]");
+      }
+
+      if (replay == ReplayRestart) {
+         /* It was interrupted and restarted when recorded; the signal
+            that did that is delivered next. */
+         PRINT(" --> [replay] restart\n");
+         ML_(fixup_guest_state_to_restart_syscall)(&tst->arch);
+         sci->status.what = SsIdle;
+         return;
+      }
+
+      if (replay == ReplayResult) {
+
+         sci->status = convert_SysRes_to_SyscallStatus(replay_sres);
+         PRINT(" --> [replay] %s", VG_(sr_as_string)(sci->status.sres));
+
+      } else if (sci->flags & SfMayBlock) {
 
          /* Syscall may block, so run it asynchronously */
          vki_sigset_t mask;
 
          PRINT(" --> [async] ... \n");
 
-         mask = tst->sig_mask;
+         /* When replaying, signals come from the log, not the
+            kernel. */
+         if (UNLIKELY(VG_(replay_mode) == ReplayReplay))
+            VG_(sigfillset)(&mask);
+         else
+            mask = tst->sig_mask;
          VG_(sanitize_client_sigmask)(&mask);
 
          /* Gack.  More impedance matching.  Copy the possibly
@@ -2110,6 +2145,7 @@ void VG_(post_syscall) (ThreadId tid)
    const SyscallTableEntry* ent;
    SyscallStatus            test_status;
    ThreadState*             tst;
+   SysRes                   kernel_sres;
    Word sysno;
 
    /* Preliminaries */
@@ -2132,6 +2168,7 @@ void VG_(post_syscall) (ThreadId tid)
       state.  At least in the normal case where we have actually
       previously written the result into the guest state. */
    vg_assert(sci->status.what == SsComplete);
+   kernel_sres = sci->status.sres;
 
    /* Get the system call number.  Because the pre-handler isn't
       allowed to mess with it, it should be the same for both the
@@ -2192,6 +2229,11 @@ void VG_(post_syscall) (ThreadId tid)
                     sci->status.sres);
    }
 
+   /* Log it, or check it against the log, with the result the kernel
+      gave, before the post-handler had its say. */
+   if (UNLIKELY(VG_(replay_mode) != ReplayOff))
+      VG_(replay_post_syscall)(tid, sysno, kernel_sres);
+
    /* The syscall is done. */
    vg_assert(sci->status.what == SsComplete);
    sci->status.what = SsIdle;
@@ -2836,6 +2878,9 @@ VG_(fixup_guest_state_after_syscall_interrupted)( ThreadId tid,
       ML_(fixup_guest_state_to_restart_syscall), since that just
       re-positions the guest's IP for another go at it).  So we need
       to record that fact. */
+   if (UNLIKELY(VG_(replay_mode) != ReplayOff)
+       && sci->status.what == SsHandToKernel)
+      VG_(replay_syscall_restarted)(tid);
    sci->status.what = SsIdle;
 }
 
@@ -95,9 +95,11 @@ VgNeeds VG_(needs) = {
    .print_stats          = False,
    .info_location        = False,
    .var_info	         = False,
+   .no_debuginfo         = False,
    .malloc_replacement   = False,
    .xml_output           = False,
-   .final_IR_tidy_pass   = False
+   .final_IR_tidy_pass   = False,
+   .persistent_translations = False
 };
 
 /* static */
@@ -223,6 +225,7 @@ NEEDS(libc_freeres)
 NEEDS(cxx_freeres)
 NEEDS(core_errors)
 NEEDS(var_info)
+NEEDS(no_debuginfo)
 
 void VG_(needs_superblock_discards)(
    void (*discard)(Addr, VexGuestExtents)
@@ -374,6 +377,14 @@ void VG_(needs_final_IR_tidy_pass)(
    VG_(tdict).tool_final_IR_tidy_pass = final_tidy;
 }
 
+void VG_(needs_persistent_translations)(
+   Bool (*option_is_keyed)(const HChar*)
+)
+{
+   VG_(needs).persistent_translations = True;
+   VG_(tdict).tool_option_is_keyed = option_is_keyed;
+}
+
 /*--------------------------------------------------------------------*/
 /* Tracked events.  Digit 'n' on DEFn is the REGPARMness. */
 
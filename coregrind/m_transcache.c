@@ -0,0 +1,448 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Translations kept on disk between runs.       m_transcache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_aspacemgr.h"
+#include "pub_core_clientstate.h"   // VG_(args_for_valgrind)
+#include "pub_core_hashtable.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_machine.h"       // VG_(machine_get_VexArchInfo)
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_tooliface.h"     // VG_(needs), VG_(details)
+#include "pub_core_transtab.h"      // VG_(get_translation_mode)
+#include "pub_core_xarray.h"
+#include "pub_core_transcache.h"    // self
+
+#include "config.h"                 // VERSION
+
+/* Host code refers to the tool's helpers and to core data by absolute
+   address, so it is only valid for the same tool executable: its
+   identity is part of every file's key.  Guest addresses are embedded
+   too, hence the address an object is mapped at is part of the key of
+   its file.  Translations are stored unchained, as VEX made them, and
+   get chained again as they run.
+
+   Layout of a file: a FileHeader, then Records, each followed by its
+   host code padded to 8 bytes.  Records are only ever appended, each
+   with a single write to a file opened with O_APPEND, so that
+   processes forked from one another can share a file.  A record that
+   is cut short or fails its checksum ends the file as far as readers
+   are concerned, and stops this run from adding to it. */
+
+#define TC_MAGIC   "VGTCACHE"
+#define TC_VERSION 1
+
+typedef
+   struct {
+      HChar magic[8];
+      UInt  version;
+      UInt  record_szB;  // sizeof(Record), as a check
+      ULong key;         // as in the file name
+   }
+   FileHeader;
+
+typedef
+   struct {
+      ULong  entry;
+      ULong  base[3];
+      UInt   size;       // of the record and its code, a multiple of 8
+      UInt   check;      // checksum of the rest of the record and code
+      UInt   mode;       // translation mode
+      UShort code_len;
+      UShort len[3];
+      UChar  n_used;
+      UChar  is_self_checking;
+      UChar  n_guest_instrs;
+      UChar  pad;
+   }
+   Record;
+
+STATIC_ASSERT(sizeof(FileHeader) == 24);
+STATIC_ASSERT(sizeof(Record) == 56);
+
+/* A translation of some object, for some mode */
+typedef
+   struct _Entry {
+      struct _Entry* next;   // VgHashNode
+      UWord          key;    // entry
+      struct _Entry* alt;    // another mode, same entry
+      const Record*  rec;
+   }
+   Entry;
+
+/* A mapping of an object file */
+typedef
+   struct _Object {
+      struct _Object* next;
+      ULong           dev;
+      ULong           ino;
+      Addr            bias;     // mapped address minus file offset
+      Int             fd;       // -1 if no more records can be added
+      UChar*          buf;      // the file as it was read
+      VgHashTable*    entries;  // of Entry
+   }
+   Object;
+
+Bool VG_(transcache_active) = False;
+
+static ULong   global_key = 0;
+static Object* objects    = NULL;
+
+/* Stats */
+static ULong n_objects = 0;
+static ULong n_loaded  = 0;
+static ULong n_hits    = 0;
+static ULong n_added   = 0;
+
+/* 64-bit FNV-1a */
+static ULong hash_bytes ( ULong h, const void* p, SizeT n )
+{
+   const UChar* b = p;
+   SizeT        i;
+
+   for (i = 0; i < n; i++) {
+      h ^= b[i];
+      h *= 0x100000001b3ULL;
+   }
+   return h;
+}
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+static ULong hash_str ( ULong h, const HChar* s )
+{
+   return hash_bytes(h, s, VG_(strlen)(s) + 1);
+}
+
+static UInt record_check ( const Record* r, const UChar* code )
+{
+   Record tmp = *r;
+   ULong  h;
+
+   tmp.size  = 0;
+   tmp.check = 0;
+   h = hash_bytes(HASH_INIT, &tmp, sizeof(tmp));
+   h = hash_bytes(h, code, r->code_len);
+   return (UInt)(h ^ (h >> 32));
+}
+
+/* Options that change what is printed, not how anything is translated */
+static Bool key_ignores_option ( const HChar* arg )
+{
+   static const HChar* const ignored[] = {
+      "--translation-cache=", "--log-", "--xml", "--stats=",
+      "-v", "--verbose", "-q", "--quiet"
+   };
+   UInt i;
+
+   for (i = 0; i < sizeof(ignored) / sizeof(ignored[0]); i++)
+      if (VG_(strncmp)(arg, ignored[i], VG_(strlen)(ignored[i])) == 0)
+         return True;
+   return False;
+}
+
+void VG_(transcache_init) ( void )
+{
+   struct vg_stat st;
+   VexArch        arch;
+   VexArchInfo    archinfo;
+   ULong          h = HASH_INIT;
+   Word           i;
+
+   if (VG_(clo_translation_cache) == NULL)
+      return;
+   if (!VG_(needs).persistent_translations) {
+      VG_(umsg)("Warning: %s translations cannot be kept, "
+                "ignoring --translation-cache\n", VG_(details).name);
+      return;
+   }
+   if (VG_(clo_keep_hot_translations) > 0) {
+      VG_(umsg)("Warning: translations counting their runs cannot be "
+                "kept, ignoring --translation-cache\n");
+      return;
+   }
+   if (sr_isError(VG_(stat)(VG_(clo_translation_cache), &st))
+       || !VKI_S_ISDIR(st.mode))
+      VG_(fmsg_bad_option)("--translation-cache",
+                           "%s is not a directory\n",
+                           VG_(clo_translation_cache));
+
+   h = hash_str(h, VERSION);
+   h = hash_str(h, VG_(details).name);
+   if (sr_isError(VG_(stat)("/proc/self/exe", &st))) {
+      VG_(umsg)("Warning: cannot identify the %s executable, "
+                "ignoring --translation-cache\n", VG_(details).name);
+      return;
+   }
+   h = hash_bytes(h, &st.dev, sizeof(st.dev));
+   h = hash_bytes(h, &st.ino, sizeof(st.ino));
+   h = hash_bytes(h, &st.size, sizeof(st.size));
+   h = hash_bytes(h, &st.mtime, sizeof(st.mtime));
+   h = hash_bytes(h, &st.mtime_nsec, sizeof(st.mtime_nsec));
+   VG_(machine_get_VexArchInfo)(&arch, &archinfo);
+   h = hash_bytes(h, &arch, sizeof(arch));
+   h = hash_bytes(h, &archinfo.hwcaps, sizeof(archinfo.hwcaps));
+   for (i = 0; i < VG_(sizeXA)(VG_(args_for_valgrind)); i++) {
+      const HChar* arg = *(HChar**)VG_(indexXA)(VG_(args_for_valgrind), i);
+      if (!key_ignores_option(arg)
+          && VG_TDICT_CALL(tool_option_is_keyed, arg))
+         h = hash_str(h, arg);
+   }
+   global_key = h;
+   VG_(transcache_active) = True;
+}
+
+/* Does vge lie within seg? */
+static Bool vge_in_seg ( const VexGuestExtents* vge, NSegment const* seg )
+{
+   UInt i;
+
+   for (i = 0; i < vge->n_used; i++)
+      if (vge->base[i] < seg->start
+          || vge->base[i] + vge->len[i] - 1 > seg->end)
+         return False;
+   return True;
+}
+
+static void add_entry ( Object* o, const Record* rec )
+{
+   Entry* e   = VG_(malloc)("transcache.entry", sizeof(Entry));
+   Entry* old = VG_(HT_lookup)(o->entries, (UWord)rec->entry);
+
+   e->rec = rec;
+   if (old != NULL) {
+      e->alt   = old->alt;
+      old->alt = e;
+   } else {
+      e->key = (UWord)rec->entry;
+      e->alt = NULL;
+      VG_(HT_add_node)(o->entries, e);
+   }
+}
+
+/* Read the records of o's file, of size 'size', into o->entries.
+   Returns False if the file cannot be added to. */
+static Bool load_object ( Object* o, ULong key, Long size )
+{
+   const FileHeader* fh;
+   Long              pos;
+
+   o->buf = VG_(malloc)("transcache.buf", size);
+   if (VG_(read)(o->fd, o->buf, size) != size)
+      return False;
+   fh = (const FileHeader*)o->buf;
+   if (size < sizeof(FileHeader)
+       || VG_(memcmp)(fh->magic, TC_MAGIC, 8) != 0
+       || fh->version != TC_VERSION
+       || fh->record_szB != sizeof(Record)
+       || fh->key != key)
+      return False;
+
+   for (pos = sizeof(FileHeader); pos < size; ) {
+      const Record* r = (const Record*)(o->buf + pos);
+      if (pos + sizeof(Record) > size
+          || r->size % 8 != 0
+          || r->size < sizeof(Record) + r->code_len
+          || pos + r->size > size
+          || r->n_used < 1 || r->n_used > 3
+          || r->check != record_check(r, (const UChar*)(r + 1)))
+         return False;
+      add_entry(o, r);
+      n_loaded++;
+      pos += r->size;
+   }
+   return True;
+}
+
+/* The Object for seg, opening and reading its file the first time it
+   is seen.  NULL if its translations cannot be kept. */
+static Object* find_object ( NSegment const* seg )
+{
+   struct vg_stat st;
+   const HChar*   name;
+   Object*        o;
+   ULong          key;
+   Addr           bias;
+
+   if (seg == NULL || seg->kind != SkFileC)
+      return NULL;
+   bias = seg->start - seg->offset;
+   for (o = objects; o != NULL; o = o->next)
+      if (o->dev == seg->dev && o->ino == seg->ino && o->bias == bias)
+         return o->entries ? o : NULL;
+
+   o = VG_(calloc)("transcache.object", 1, sizeof(Object));
+   o->dev  = seg->dev;
+   o->ino  = seg->ino;
+   o->bias = bias;
+   o->fd   = -1;
+   o->next = objects;
+   objects = o;
+
+   name = VG_(am_get_filename)(seg);
+   if (name == NULL || sr_isError(VG_(stat)(name, &st))
+       || st.dev != seg->dev || st.ino != seg->ino)
+      return NULL;
+
+   key = hash_str(global_key, name);
+   key = hash_bytes(key, &st.dev, sizeof(st.dev));
+   key = hash_bytes(key, &st.ino, sizeof(st.ino));
+   key = hash_bytes(key, &st.size, sizeof(st.size));
+   key = hash_bytes(key, &st.mtime, sizeof(st.mtime));
+   key = hash_bytes(key, &st.mtime_nsec, sizeof(st.mtime_nsec));
+   key = hash_bytes(key, &bias, sizeof(bias));
+
+   HChar  path[VG_(strlen)(VG_(clo_translation_cache)) + 32];
+   SysRes sres;
+   VG_(sprintf)(path, "%s/%016llx.vgtc", VG_(clo_translation_cache), key);
+   sres = VG_(open)(path, VKI_O_CREAT|VKI_O_RDWR|VKI_O_APPEND,
+                    VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sr_isError(sres))
+      return NULL;
+   o->fd      = VG_(safe_fd)(sr_Res(sres));
+   o->entries = VG_(HT_construct)("transcache.entries");
+   n_objects++;
+
+   if (VG_(fstat)(o->fd, &st) != 0) {
+      VG_(close)(o->fd);
+      o->fd = -1;
+   } else if (st.size == 0) {
+      FileHeader fh;
+      VG_(memset)(&fh, 0, sizeof(fh));
+      VG_(memcpy)(fh.magic, TC_MAGIC, 8);
+      fh.version    = TC_VERSION;
+      fh.record_szB = sizeof(Record);
+      fh.key        = key;
+      if (VG_(write)(o->fd, &fh, sizeof(fh)) != sizeof(fh)) {
+         VG_(close)(o->fd);
+         o->fd = -1;
+      }
+   } else if (!load_object(o, key, st.size)) {
+      if (VG_(clo_verbosity) > 1)
+         VG_(umsg)("translation cache %s is damaged, "
+                   "not adding to it\n", path);
+      VG_(close)(o->fd);
+      o->fd = -1;
+   }
+   if (VG_(clo_verbosity) > 2)
+      VG_(dmsg)("transcache: %s -> %s\n", name, path);
+   return o;
+}
+
+Bool VG_(transcache_lookup) ( NSegment const* seg, Addr entry,
+                              /*OUT*/VexGuestExtents* vge,
+                              /*OUT*/const UChar** code,
+                              /*OUT*/UInt* code_len,
+                              /*OUT*/Bool* is_self_checking,
+                              /*OUT*/UInt* n_guest_instrs )
+{
+   Object* o = find_object(seg);
+   Entry*  e;
+   UInt    mode = VG_(get_translation_mode)();
+   UInt    i;
+
+   if (o == NULL)
+      return False;
+   for (e = VG_(HT_lookup)(o->entries, entry); e != NULL; e = e->alt) {
+      const Record* r = e->rec;
+      if (r->mode != mode)
+         continue;
+      vge->n_used = r->n_used;
+      for (i = 0; i < 3; i++) {
+         vge->base[i] = (Addr)r->base[i];
+         vge->len[i]  = r->len[i];
+      }
+      /* A record for another block of the object's code may share
+         the entry's hash chain: keep looking */
+      if (vge->base[0] != entry || !vge_in_seg(vge, seg))
+         continue;
+      *code             = (const UChar*)(r + 1);
+      *code_len         = r->code_len;
+      *is_self_checking = r->is_self_checking;
+      *n_guest_instrs   = r->n_guest_instrs;
+      n_hits++;
+      return True;
+   }
+   return False;
+}
+
+void VG_(transcache_add) ( NSegment const* seg, Addr entry,
+                           const VexGuestExtents* vge,
+                           const UChar* code, UInt code_len,
+                           Bool is_self_checking,
+                           UInt n_guest_instrs )
+{
+   Object* o = find_object(seg);
+   Record* r;
+   UInt    size, i;
+
+   if (o == NULL || o->fd < 0 || !vge_in_seg(vge, seg)
+       || code_len > 0xFFFF || n_guest_instrs > 0xFF)
+      return;
+   size = (sizeof(Record) + code_len + 7) & ~7;
+   r    = VG_(calloc)("transcache.record", 1, size);
+   r->entry = entry;
+   r->n_used = vge->n_used;
+   for (i = 0; i < 3; i++) {
+      r->base[i] = vge->base[i];
+      r->len[i]  = vge->len[i];
+   }
+   r->size             = size;
+   r->mode             = VG_(get_translation_mode)();
+   r->code_len         = code_len;
+   r->is_self_checking = is_self_checking;
+   r->n_guest_instrs   = n_guest_instrs;
+   VG_(memcpy)(r + 1, code, code_len);
+   r->check = record_check(r, code);
+   if (VG_(write)(o->fd, r, size) != size) {
+      VG_(close)(o->fd);
+      o->fd = -1;
+      VG_(free)(r);
+      return;
+   }
+   /* In case the block is translated again, after its sector is
+      recycled, say */
+   add_entry(o, r);
+   n_added++;
+}
+
+void VG_(print_transcache_stats) ( void )
+{
+   if (!VG_(transcache_active))
+      return;
+   VG_(message)(Vg_DebugMsg,
+                "transcache: %'llu objects, %'llu translations read, "
+                "%'llu used, %'llu added\n",
+                n_objects, n_loaded, n_hits, n_added);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -37,6 +37,7 @@
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"    // VG_(read_microsecond_timer)
 #include "pub_core_options.h"
 
 #include "pub_core_debuginfo.h"  // VG_(get_fnname_w_offset)
@@ -46,6 +47,7 @@
 #include "pub_core_stacks.h"     // VG_(unknown_SP_update*)()
 #include "pub_core_tooliface.h"  // VG_(tdict)
 
+#include "pub_core_transcache.h"
 #include "pub_core_translate.h"
 #include "pub_core_transtab.h"
 #include "pub_core_dispatch.h" // VG_(run_innerloop__dispatch_{un}profiled)
@@ -57,6 +59,7 @@
 #include "pub_core_execontext.h"  // VG_(make_depth_1_ExeContext_from_Addr)
 
 #include "pub_core_gdbserver.h"   // VG_(instrument_for_gdbserver_if_needed)
+#include "pub_core_helperprof.h"  // VG_(helperprof_instrument)
 
 #include "libvex_emnote.h"        // For PPC, EmWarn_PPC64_redir_underflow
 
@@ -68,6 +71,7 @@ static ULong n_TRACE_total_constructed              = 0;
 static ULong n_TRACE_total_guest_insns              = 0;
 static ULong n_TRACE_total_uncond_branches_followed = 0;
 static ULong n_TRACE_total_cond_branches_followed   = 0;
+static ULong n_TRACE_total_usecs                    = 0;
 
 static ULong n_SP_updates_new_fast            = 0;
 static ULong n_SP_updates_new_generic_known   = 0;
@@ -89,6 +93,12 @@ void VG_(print_translation_stats) ( void )
        n_TRACE_total_guest_insns, n_TRACE_total_constructed,
        n_TRACE_total_uncond_branches_followed,
        n_TRACE_total_cond_branches_followed);
+   if (n_TRACE_total_constructed > 0)
+      VG_(message)
+         (Vg_DebugMsg,
+          "translate: %'llu us translating, %'llu ns/trace\n",
+          n_TRACE_total_usecs,
+          n_TRACE_total_usecs * 1000 / n_TRACE_total_constructed);
    UInt n_SP_updates = n_SP_updates_new_fast + n_SP_updates_new_generic_known
                      + n_SP_updates_die_fast + n_SP_updates_die_generic_known
                      + n_SP_updates_generic_unknown;
@@ -121,6 +131,7 @@ void VG_(print_translation_stats) ( void )
        "  AllRegs %'llu,  AllRegsAllInsns %'llu\n",
        n_PX_VexRegUpdSpAtMemAccess, n_PX_VexRegUpdUnwindregsAtMemAccess,
        n_PX_VexRegUpdAllregsAtMemAccess, n_PX_VexRegUpdAllregsAtEachInsn);
+   VG_(print_transcache_stats)();
 }
 
 /*------------------------------------------------------------*/
@@ -685,6 +696,24 @@ IRSB* vg_SP_update_pass ( void*             closureV,
 #undef DO_DIE
 }
 
+/* With --profile-helpers, the counting of the dirty helper calls comes
+   last, after the SP update pass, so as to include the calls which
+   that adds. */
+static
+IRSB* SP_update_then_helperprof ( void*             closureV,
+                                  IRSB*             sb_in,
+                                  const VexGuestLayout*   layout,
+                                  const VexGuestExtents*  vge,
+                                  const VexArchInfo*      vai,
+                                  IRType            gWordTy,
+                                  IRType            hWordTy )
+{
+   if (need_to_handle_SP_assignment())
+      sb_in = vg_SP_update_pass(closureV, sb_in, layout, vge, vai,
+                                gWordTy, hWordTy);
+   return VG_(helperprof_instrument)(sb_in);
+}
+
 /*------------------------------------------------------------*/
 /*--- Main entry point for the JITter.                     ---*/
 /*------------------------------------------------------------*/
@@ -1649,6 +1678,31 @@ Bool VG_(translate) ( ThreadId tid,
       verbosity = VG_(clo_trace_flags);
    }
 
+   /* A translation kept by an earlier run (--translation-cache) saves
+      calling VEX.  Not if it would differ from a new one, though: when
+      profiling, when gdbserver may be instrumenting, or when the
+      translation is to be printed. */
+   Bool keep = VG_(transcache_active)
+               && kind == T_Normal
+               && !debugging_translation
+               && verbosity == 0
+               && !VG_(clo_profyle_sbs)
+               && !VG_(clo_profile_helpers)
+               && !VG_(gdbserver_instrumenting)();
+   if (keep) {
+      const UChar* code;
+      UInt         code_len, n_guest_instrs;
+      Bool         is_self_checking;
+      if (VG_(transcache_lookup)(seg, nraddr, &vge, &code, &code_len,
+                                 &is_self_checking, &n_guest_instrs)) {
+         for (i = 0; i < vge.n_used; i++)
+            VG_(am_set_segment_hasT)( vge.base[i] );
+         VG_(add_to_transtab)( &vge, nraddr, (Addr)code, code_len,
+                               is_self_checking, -1, n_guest_instrs );
+         return True;
+      }
+   }
+
    /* Figure out which preamble-mangling callback to send. */
    preamble_fn = NULL;
    if (kind == T_Redir_Replace)
@@ -1784,7 +1838,9 @@ Bool VG_(translate) ( ThreadId tid,
      vta.instrument1     = g;
    }
    /* No need for type kludgery here. */
-   vta.instrument2       = need_to_handle_SP_assignment()
+   vta.instrument2       = VG_(clo_profile_helpers)
+                              ? SP_update_then_helperprof
+                              : need_to_handle_SP_assignment()
                               ? vg_SP_update_pass
                               : NULL;
    vta.finaltidy         = VG_(needs).final_IR_tidy_pass
@@ -1794,7 +1850,9 @@ Bool VG_(translate) ( ThreadId tid,
    vta.preamble_function = preamble_fn;
    vta.traceflags        = verbosity;
    vta.sigill_diag       = VG_(clo_sigill_diag);
-   vta.addProfInc        = VG_(clo_profyle_sbs) && kind != T_NoRedir;
+   vta.addProfInc        = (VG_(clo_profyle_sbs)
+                            || VG_(clo_keep_hot_translations) > 0)
+                           && kind != T_NoRedir;
 
    /* Set up the dispatch continuation-point info.  If this is a
       no-redir translation then it cannot be chained, and the chain-me
@@ -1824,8 +1882,12 @@ Bool VG_(translate) ( ThreadId tid,
    vta.disp_cp_xassisted
       = VG_(fnptr_to_fnentry)( &VG_(disp_cp_xassisted) );
 
-   /* Sheesh.  Finally, actually _do_ the translation! */
+   /* Sheesh.  Finally, actually _do_ the translation!  It is timed
+      for --stats only, as reading the clock is a syscall. */
+   ULong usecs = VG_(clo_stats) ? VG_(read_microsecond_timer)() : 0;
    tres = LibVEX_Translate ( &vta );
+   if (VG_(clo_stats))
+      n_TRACE_total_usecs += VG_(read_microsecond_timer)() - usecs;
 
    vg_assert(tres.status == VexTransOK);
    vg_assert(tres.n_sc_extents >= 0 && tres.n_sc_extents <= 3);
@@ -1836,6 +1898,10 @@ Bool VG_(translate) ( ThreadId tid,
    n_TRACE_total_guest_insns += tres.n_guest_instrs;
    n_TRACE_total_uncond_branches_followed += tres.n_uncond_in_trace;
    n_TRACE_total_cond_branches_followed   += tres.n_cond_in_trace;
+
+   if (keep && tres.offs_profInc == -1)
+      VG_(transcache_add)( seg, nraddr, &vge, tmpbuf, tmpbuf_used,
+                           tres.n_sc_extents > 0, tres.n_guest_instrs );
    } /* END new scope specially for 'seg' */
 
    /* Tell aspacem of all segments that have had translations taken
@@ -54,9 +54,22 @@
 /* Nr of sectors provided via command line parameter. */
 UInt VG_(clo_num_transtab_sectors) = N_SECTORS_DEFAULT;
 /* Nr of sectors.
-   Will be set by VG_(init_tt_tc) to VG_(clo_num_transtab_sectors). */
+   Will be set by VG_(init_tt_tc) to VG_(clo_num_transtab_sectors),
+   and may grow later, up to max_n_sectors. */
 static SECno n_sectors = 0;
 
+/* Memory budget in MB for the TT/TC, beyond which it does not grow.
+   0 means twice the initial size. */
+UInt VG_(clo_max_transtab_size) = 0;
+/* Nr of sectors at startup, and the most there can be within
+   VG_(clo_max_transtab_size).  Set by VG_(init_tt_tc). */
+static SECno initial_n_sectors = 0;
+static SECno max_n_sectors = 0;
+
+/* Translations run at least this many times since they were made are
+   kept when their sector is recycled.  0 means none are. */
+UInt VG_(clo_keep_hot_translations) = 0;
+
 /* Average size of a transtab code entry. 0 means to use the tool
    provided default. */
 UInt VG_(clo_avg_transtab_entry_size) = 0;
@@ -98,6 +111,19 @@ typedef UShort HTTno;
 #define ECLASS_N     (1 + ECLASS_MISC)
 STATIC_ASSERT(ECLASS_SHIFT + ECLASS_WIDTH < 32);
 
+/* Size of the table of recently dumped translations, used to notice
+   when one is made again.  Must be a power of 2. */
+#define N_DUMPED_TTES 65536
+
+/* Sectors are added when, over one pass through all of them, at least
+   this percentage of the new translations were of blocks thrown away
+   earlier by recycling. */
+#define CHURN_PERCENT 10
+
+/* When a sector is recycled, the hot translations kept in it take at
+   most 1/KEEP_HOT_FRACTION of its tt entries and of its tc. */
+#define KEEP_HOT_FRACTION 4
+
 typedef UShort EClassNo;
 
 /*------------------ TYPES ------------------*/
@@ -193,6 +219,14 @@ typedef
          redirection. */
       Addr entry;
 
+      /* The translation mode the tool was in when this translation was
+         made (see VG_(set_translation_mode)).  Only translations of the
+         current mode are found by VG_(search_transtab), so one guest
+         address can have a translation in each mode at once.  It is
+         kept here rather than in the hot part, which is full, next to
+         .entry, which lookups compare anyway. */
+      UInt mode;
+
       /* Address range summary info: these are pointers back to
          eclass[] entries in the containing Sector.  Those entries in
          turn point back here -- the two structures are mutually
@@ -422,6 +456,14 @@ typedef
          in strictly non-overlapping order, so we can binary search
          them at any time. */
       XArray* host_extents; /* XArray* of HostExtent */
+
+      /* Kept across recycling: the number of times this sector was
+         recycled, the translations that threw away, and how many of
+         those were made again afterwards. */
+      UInt  n_recycled;
+      ULong n_dumped;
+      ULong n_retranslated;
+      ULong n_kept;
    }
    Sector;
 
@@ -490,6 +532,10 @@ typedef
 /* Make sure we're not used before initialisation. */
 static Bool init_done = False;
 
+/* The current translation mode.  New translations are tagged with it,
+   and only translations tagged with it are found. */
+static UInt translation_mode = 0;
+
 
 /*------------------ STATS DECLS ------------------*/
 
@@ -517,6 +563,24 @@ static ULong n_sectors_recycled = 0;
 static ULong n_disc_count = 0;
 static ULong n_disc_osize = 0;
 
+/* Number of translation mode switches. */
+static ULong n_mode_switches = 0;
+
+/* Number of translations of blocks dumped earlier by recycling, and
+   the values of it and n_in_count when youngest_sector last wrapped
+   around to sector 0. */
+static ULong n_retranslated = 0;
+static ULong cycle_retranslated = 0;
+static ULong cycle_in_count = 0;
+
+/* Number of times sectors were added, and of passes with churn when
+   no more could be added. */
+static ULong n_sector_growths = 0;
+static ULong n_churn_at_max = 0;
+
+/* Number of hot translations kept when recycling. */
+static ULong n_hot_kept = 0;
+
 
 /*-------------------------------------------------------------*/
 /*--- Misc                                                  ---*/
@@ -1541,6 +1605,256 @@ static void add_to_empty_tt_list (SECno sNo, TTEno tteno)
    sectors[sNo].empty_tt_list = tteno;
 }
 
+/* Point an htt entry of sector y to its tt slot tteix, holding a
+   translation of entry. */
+static void add_to_htt ( SECno y, Addr entry, TTEno tteix )
+{
+   HTTno htti = HASH_TT(entry);
+   vg_assert(htti >= 0 && htti < N_HTTES_PER_SECTOR);
+   while (True) {
+      if (sectors[y].htt[htti] == HTT_EMPTY
+          || sectors[y].htt[htti] == HTT_DELETED)
+         break;
+      htti++;
+      if (htti >= N_HTTES_PER_SECTOR)
+         htti = 0;
+   }
+   sectors[y].htt[htti] = tteix;
+}
+
+/* Add the code of tt slot tteix to the host_extents map of sector y,
+   checking that we're adding in order. */
+static void add_host_extent ( SECno y, ULong* tcptr, UInt code_len,
+                              TTEno tteix )
+{
+   HostExtent hx;
+   hx.start = (UChar*)tcptr;
+   hx.len   = code_len;
+   hx.tteNo = tteix;
+   vg_assert(hx.len > 0); /* bsearch fails w/ zero length entries */
+   XArray* hx_array = sectors[y].host_extents;
+   vg_assert(hx_array);
+   Word n = VG_(sizeXA)(hx_array);
+   if (n > 0) {
+      HostExtent* hx_prev = (HostExtent*)VG_(indexXA)(hx_array, n-1);
+      vg_assert(hx_prev->start + hx_prev->len <= hx.start);
+   }
+   VG_(addToXA)(hx_array, &hx);
+   if (DEBUG_TRANSTAB)
+      VG_(printf)("... hx.start 0x%p hx.len %u sector %d ttslot %d\n",
+                  hx.start, hx.len, y, tteix);
+}
+
+/* With --keep-hot-translations=N, translations carry a profile
+   counter, as for --profile-flags.  When a sector is recycled, those
+   run at least N times since they were made are not thrown away, but
+   moved to the start of its tc: the sector becomes the youngest, so
+   they are the last to go the next time round.  They stay in their tt
+   slots, which their counters are part of, and their counts start
+   again, so that only translations still hot are kept again.  If more
+   qualify than fit in 1/KEEP_HOT_FRACTION of the sector, the hottest
+   are kept.  The host code moves, so it is unchained first; it gets
+   chained again as it runs. */
+
+/* The translations to keep from the sector being recycled, in address
+   order, and the set of their tt slots. */
+static HostExtent* hot_ttes   = NULL;
+static UInt        n_hot_ttes = 0;
+static UInt        hot_bits[(N_TTES_PER_SECTOR + 31) / 32];
+
+static inline Bool is_hot ( TTEno tteNo )
+{
+   return (hot_bits[tteNo / 32] >> (tteNo % 32)) & 1;
+}
+
+static inline UInt log2_count ( ULong count )
+{
+   UInt b = 0;
+   while (count > 1) {
+      count >>= 1;
+      b++;
+   }
+   return b;
+}
+
+/* Undo the chaining of the jumps from a translation to others, so
+   that its code can be moved. */
+static void unchain_out_edges ( VexArch arch_host, VexEndness endness_host,
+                                SECno sNo, TTEno tteNo )
+{
+   Int       evCheckSzB = LibVEX_evCheckSzB(arch_host);
+   TTEntryC* tteC       = index_tteC(sNo, tteNo);
+   UWord     i, j, n, m;
+
+   n = OutEdgeArr__size(&tteC->out_edges);
+   for (i = 0; i < n; i++) {
+      OutEdge*  oe      = OutEdgeArr__index(&tteC->out_edges, i);
+      TTEntryC* to_tteC = index_tteC(oe->to_sNo, oe->to_tteNo);
+      UChar*    to_slow_EP = (UChar*)to_tteC->tcptr;
+      m = InEdgeArr__size(&to_tteC->in_edges);
+      for (j = 0; j < m; j++) {
+         InEdge* ie = InEdgeArr__index(&to_tteC->in_edges, j);
+         if (ie->from_sNo == sNo && ie->from_tteNo == tteNo
+             && ie->from_offs == oe->from_offs)
+            break;
+      }
+      vg_assert(j < m); // "ie must be findable"
+      unchain_one(arch_host, endness_host,
+                  InEdgeArr__index(&to_tteC->in_edges, j),
+                  to_slow_EP + evCheckSzB, to_slow_EP);
+      InEdgeArr__deleteIndex(&to_tteC->in_edges, j);
+   }
+   OutEdgeArr__makeEmpty(&tteC->out_edges);
+}
+
+/* Is the extent hx the code of a translation in use with at least
+   the given count?  If so, returns log2 of the count in *bucket. */
+static Bool is_hot_candidate ( const Sector* sec, const HostExtent* hx,
+                               ULong min_count, /*OUT*/UInt* bucket )
+{
+   if (sec->ttH[hx->tteNo].status != InUse
+       || HostExtent__is_dead(hx, sec)
+       || sec->ttC[hx->tteNo].usage.prof.count < min_count)
+      return False;
+   *bucket = log2_count(sec->ttC[hx->tteNo].usage.prof.count);
+   return True;
+}
+
+/* Choose the translations of sector sno to keep when recycling it,
+   and unchain their exits. */
+static void select_hot_ttes ( VexArch arch_host, VexEndness endness_host,
+                              SECno sno )
+{
+   const Sector* sec       = &sectors[sno];
+   const ULong   min_count = VG_(clo_keep_hot_translations);
+   const UInt    max_n     = N_TTES_PER_SECTOR / KEEP_HOT_FRACTION;
+   const ULong   max_szB   = 8 * (ULong)tc_sector_szQ / KEEP_HOT_FRACTION;
+   UInt  n_in[64];
+   ULong szB_in[64];
+   UInt  b, cutoff, n;
+   ULong szB;
+   Word  i, n_hx;
+
+   n_hot_ttes = 0;
+   VG_(memset)(hot_bits, 0, sizeof(hot_bits));
+   if (min_count == 0)
+      return;
+   if (hot_ttes == NULL)
+      hot_ttes = ttaux_malloc("transtab.select_hot_ttes",
+                              max_n * sizeof(HostExtent));
+
+   /* Sort the candidates into buckets by log2 of their counts, and
+      find the lowest bucket from which on they all fit. */
+   VG_(memset)(n_in, 0, sizeof(n_in));
+   VG_(memset)(szB_in, 0, sizeof(szB_in));
+   n_hx = VG_(sizeXA)(sec->host_extents);
+   for (i = 0; i < n_hx; i++) {
+      const HostExtent* hx = VG_(indexXA)(sec->host_extents, i);
+      if (is_hot_candidate(sec, hx, min_count, &b)) {
+         n_in[b]++;
+         szB_in[b] += hx->len;
+      }
+   }
+   n   = 0;
+   szB = 0;
+   for (cutoff = 64; cutoff > 0; cutoff--) {
+      if (n + n_in[cutoff-1] > max_n || szB + szB_in[cutoff-1] > max_szB)
+         break;
+      n   += n_in[cutoff-1];
+      szB += szB_in[cutoff-1];
+   }
+
+   for (i = 0; i < n_hx; i++) {
+      const HostExtent* hx = VG_(indexXA)(sec->host_extents, i);
+      if (is_hot_candidate(sec, hx, min_count, &b) && b >= cutoff) {
+         hot_ttes[n_hot_ttes++] = *hx;
+         hot_bits[hx->tteNo / 32] |= 1U << (hx->tteNo % 32);
+         unchain_out_edges(arch_host, endness_host, sno, hx->tteNo);
+      }
+   }
+   vg_assert(n_hot_ttes == n);
+}
+
+/* Once sector sno has been emptied, move the kept translations to the
+   start of its tc, in address order so that none is overwritten
+   before it has moved, and enter them again. */
+static void move_hot_ttes ( SECno sno )
+{
+   Sector* sec = &sectors[sno];
+
+   for (UInt i = 0; i < n_hot_ttes; i++) {
+      const HostExtent* hot   = &hot_ttes[i];
+      TTEntryC*         tteC  = &sec->ttC[hot->tteNo];
+      ULong*            tcptr = sec->tc_next;
+
+      vg_assert((UChar*)tcptr <= hot->start);
+      VG_(memmove)(tcptr, hot->start, hot->len);
+      VG_(invalidate_icache)(tcptr, hot->len);
+      sec->tc_next += (hot->len + 7) >> 3;
+      sec->tt_n_inuse++;
+
+      tteC->tcptr = tcptr;
+      tteC->usage.prof.count = 0;
+      sec->ttH[hot->tteNo].status = InUse;
+      add_to_htt(sno, tteC->entry, hot->tteNo);
+      add_host_extent(sno, tcptr, hot->len, hot->tteNo);
+      upd_eclasses_after_add(sec, hot->tteNo);
+   }
+   n_hot_kept  += n_hot_ttes;
+   sec->n_kept += n_hot_ttes;
+   n_hot_ttes = 0;
+}
+
+/* Translations dumped by recycling, to count those made again.  A
+   direct-mapped table indexed by a hash of the guest address, and
+   allocated when a sector is first recycled.  Newer entries overwrite
+   older ones, so the retranslation counts are a lower bound. */
+typedef
+   struct {
+      Addr  entry;   // TRANSTAB_BOGUS_GUEST_ADDR if unused
+      UInt  mode;
+      SECno sno;     // the sector it was dumped from
+   }
+   DumpedTTE;
+
+static DumpedTTE* dumped_ttes = NULL;
+
+static inline UWord dumped_hash ( Addr entry )
+{
+   return (entry ^ (entry >> 16)) & (N_DUMPED_TTES - 1);
+}
+
+static void note_dumped ( SECno sno, const TTEntryC* tteC )
+{
+   DumpedTTE* d;
+
+   if (dumped_ttes == NULL) {
+      dumped_ttes = ttaux_malloc("transtab.note_dumped",
+                                 N_DUMPED_TTES * sizeof(DumpedTTE));
+      for (UWord i = 0; i < N_DUMPED_TTES; i++)
+         dumped_ttes[i].entry = TRANSTAB_BOGUS_GUEST_ADDR;
+   }
+   d = &dumped_ttes[dumped_hash(tteC->entry)];
+   d->entry = tteC->entry;
+   d->mode  = tteC->mode;
+   d->sno   = sno;
+}
+
+/* Count a new translation of 'entry' if it was dumped earlier. */
+static void check_retranslated ( Addr entry )
+{
+   DumpedTTE* d;
+
+   if (dumped_ttes == NULL)
+      return;
+   d = &dumped_ttes[dumped_hash(entry)];
+   if (d->entry == entry && d->mode == translation_mode) {
+      n_retranslated++;
+      sectors[d->sno].n_retranslated++;
+      d->entry = TRANSTAB_BOGUS_GUEST_ADDR;
+   }
+}
+
 static void initialiseSector ( SECno sno )
 {
    UInt i;
@@ -1642,7 +1956,6 @@ static void initialiseSector ( SECno sno )
       vg_assert(sec->ttC != NULL);
       vg_assert(sec->ttH != NULL);
       vg_assert(sec->tc_next != NULL);
-      n_dump_count += sec->tt_n_inuse;
 
       VexArch     arch_host = VexArch_INVALID;
       VexArchInfo archinfo_host;
@@ -1650,15 +1963,30 @@ static void initialiseSector ( SECno sno )
       VG_(machine_get_VexArchInfo)( &arch_host, &archinfo_host );
       VexEndness endness_host = archinfo_host.endness;
 
+      select_hot_ttes(arch_host, endness_host, sno);
+      n_dump_count += sec->tt_n_inuse - n_hot_ttes;
+      sec->n_recycled++;
+      sec->n_dumped += sec->tt_n_inuse - n_hot_ttes;
+
       /* Visit each just-about-to-be-abandoned translation. */
       if (DEBUG_TRANSTAB) VG_(printf)("QQQ unlink-entire-sector: %d START\n",
                                       sno);
       sec->empty_tt_list = HTT_EMPTY;
       for (TTEno ei = 0; ei < N_TTES_PER_SECTOR; ei++) {
+         if (sec->ttH[ei].status == InUse && is_hot(ei)) {
+            /* Kept, and entered again by move_hot_ttes: neither the
+               tool nor the empty list hear of it. */
+            unchain_in_preparation_for_deletion(arch_host,
+                                                endness_host, sno, ei);
+            sec->ttH[ei].status   = Empty;
+            sec->ttC[ei].n_tte2ec = 0;
+            continue;
+         }
          if (sec->ttH[ei].status == InUse) {
             vg_assert(sec->ttC[ei].n_tte2ec >= 1);
             vg_assert(sec->ttC[ei].n_tte2ec <= 3);
             n_dump_osize += TTEntryH__osize(&sec->ttH[ei]);
+            note_dumped(sno, &sec->ttC[ei]);
             /* Tell the tool too. */
             if (VG_(needs).superblock_discards) {
                VexGuestExtents vge_tmp;
@@ -1715,6 +2043,7 @@ static void initialiseSector ( SECno sno )
 
    sec->tc_next = sec->tc;
    sec->tt_n_inuse = 0;
+   move_hot_ttes(sno);
 
    invalidateFastCache();
 
@@ -1723,6 +2052,41 @@ static void initialiseSector ( SECno sno )
    }
 }
 
+/* Called when the youngest sector is full and the last one, so that
+   filling sector 0 again would throw away the oldest translations.  If
+   many of the translations made since the previous time were of blocks
+   dumped by earlier recycling, the code being run does not fit: add
+   sectors instead, within --max-transtab-size.  Returns True if it
+   did, in which case the first new sector is the one to fill next. */
+static Bool add_sectors ( void )
+{
+   ULong made  = n_in_count - cycle_in_count;
+   ULong again = n_retranslated - cycle_retranslated;
+   SECno more;
+
+   cycle_in_count     = n_in_count;
+   cycle_retranslated = n_retranslated;
+   if (again == 0 || again * 100 < made * CHURN_PERCENT)
+      return False;
+   if (n_sectors >= max_n_sectors) {
+      n_churn_at_max++;
+      return False;
+   }
+
+   more = n_sectors / 4 > 0 ? n_sectors / 4 : 1;
+   if (more > max_n_sectors - n_sectors)
+      more = max_n_sectors - n_sectors;
+   if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1
+       || VG_(clo_verbosity) > 1)
+      VG_(dmsg)("transtab: "
+                "%'llu of the last %'llu translations were made again, "
+                "growing from %d to %d sectors\n",
+                again, made, n_sectors, n_sectors + more);
+   n_sectors += more;
+   n_sector_growths++;
+   return True;
+}
+
 /* Add a translation of vge to TT/TC.  The translation is temporarily
    in code[0 .. code_len-1].
 
@@ -1760,6 +2124,7 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
    n_in_osize += vge_osize(vge);
    if (is_self_checking)
       n_in_sc_count++;
+   check_retranslated(entry);
 
    y = youngest_sector;
    vg_assert(isValidSector(y));
@@ -1795,7 +2160,7 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
                    8 * (tc_sector_szQ - tcAvailQ)/sectors[y].tt_n_inuse);
       }
       youngest_sector++;
-      if (youngest_sector >= n_sectors)
+      if (youngest_sector >= n_sectors && !add_sectors())
          youngest_sector = 0;
       y = youngest_sector;
       initialiseSector(y);
@@ -1842,21 +2207,12 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
              (code_len == 0 ? 1 : (code_len / 4));
 
    sectors[y].ttC[tteix].entry  = entry;
+   sectors[y].ttC[tteix].mode   = translation_mode;
    TTEntryH__from_VexGuestExtents( &sectors[y].ttH[tteix], vge );
    sectors[y].ttH[tteix].status = InUse;
 
    // Point an htt entry to the tt slot
-   HTTno htti = HASH_TT(entry);
-   vg_assert(htti >= 0 && htti < N_HTTES_PER_SECTOR);
-   while (True) {
-      if (sectors[y].htt[htti] == HTT_EMPTY
-          || sectors[y].htt[htti] == HTT_DELETED)
-         break;
-      htti++;
-      if (htti >= N_HTTES_PER_SECTOR)
-         htti = 0;
-   }
-   sectors[y].htt[htti] = tteix;
+   add_to_htt(y, entry, tteix);
 
    /* Patch in the profile counter location, if necessary. */
    if (offs_profInc != -1) {
@@ -1875,25 +2231,8 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
 
    VG_(invalidate_icache)( dstP, code_len );
 
-   /* Add this entry to the host_extents map, checking that we're
-      adding in order. */
-   { HostExtent hx;
-     hx.start = (UChar*)tcptr;
-     hx.len   = code_len;
-     hx.tteNo = tteix;
-     vg_assert(hx.len > 0); /* bsearch fails w/ zero length entries */
-     XArray* hx_array = sectors[y].host_extents;
-     vg_assert(hx_array);
-     Word n = VG_(sizeXA)(hx_array);
-     if (n > 0) {
-        HostExtent* hx_prev = (HostExtent*)VG_(indexXA)(hx_array, n-1);
-        vg_assert(hx_prev->start + hx_prev->len <= hx.start);
-     }
-     VG_(addToXA)(hx_array, &hx);
-     if (DEBUG_TRANSTAB)
-        VG_(printf)("... hx.start 0x%p hx.len %u sector %d ttslot %d\n",
-                    hx.start, hx.len, y, tteix);
-   }
+   /* Add this entry to the host_extents map. */
+   add_host_extent(y, tcptr, code_len, tteix);
 
    /* Update the fast-cache. */
    setFastCacheEntry( entry, tcptr );
@@ -1937,7 +2276,8 @@ Bool VG_(search_transtab) ( /*OUT*/Addr*  res_hcode,
          n_lookup_probes++;
          tti = sectors[sno].htt[k];
          if (tti < N_TTES_PER_SECTOR
-             && sectors[sno].ttC[tti].entry == guest_addr) {
+             && sectors[sno].ttC[tti].entry == guest_addr
+             && sectors[sno].ttC[tti].mode == translation_mode) {
             /* found it */
             if (upd_cache)
                setFastCacheEntry( 
@@ -2323,6 +2663,90 @@ void VG_(discard_translations_safely) ( Addr  start, SizeT len,
    VG_(discard_translations)(start, len, who);
 }
 
+/*------------------------------------------------------------*/
+/*--- Translation modes.                                   ---*/
+/*------------------------------------------------------------*/
+
+/* forward */
+static void init_unredir_tt_tc ( void );
+
+/* Undo every chained jump in the main TC.  Chains are only made
+   between translations of the mode current when the jump is first
+   taken, so after a mode switch the old ones must go: otherwise
+   control could flow from one translation of the old mode to the
+   next without ever looking them up again.
+
+   Only the sectors holding translations are walked, and each only
+   until all its translations are seen.  cstracer --phases switches
+   mode at most twice per --phase-interval (10M instructions by
+   default), which costs far more than this walk. */
+static void unchain_all ( void )
+{
+   VexArch     arch_host = VexArch_INVALID;
+   VexArchInfo archinfo_host;
+   VG_(bzero_inline)(&archinfo_host, sizeof(archinfo_host));
+   VG_(machine_get_VexArchInfo)( &arch_host, &archinfo_host );
+   VexEndness endness_host = archinfo_host.endness;
+   Int        evCheckSzB   = LibVEX_evCheckSzB(arch_host);
+
+   for (SECno sno = 0; sno < n_sectors; sno++) {
+      Sector* sec = &sectors[sno];
+      Int     left;
+      if (sec->tc == NULL)
+         continue;
+      left = sec->tt_n_inuse;
+      for (TTEno ei = 0; ei < N_TTES_PER_SECTOR && left > 0; ei++) {
+         if (sec->ttH[ei].status != InUse)
+            continue;
+         left--;
+         TTEntryC* tteC = &sec->ttC[ei];
+         UWord     n    = InEdgeArr__size(&tteC->in_edges);
+         UChar*    slow_EP = (UChar*)tteC->tcptr;
+         UChar*    fast_EP = slow_EP + evCheckSzB;
+         for (UWord i = 0; i < n; i++)
+            unchain_one(arch_host, endness_host,
+                        InEdgeArr__index(&tteC->in_edges, i),
+                        fast_EP, slow_EP);
+         /* Each out edge is the in edge of another translation, which
+            is unchained when that one is visited; unchain_one only
+            needs the in edges. */
+         InEdgeArr__makeEmpty(&tteC->in_edges);
+         OutEdgeArr__makeEmpty(&tteC->out_edges);
+      }
+   }
+}
+
+/* Make 'mode' the current translation mode.  The translations of the
+   other modes stay in the TC, unreachable until their mode is current
+   again, so switching back and forth costs no retranslation.  The
+   fast cache, the chained jumps and the (small) unredirected TC are
+   dropped, since they do not record the mode.  As with discards, the
+   block that calls this, if any, carries on to its end in the old
+   mode. */
+void VG_(set_translation_mode) ( UInt mode )
+{
+   if (!init_done) {
+      /* Nothing translated yet, hence nothing to drop. */
+      translation_mode = mode;
+      return;
+   }
+   if (mode == translation_mode)
+      return;
+   if (VG_(clo_verbosity) > 2)
+      VG_(message)(Vg_DebugMsg, "TT/TC: translation mode %u -> %u\n",
+                   translation_mode, mode);
+   translation_mode = mode;
+   n_mode_switches++;
+   unchain_all();
+   invalidateFastCache();
+   init_unredir_tt_tc();
+}
+
+UInt VG_(get_translation_mode) ( void )
+{
+   return translation_mode;
+}
+
 /*------------------------------------------------------------*/
 /*--- AUXILIARY: the unredirected TT/TC                    ---*/
 /*------------------------------------------------------------*/
@@ -2499,9 +2923,18 @@ static void unredir_discard_translations( Addr guest_start, ULong range )
 /*--- Initialisation.                                      ---*/
 /*------------------------------------------------------------*/
 
+/* The memory used by each sector, once allocated. */
+static ULong sector_szB ( void )
+{
+   return 8 * (ULong)tc_sector_szQ
+          + N_TTES_PER_SECTOR * (sizeof(TTEntryC) + sizeof(TTEntryH))
+          + N_HTTES_PER_SECTOR * sizeof(TTEno);
+}
+
 void VG_(init_tt_tc) ( void )
 {
    Int i, avg_codeszQ;
+   ULong max_sectors;
 
    vg_assert(!init_done);
    init_done = True;
@@ -2592,6 +3025,17 @@ void VG_(init_tt_tc) ( void )
    vg_assert(n_sectors >= MIN_N_SECTORS);
    vg_assert(n_sectors <= MAX_N_SECTORS);
 
+   /* And how many there may be later. */
+   initial_n_sectors = n_sectors;
+   max_sectors = VG_(clo_max_transtab_size) == 0
+                 ? 2 * (ULong)n_sectors
+                 : ((ULong)VG_(clo_max_transtab_size) << 20) / sector_szB();
+   if (max_sectors > MAX_N_SECTORS)
+      max_sectors = MAX_N_SECTORS;
+   if (max_sectors < n_sectors)
+      max_sectors = n_sectors;
+   max_n_sectors = max_sectors;
+
    /* Initialise the sectors, even the ones we aren't going to use.
       Set all fields to zero. */
    youngest_sector = 0;
@@ -2640,6 +3084,9 @@ void VG_(init_tt_tc) ( void )
          (int)(N_HTTES_PER_SECTOR * sizeof(TTEno)),
          (int)(n_sectors * N_HTTES_PER_SECTOR * sizeof(TTEno)),
          N_HTTES_PER_SECTOR, SECTOR_TT_LIMIT_PERCENT);
+      VG_(message)(Vg_DebugMsg,
+         "TT/TC: may grow to %d sectors = %'llu total bytes\n",
+         max_n_sectors, max_n_sectors * sector_szB());
    }
 
    if (0) {
@@ -2664,6 +3111,11 @@ static Double safe_idiv( ULong a, ULong b )
    return (b == 0 ? 0 : (Double)a / (Double)b);
 }
 
+ULong VG_(get_sectors_recycled) ( void )
+{
+   return n_sectors_recycled;
+}
+
 UInt VG_(get_bbs_translated) ( void )
 {
    return n_in_count;
@@ -2698,6 +3150,10 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
+   if (n_mode_switches > 0)
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: mode switches %'llu\n", n_mode_switches );
+   VG_(print_tt_tc_sector_stats)(False);
 
    if (DEBUG_TRANSTAB) {
       VG_(printf)("\n");
@@ -2710,6 +3166,44 @@ void VG_(print_tt_tc_stats) ( void )
    }
 }
 
+void VG_(print_tt_tc_sector_stats) ( Bool brief )
+{
+   if (brief && n_sectors_recycled == 0)
+      return;
+
+   VG_(message)(Vg_DebugMsg,
+                " transtab: %'llu sectors recycled, dumping %'llu "
+                "translations, %'llu (%.1f%%) of them made again\n",
+                n_sectors_recycled, n_dump_count, n_retranslated,
+                100.0 * safe_idiv(n_retranslated, n_dump_count));
+   VG_(message)(Vg_DebugMsg,
+                " transtab: %d sectors (%d at start, %d at most), "
+                "grown %'llu times\n",
+                n_sectors, initial_n_sectors, max_n_sectors,
+                n_sector_growths);
+   if (n_churn_at_max > 0)
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: churning at the size limit %'llu times, "
+                   "see --max-transtab-size\n", n_churn_at_max);
+   if (VG_(clo_keep_hot_translations) > 0)
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: %'llu hot translations kept when "
+                   "recycling\n", n_hot_kept);
+   if (brief)
+      return;
+
+   for (SECno sno = 0; sno < n_sectors; sno++) {
+      const Sector* sec = &sectors[sno];
+      if (sec->tc == NULL)
+         continue;
+      VG_(message)(Vg_DebugMsg,
+                   " transtab:   sector %2d: %6d in use, recycled %'u times, "
+                   "kept %'llu, dumped %'llu, %'llu made again\n",
+                   sno, sec->tt_n_inuse, sec->n_recycled, sec->n_kept,
+                   sec->n_dumped, sec->n_retranslated);
+   }
+}
+
 /*------------------------------------------------------------*/
 /*--- Printing out of profiling results.                   ---*/
 /*------------------------------------------------------------*/
@@ -40,6 +40,9 @@
 /* Initialise the entire module.  Must be called first of all. */
 extern void VG_(di_initialise) ( void );
 
+/* Show how much use was made of --debuginfo-cache. */
+extern void VG_(print_debuginfo_cache_stats) ( void );
+
 /* LINUX: Notify the debuginfo system about a new mapping, or the
    disappearance of such, or a permissions change on an existing
    mapping.  This is the way new debug information gets loaded.  If
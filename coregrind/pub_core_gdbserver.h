@@ -47,6 +47,10 @@ void VG_(gdbserver_prerun_action) (ThreadId tid);
 // i.e. VG_(gdbserver_prerun_action) was called.
 Bool VG_(gdbserver_init_done) (void);
 
+// True if gdbserver may instrument translations made now: when single
+// stepping, with breakpoints or watchpoints set, or with --vgdb=full.
+Bool VG_(gdbserver_instrumenting) (void);
+
 // True if gdbserver should stop execution for the specified stop at reason
 Bool VG_(gdbserver_stop_at) (VgdbStopAt stopat);
 
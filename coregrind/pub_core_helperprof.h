@@ -0,0 +1,54 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Profiling the helpers called by instrumented code.          ---*/
+/*---                                        pub_core_helperprof.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_HELPERPROF_H
+#define __PUB_CORE_HELPERPROF_H
+
+//--------------------------------------------------------------------
+// PURPOSE: With --profile-helpers, count the calls made by the
+// generated code to each dirty helper -- the tool's, and those the
+// core adds -- and, with --profile-helpers=cycles, time a sample of
+// them, so as to show where the cost of instrumentation goes.
+//--------------------------------------------------------------------
+
+#include "pub_core_basics.h"   // VG_ macro
+#include "libvex_ir.h"         // IRSB
+
+/* The last instrumentation pass: add the counting (and timing) of the
+   dirty helper calls in sb, which it returns. */
+extern IRSB* VG_(helperprof_instrument) ( IRSB* sb );
+
+/* Print the helpers, ranked by calls (or estimated cycles), and zero
+   the counts so that another call shows only what was done since.
+   ecs_done == 0 is taken to mean this is a run-end profile, as for
+   VG_(get_and_show_SB_profile). */
+extern void VG_(helperprof_show) ( ULong ecs_done );
+
+#endif   // __PUB_CORE_HELPERPROF_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                    pub_core_helperprof.h ---*/
+/*--------------------------------------------------------------------*/
@@ -80,6 +80,12 @@ extern HChar **VG_(env_clone)    ( HChar **env_clone );
 extern Int  VG_(getgroups)( Int size, UInt* list );
 extern Int  VG_(ptrace)( Int request, Int pid, void *addr, void *data );
 
+// A VG_(fork) whose child does not signal its parent when it exits
+extern Int  VG_(fork_quiet) ( void );
+
+// As VG_(read_millisecond_timer), in microseconds
+extern ULong VG_(read_microsecond_timer) ( void );
+
 // atfork
 extern void VG_(do_atfork_pre)    ( ThreadId tid );
 extern void VG_(do_atfork_parent) ( ThreadId tid );
@@ -131,6 +131,24 @@ extern Bool  VG_(clo_child_silent_after_fork);
 extern const HChar *VG_(clo_log_fname_unexpanded);
 extern const HChar *VG_(clo_xml_fname_unexpanded);
 
+/* If the user specified --record-syscalls=STR or --replay-syscalls=STR,
+   these hold STR (the former before expansion).  See m_replay.c. */
+extern const HChar *VG_(clo_record_fname);
+extern const HChar *VG_(clo_replay_fname);
+
+/* If the user specified --translation-cache=DIR, this holds DIR.  See
+   m_transcache.c. */
+extern const HChar *VG_(clo_translation_cache);
+
+/* If the user specified --debuginfo-cache=DIR, this holds DIR.  See
+   m_debuginfo/dicache.c. */
+extern const HChar *VG_(clo_debuginfo_cache);
+
+/* How many helper processes may read objects into the debuginfo cache
+   at once, while the client runs on.  Default: 0, read them in
+   Valgrind itself. */
+extern Int VG_(clo_debuginfo_helpers);
+
 /* Add timestamps to log messages?  default: NO */
 extern Bool  VG_(clo_time_stamp);
 
@@ -176,6 +194,11 @@ extern UChar VG_(clo_profyle_flags);
    this-many back edges (event checks).  default: zero (== show
    profiling results only at the end of the run. */
 extern ULong VG_(clo_profyle_interval);
+/* DEBUG: profile the dirty helpers called by the generated code?
+   0: no, 1: count their calls, 2: also time a sample of the calls.
+   Shown at the end of the run, or every --profile-interval event
+   checks.  default: 0 */
+extern UInt  VG_(clo_profile_helpers);
 
 /* DEBUG: if tracing codegen, be quiet until after this bb */
 extern Int   VG_(clo_trace_notbelow);
@@ -248,6 +271,10 @@ extern Bool VG_(clo_sym_offsets);
 extern Bool VG_(clo_read_inline_info);
 /* Read DWARF3 variable info even if tool doesn't ask for it? */
 extern Bool VG_(clo_read_var_info);
+/* Read an object's debug info only when first asked about it, rather
+   than when it is mapped?  Default: NO, except for tools that call
+   VG_(needs_no_debuginfo). */
+extern Bool VG_(clo_lazy_debuginfo);
 /* Which prefix to strip from full source file paths, if any. */
 extern const HChar* VG_(clo_prefix_to_strip);
 
@@ -326,6 +353,16 @@ extern Int VG_(clo_merge_recursive_frames);
 /* Max number of sectors that will be used by the translation code cache. */
 extern UInt VG_(clo_num_transtab_sectors);
 
+/* Memory budget in MB up to which sectors are added to the translation
+   code cache when the code run does not fit in it.  0 means twice the
+   size given by VG_(clo_num_transtab_sectors). */
+extern UInt VG_(clo_max_transtab_size);
+
+/* When a translation code cache sector is recycled, translations run
+   at least this many times since they were made are kept in it.  0
+   means none are. */
+extern UInt VG_(clo_keep_hot_translations);
+
 /* Average size of a transtab code entry. 0 means to use the tool
    provided default. */
 extern UInt VG_(clo_avg_transtab_entry_size);
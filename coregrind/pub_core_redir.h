@@ -73,6 +73,10 @@ extern void VG_(redir_initialise)( void );
 /* Notify the module of a new target for an indirect function. */
 extern void VG_(redir_add_ifunc_target)( Addr old_from, Addr new_from );
 
+/* Must m_debuginfo read the symbols of each object as soon as it is
+   mapped, rather than when they are first asked about? */
+extern Bool VG_(redir_needs_all_symbols)( void );
+
 //--------------------------------------------------------------------
 // Queries
 //--------------------------------------------------------------------
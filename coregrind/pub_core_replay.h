@@ -0,0 +1,103 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Syscall, signal and schedule record/replay.                  ---*/
+/*---                                            pub_core_replay.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_REPLAY_H
+#define __PUB_CORE_REPLAY_H
+
+//--------------------------------------------------------------------
+// PURPOSE: With --record-syscalls=FILE, log the results of syscalls
+// (and the memory they wrote), the points at which async signals were
+// delivered and the order in which threads took the big lock.  With
+// --replay-syscalls=FILE, feed a log back so that the client executes
+// the same instruction stream again, without doing the I/O and sleeps
+// a second time.  Events are positioned by the scheduler's count of
+// blocks executed.
+//--------------------------------------------------------------------
+
+#include "pub_core_basics.h"      // VG_ macro
+#include "pub_core_vki.h"         // vki_siginfo_t
+
+typedef
+   enum { ReplayOff, ReplayRecord, ReplayReplay }
+   ReplayMode;
+
+/* Current mode.  Replay drops back to ReplayOff if the client stops
+   following the log. */
+extern ReplayMode VG_(replay_mode);
+
+/* Open the log named by --record-syscalls or --replay-syscalls.
+   Called once the command line has been processed. */
+extern void VG_(replay_init) ( void );
+
+/* Flush and close the log at exit. */
+extern void VG_(replay_shutdown) ( void );
+
+/* What VG_(client_syscall) should do with a syscall about to be handed
+   to the kernel. */
+typedef
+   enum {
+      ReplayRun,       // do it for real
+      ReplayResult,    // don't; the logged result is in *res and any
+                       // memory it wrote has been restored
+      ReplayRestart    // don't; it was interrupted and restarted
+   }
+   ReplayAction;
+
+extern ReplayAction VG_(replay_pre_syscall) ( ThreadId tid, Word sysno,
+                                              /*OUT*/SysRes* res );
+
+/* A syscall handed to the kernel finished with kernel result 'res',
+   after its post-handler ran. */
+extern void VG_(replay_post_syscall) ( ThreadId tid, Word sysno, SysRes res );
+
+/* A syscall handed to the kernel was interrupted and will be
+   restarted. */
+extern void VG_(replay_syscall_restarted) ( ThreadId tid );
+
+/* A post-handler reported a client memory write (POST_MEM_WRITE). */
+extern void VG_(record_mem_write) ( ThreadId tid, Addr a, SizeT len );
+
+/* An async signal is about to be delivered to tid. */
+extern void VG_(record_signal) ( ThreadId tid, const vki_siginfo_t* info );
+
+/* Replay: if the log delivers a signal to tid at this point, copy it
+   to *info, consume it and return True. */
+extern Bool VG_(replay_signal) ( ThreadId tid, /*OUT*/vki_siginfo_t* info );
+
+/* Replay: how many of the 'max' blocks tid may run before the log
+   delivers its next signal.  0 means one is due now. */
+extern Int VG_(replay_slice) ( ThreadId tid, Int max );
+
+/* tid has just taken the big lock.  In replay, returns False if the
+   log gives the lock to another thread at this point; the caller must
+   then let go of the lock and try again. */
+extern Bool VG_(replay_acquire) ( ThreadId tid );
+
+#endif   // __PUB_CORE_REPLAY_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
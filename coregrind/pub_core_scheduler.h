@@ -110,6 +110,9 @@ extern void VG_(force_vgdb_poll) ( void );
 /* Stats ... */
 extern void VG_(print_scheduler_stats) ( void );
 
+/* Number of blocks run so far, by all threads. */
+extern ULong VG_(get_bbs_done) ( void );
+
 /* If False, a fault is Valgrind-internal (ie, a bug) */
 extern Bool VG_(in_generated_code);
 
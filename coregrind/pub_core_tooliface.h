@@ -90,9 +90,11 @@ typedef
       Bool print_stats;
       Bool info_location;
       Bool var_info;
+      Bool no_debuginfo;
       Bool malloc_replacement;
       Bool xml_output;
       Bool final_IR_tidy_pass;
+      Bool persistent_translations;
    } 
    VgNeeds;
 
@@ -172,6 +174,9 @@ typedef struct {
    // VG_(needs).final_IR_tidy_pass
    IRSB* (*tool_final_IR_tidy_pass)  (IRSB*);
 
+   // VG_(needs).persistent_translations
+   Bool  (*tool_option_is_keyed)     (const HChar*);
+
    // VG_(needs).xml_output
    // (none)
 
@@ -0,0 +1,78 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Translations kept on disk between runs.                     ---*/
+/*---                                        pub_core_transcache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_TRANSCACHE_H
+#define __PUB_CORE_TRANSCACHE_H
+
+//--------------------------------------------------------------------
+// PURPOSE: With --translation-cache=DIR, keep the instrumented host
+// code of blocks translated from file mappings in DIR, and reuse it
+// in later runs instead of calling VEX again.  There is one file per
+// mapped object, named after a hash of everything its translations
+// depend on: the tool, the command line, the Valgrind build, the
+// host's capabilities, the object's identity (name, device, inode,
+// size, modification time) and the address it is mapped at.  A file
+// is read the first time a block of its object is translated.
+//
+// Only tools that call VG_(needs_persistent_translations) can use it.
+//--------------------------------------------------------------------
+
+#include "pub_core_basics.h"      // VG_ macro
+#include "pub_core_aspacemgr.h"   // NSegment
+#include "libvex.h"               // VexGuestExtents
+
+/* True if --translation-cache is in effect. */
+extern Bool VG_(transcache_active);
+
+/* Check --translation-cache.  Called once the command line has been
+   processed. */
+extern void VG_(transcache_init) ( void );
+
+/* Find a kept translation of the unredirected block at 'entry', in
+   segment 'seg', for the current translation mode.  On success the
+   code stays valid until the next call to this module. */
+extern Bool VG_(transcache_lookup) ( NSegment const* seg, Addr entry,
+                                     /*OUT*/VexGuestExtents* vge,
+                                     /*OUT*/const UChar** code,
+                                     /*OUT*/UInt* code_len,
+                                     /*OUT*/Bool* is_self_checking,
+                                     /*OUT*/UInt* n_guest_instrs );
+
+/* Keep a new, unchained translation of the unredirected block at
+   'entry', in segment 'seg', for the current translation mode. */
+extern void VG_(transcache_add) ( NSegment const* seg, Addr entry,
+                                  const VexGuestExtents* vge,
+                                  const UChar* code, UInt code_len,
+                                  Bool is_self_checking,
+                                  UInt n_guest_instrs );
+
+extern void VG_(print_transcache_stats) ( void );
+
+#endif   // __PUB_CORE_TRANSCACHE_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
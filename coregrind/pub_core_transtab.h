@@ -144,7 +144,10 @@ static inline Bool VG_(lookupInFastCache)( /*MB_OUT*/Addr* host, Addr guest )
 /* Initialises the TC, using VG_(clo_num_transtab_sectors)
    and VG_(clo_avg_transtab_entry_size).
    VG_(clo_num_transtab_sectors) must be >= MIN_N_SECTORS
-   and <= MAX_N_SECTORS. */
+   and <= MAX_N_SECTORS.  When, between two recyclings of the first
+   sector, many of the translations made are of blocks that recycling
+   threw away, sectors are added, up to VG_(clo_max_transtab_size)
+   and MAX_N_SECTORS. */
 extern void VG_(init_tt_tc)       ( void );
 
 
@@ -201,6 +204,16 @@ extern void VG_(discard_translations) ( Addr  start, ULong range,
 
 extern void VG_(print_tt_tc_stats) ( void );
 
+/* Shows how often the sectors were recycled, how many of the
+   translations thrown away were made again, and how the number of
+   sectors grew.  With 'brief', only a summary, and nothing if no
+   sector was recycled. */
+extern void VG_(print_tt_tc_sector_stats) ( Bool brief );
+
+/* The number of sectors recycled so far.  A host code address found
+   before this changes may since hold another translation. */
+extern ULong VG_(get_sectors_recycled) ( void );
+
 extern UInt VG_(get_bbs_translated) ( void );
 extern UInt VG_(get_bbs_discarded_or_dumped) ( void );
 
@@ -0,0 +1,362 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Expands cstracer traces into plain ChampSim traces           ---*/
+/*---                                                  ct_expand.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   Copyright (C) 2020 Siddharth Jayashankar
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+// Usage: ct_expand [--framed] <trace|-> <output>
+//
+// Reads a trace written by cstracer with a CSTRACE header (for example
+// with --compress-loops=yes) and writes the equivalent headerless record
+// stream that ChampSim reads.  Traces without a header are copied as is.
+//
+// With --framed the input is the framed stream that cstracer sends to
+// --trace-file=|command or unix:/path targets, so for example
+//
+//   --trace-file='|ct_expand --framed - trace.champsim'
+//
+// expands the trace while it is being generated.
+//
+// Traces written with --mem-values=image are turned into the usual
+// format with a cache line value per memory operand, which is rebuilt
+// from the page images and stores in the trace.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define CT_MEMCPY memcpy
+#include "ct_record.h"
+
+#define HISTORY_SIZE 128
+#define IMAGE_HASH_SIZE 65536
+
+typedef struct {
+	ct_layout_t lay;
+	uint8_t bytes[CT_MAX_RECORD];
+} record_t;
+
+/* The last HISTORY_SIZE literal records, which repeat records refer to */
+static record_t history[HISTORY_SIZE];
+static unsigned int hist_next = 0;
+
+static FILE *in, *out;
+static uint32_t flags;
+
+/* Frame state of a --framed input */
+static int framed, frame_end;
+static uint32_t frame_left, frame_seq;
+
+/* The reader's copy of the traced memory, one node per imaged page */
+typedef struct _page {
+	struct _page *next;
+	uint64_t pn;
+	uint8_t data[CT_PAGE_SIZE];
+} page_t;
+
+static page_t *image[IMAGE_HASH_SIZE];
+
+static unsigned long long n_records = 0;
+
+static void die(const char *msg) {
+	fprintf(stderr, "ct_expand: %s\n", msg);
+	exit(1);
+}
+
+/* Reads up to len bytes of the trace, stripping the frame headers of a
+ * framed input.  Returns less than len only at the end of the trace. */
+static size_t read_in(void *p, size_t len) {
+	uint32_t frame[2];
+	size_t got = 0, n;
+
+	if (!framed)
+		return fread(p, 1, len, in);
+	while (got < len) {
+		if (frame_left == 0) {
+			if (frame_end)
+				break;
+			if (fread(frame, 1, sizeof(frame), in) != sizeof(frame))
+				die("stream cut short");
+			if (frame[1] != frame_seq++)
+				die("frame out of sequence");
+			if (frame[0] == 0) {
+				frame_end = 1;
+				break;
+			}
+			frame_left = frame[0];
+		}
+		n = len - got < frame_left ? len - got : frame_left;
+		if (fread((uint8_t *)p + got, 1, n, in) != n)
+			die("stream cut short");
+		got += n;
+		frame_left -= n;
+	}
+	return got;
+}
+
+static void read_exact(void *p, size_t len) {
+	if (read_in(p, len) != len)
+		die("truncated trace");
+}
+
+static void write_exact(const void *p, size_t len) {
+	if (fwrite(p, 1, len, out) != len)
+		die("write error");
+}
+
+static page_t *find_page(uint64_t addr, int create) {
+	uint64_t pn = addr >> CT_PAGE_POW;
+	page_t **head = &image[pn % IMAGE_HASH_SIZE];
+	page_t *p;
+	for (p = *head; p; p = p->next)
+		if (p->pn == pn)
+			return p;
+	if (!create)
+		return NULL;
+	p = calloc(1, sizeof(page_t));
+	if (!p)
+		die("out of memory");
+	p->pn	= pn;
+	p->next = *head;
+	*head	= p;
+	return p;
+}
+
+static void image_write(uint64_t addr, const uint8_t *data, size_t len) {
+	while (len > 0) {
+		page_t *p	= find_page(addr, 1);
+		size_t off	= addr & (CT_PAGE_SIZE - 1);
+		size_t n	= CT_PAGE_SIZE - off < len ? CT_PAGE_SIZE - off : len;
+		memcpy(p->data + off, data, n);
+		addr += n;
+		data += n;
+		len -= n;
+	}
+}
+
+/* Lines of pages that were never imaged read as zeroes */
+static void image_line(uint64_t addr, uint8_t *line) {
+	uint64_t base = (addr >> CACHE_POW) << CACHE_POW;
+	page_t *p	  = find_page(base, 0);
+	if (p)
+		memcpy(line, p->data + (base & (CT_PAGE_SIZE - 1)), CACHE_LINE_SIZE);
+	else
+		memset(line, 0, CACHE_LINE_SIZE);
+}
+
+/* Reads the rest of an instruction record whose key has been read, as
+ * far as ct_decode_record needs at each step */
+static void read_record(record_t *r, uint16_t key) {
+	uint32_t have = 2;
+	int n;
+
+	memcpy(r->bytes, &key, 2);
+	while ((n = ct_decode_record(r->bytes, have, flags, &r->lay)) == 0) {
+		read_exact(r->bytes + have, r->lay.len - have);
+		have = r->lay.len;
+	}
+	if (n < 0)
+		die("store too large");
+}
+
+/* Writes an instruction record, rebuilding its line values from the
+ * memory image if need be.  The source lines are read before the stores
+ * of the instruction are applied, the destination lines after. */
+static void emit_record(const record_t *r) {
+	uint8_t buf[CT_MAX_RECORD];
+	uint8_t src_lines[CT_MAX_ADDRS][CACHE_LINE_SIZE];
+	uint64_t dst_addr[CT_MAX_ADDRS];
+	uint16_t key;
+	unsigned int n_dreg, n_dmem, n_sreg, n_smem, i, pos, len;
+
+	n_records++;
+	if (!(flags & CT_HDR_IMAGE)) {
+		write_exact(r->bytes, r->lay.len);
+		return;
+	}
+
+	memcpy(&key, r->bytes, 2);
+	n_dreg = ct_popcount(key & DEST_REG_BITS);
+	n_dmem = ct_popcount(key & DEST_MEM_BITS);
+	n_sreg = ct_popcount(key & SOURCE_REG_BITS);
+	n_smem = ct_popcount(key & SOURCE_MEM_BITS);
+
+	for (i = 0; i < n_smem; i++) {
+		uint64_t a;
+		memcpy(&a, r->bytes + r->lay.aoff[n_dmem + i], 8);
+		image_line(a, src_lines[i]);
+	}
+	for (i = 0; i < n_dmem; i++) {
+		uint16_t size;
+		pos = r->lay.aoff[i];
+		memcpy(&dst_addr[i], r->bytes + pos, 8);
+		memcpy(&size, r->bytes + pos + 8, 2);
+		image_write(dst_addr[i], r->bytes + pos + 10, size);
+	}
+
+	pos = 2 + 8 + 4 * n_dreg;
+	memcpy(buf, r->bytes, pos);
+	len = pos;
+	for (i = 0; i < n_dmem; i++) {
+		memcpy(buf + len, &dst_addr[i], 8);
+		image_line(dst_addr[i], buf + len + 8);
+		len += 8 + CACHE_LINE_SIZE;
+	}
+	if (n_dmem) {
+		uint16_t size;
+		pos = r->lay.aoff[n_dmem - 1];
+		memcpy(&size, r->bytes + pos + 8, 2);
+		pos += 10 + size;
+	}
+	memcpy(buf + len, r->bytes + pos, 4 * n_sreg);
+	len += 4 * n_sreg;
+	for (i = 0; i < n_smem; i++) {
+		memcpy(buf + len, r->bytes + r->lay.aoff[n_dmem + i], 8);
+		memcpy(buf + len + 8, src_lines[i], CACHE_LINE_SIZE);
+		len += 8 + CACHE_LINE_SIZE;
+	}
+	write_exact(buf, len);
+}
+
+static void read_memory_record(uint16_t key) {
+	uint8_t data[CT_PAGE_SIZE];
+	uint64_t addr;
+	uint32_t len;
+
+	read_exact(&addr, 8);
+	if (key == CT_KEY_PAGE) {
+		len = CT_PAGE_SIZE;
+	} else {
+		read_exact(&len, 4);
+	}
+	while (len > 0) {
+		uint32_t n = len < sizeof(data) ? len : sizeof(data);
+		read_exact(data, n);
+		image_write(addr, data, n);
+		addr += n;
+		len -= n;
+	}
+}
+
+static void expand_repeat(void) {
+	uint16_t n_insts, n_strides;
+	uint32_t count, k, i, j, s;
+	int64_t *strides;
+	record_t rec;
+
+	read_exact(&n_insts, 2);
+	read_exact(&count, 4);
+	read_exact(&n_strides, 2);
+	if (n_insts == 0 || n_insts > HISTORY_SIZE || n_insts > hist_next)
+		die("repeat record without a matching block");
+
+	strides = malloc(n_strides * sizeof(int64_t) + 1);
+	if (!strides)
+		die("out of memory");
+	read_exact(strides, n_strides * sizeof(int64_t));
+
+	for (k = 1; k <= count; k++) {
+		s = 0;
+		for (i = 0; i < n_insts; i++) {
+			rec = history[(hist_next - n_insts + i) % HISTORY_SIZE];
+			for (j = 0; j < rec.lay.n_addrs; j++, s++) {
+				uint64_t a;
+				if (s >= n_strides)
+					die("repeat record has too few strides");
+				memcpy(&a, rec.bytes + rec.lay.aoff[j], 8);
+				a += (uint64_t)strides[s] * k;
+				memcpy(rec.bytes + rec.lay.aoff[j], &a, 8);
+			}
+			emit_record(&rec);
+		}
+	}
+	free(strides);
+}
+
+static void copy_plain(void) {
+	char buf[1 << 16];
+	size_t n;
+	while ((n = read_in(buf, sizeof(buf))) > 0)
+		write_exact(buf, n);
+}
+
+int main(int argc, char **argv) {
+	trace_header_t hdr;
+	uint16_t key;
+	size_t n;
+
+	if (argc > 1 && strcmp(argv[1], "--framed") == 0) {
+		framed = 1;
+		argc--;
+		argv++;
+	}
+	if (argc != 3) {
+		fprintf(stderr, "usage: ct_expand [--framed] <trace|-> <output>\n");
+		return 1;
+	}
+	in = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "rb");
+	if (!in)
+		die("cannot open input");
+	out = fopen(argv[2], "wb");
+	if (!out)
+		die("cannot open output");
+
+	n = read_in(&hdr, sizeof(hdr));
+	if (n != sizeof(hdr) ||
+		memcmp(hdr.magic, CT_HDR_MAGIC, sizeof(CT_HDR_MAGIC)) != 0) {
+		write_exact(&hdr, n);
+		copy_plain();
+		if (fclose(out) != 0)
+			die("write error");
+		return 0;
+	}
+	flags = hdr.flags;
+
+	while (read_in(&key, 2) == 2) {
+		if (key & CT_KEY_REPEAT) {
+			if (key == CT_KEY_REPEAT)
+				expand_repeat();
+			else if ((flags & CT_HDR_IMAGE) &&
+					 (key == CT_KEY_PAGE || key == CT_KEY_MEMWRITE))
+				read_memory_record(key);
+			else
+				die("unknown control record");
+			continue;
+		}
+		record_t *r = &history[hist_next % HISTORY_SIZE];
+		read_record(r, key);
+		hist_next++;
+		emit_record(r);
+	}
+
+	if (fclose(out) != 0)
+		die("write error");
+	fprintf(stderr, "ct_expand: %llu records\n", n_records);
+	return 0;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                              ct_expand.c ---*/
+/*--------------------------------------------------------------------*/
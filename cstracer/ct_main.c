@@ -68,10 +68,6 @@
 //
 
 
-// undef this to generate traces for the normal form of ChampSim
-#define TRACE_MEM_VALUES 1
-
-
 // Set to 1 to for for debugging
 #define DEBUG_CT 0
 #define PRINT_INST 0
@@ -80,15 +76,22 @@
 
 #include "pub_tool_basics.h"
 #include "pub_tool_debuginfo.h"
+#include "pub_tool_gdbserver.h" // VG_(print_all_stats)
+#include "pub_tool_hashtable.h"
+#include "pub_tool_icount.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcfile.h"
 #include "pub_tool_libcproc.h"
 #include "pub_tool_libcprint.h"
 #include "pub_tool_machine.h" // VG_(fnptr_to_fnentry)
+#include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
 #include "pub_tool_threadstate.h" // VG_(get_running_tid)()
 #include "pub_tool_tooliface.h"
+#include "pub_tool_transtab.h" // VG_(set_translation_mode)
+#include "libvex_guest_amd64.h"
+#include "libvex_guest_arm64.h"
 
 #if defined(VGP_arm64_linux)
 #include "arm64regs.h" //contains the registers
@@ -100,12 +103,15 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#define CT_MEMCPY VG_(memcpy)
+#include "ct_record.h"
+
 
 /*------------------------------------------------------------*/
 /*--- Command line options                                 ---*/
 /*------------------------------------------------------------*/
 
-// Trace file name --trace-file=tracefile
+// Trace file name --trace-file=tracefile, |command or unix:/path
 static const HChar *t_fname = "tracefile";
 
 // Num of Instructions to skip --skip=
@@ -119,6 +125,30 @@ static unsigned long long int heartbeat = 100000000;
 
 static Bool exit_after_tracing = False;
 
+// Fold repeated superblocks into repeat records --compress-loops=
+static Bool compress_loops = False;
+
+// Log page images and stored bytes instead of lines --mem-values=image
+static Bool mem_image = False;
+
+// Record format --format=champsim|champsim-values|cvp
+typedef enum {
+	FMT_CHAMPSIM,		 // ChampSim records without memory values
+	FMT_CHAMPSIM_VALUES, // ChampSim records with memory values
+	FMT_CVP				 // CVP-1 records with register values
+} trace_format_t;
+
+static trace_format_t trace_format = FMT_CHAMPSIM_VALUES;
+
+// Trace --trace= instructions of each new phase --phases=yes|no
+static Bool phases = False;
+
+// Instructions per phase signature --phase-interval=
+static unsigned long long int phase_interval = 10000000;
+
+// Largest signature distance, in percent, within a phase --phase-threshold=
+static UInt phase_threshold = 20;
+
 static Bool ct_process_cmd_line_option(const HChar *arg) {
 	if
 		VG_STR_CLO(arg, "--trace-file", t_fname) {}
@@ -130,6 +160,25 @@ static Bool ct_process_cmd_line_option(const HChar *arg) {
 		VG_INT_CLO(arg, "--heartbeat", heartbeat) {}
 	else if
 		VG_BOOL_CLO(arg, "--exit-after", exit_after_tracing) {}
+	else if
+		VG_BOOL_CLO(arg, "--compress-loops", compress_loops) {}
+	else if
+		VG_XACT_CLO(arg, "--mem-values=lines", mem_image, False) {}
+	else if
+		VG_XACT_CLO(arg, "--mem-values=image", mem_image, True) {}
+	else if
+		VG_XACT_CLO(arg, "--format=champsim", trace_format, FMT_CHAMPSIM) {}
+	else if
+		VG_XACT_CLO(arg, "--format=champsim-values", trace_format,
+					FMT_CHAMPSIM_VALUES) {}
+	else if
+		VG_XACT_CLO(arg, "--format=cvp", trace_format, FMT_CVP) {}
+	else if
+		VG_BOOL_CLO(arg, "--phases", phases) {}
+	else if
+		VG_INT_CLO(arg, "--phase-interval", phase_interval) {}
+	else if
+		VG_INT_CLO(arg, "--phase-threshold", phase_threshold) {}
 	else
 		return False;
 
@@ -140,14 +189,36 @@ static Bool ct_process_cmd_line_option(const HChar *arg) {
 
 static void ct_print_usage(void) {
 	VG_(printf)
-	("    --trace-file=<file>        Trace File Name\n"
+	("    --trace-file=<file>        Trace File Name, |command or unix:/path\n"
 	 "    --trace=<num>        	Number of Instructions to Trace\n"
 	 "    --skip=<num>        	Number of Instructions to Skip\n"
-	 "    --exit-after=<yes|no> Exit after tracing completes\n");
+	 "    --exit-after=<yes|no> Exit after tracing completes\n"
+	 "    --compress-loops=<yes|no> Emit repeat records for loops [no]\n"
+	 "    --mem-values=<lines|image> Copy lines or log page images and stores\n"
+	 "    --format=<champsim|champsim-values|cvp> Record format [champsim-values]\n"
+	 "    --phases=<yes|no>    	Trace --trace instructions of each new phase [no]\n"
+	 "    --phase-interval=<num> Instructions per phase signature [10000000]\n"
+	 "    --phase-threshold=<num> Percent difference within a phase [20]\n");
 }
 
 static void ct_print_debug_usage(void) { VG_(printf)(" (none)\n"); }
 
+/* Blocks are instrumented according to the format options, --phases and
+ * trace_mode, which is the translation mode; the rest only say where the
+ * output goes and when tracing is switched on and off.  So translations
+ * kept by --translation-cache serve runs that differ in those. */
+static Bool ct_option_is_keyed(const HChar *arg) {
+	static const HChar *const unkeyed[] = {
+		"--trace-file=", "--skip=", "--trace=", "--heartbeat=", "--exit-after=",
+		"--phase-interval=", "--phase-threshold="};
+	UInt i;
+
+	for (i = 0; i < sizeof(unkeyed) / sizeof(unkeyed[0]); i++)
+		if (VG_(strncmp)(arg, unkeyed[i], VG_(strlen)(unkeyed[i])) == 0)
+			return False;
+	return True;
+}
+
 /*------------------------------------------------------------*/
 /*--- Tracing                                              ---*/
 /*------------------------------------------------------------*/
@@ -155,52 +226,455 @@ static void ct_print_debug_usage(void) { VG_(printf)(" (none)\n"); }
 static Bool tracing	= False;
 static Bool tracing_done = False;
 
+/* Translations made while trace_mode is set carry the tracing helpers,
+ * the others only count instructions (see set_trace_mode). */
+static Bool trace_mode = False;
+
+// VG_(icount_now)() at the last event
 static unsigned long long int instructions = 0;
 static unsigned long long int instructions_ = 0;
 
+static UInt phase_cur = 0; // phase being traced with --phases=yes
+
 static int fd;
 static UInt pid;
 typedef IRExpr IRAtom;
 
-#define MAX_DSIZE 512
+/* The instruction being traced, see ct_record.h */
+static trace_instr_format_t inst;
+static trace_values_t vals;
+
+/*------------------------------------------------------------*/
+/*--- Trace output                                         ---*/
+/*------------------------------------------------------------*/
+
+/* Records are collected in out_buf and written out in large chunks
+ * instead of issuing one write per instruction. */
+#define OUT_BUF_SIZE (1 << 16)
+
+static uint8_t out_buf[OUT_BUF_SIZE];
+static UInt out_used = 0;
+
+/* With --trace-file=|command the trace is fed to the standard input of
+ * command, and with --trace-file=unix:/path it is sent to the UNIX socket
+ * at path.  Both are sockets, so a consumer that exits early does not
+ * kill the traced program with a SIGPIPE.  Such a
+ * stream is cut into frames, so that the consumer can tell a complete
+ * trace from one that was cut short:
+ *
+ *   len (4), seq (4), data (len)
+ *
+ * where seq counts the frames from 0, and it ends with a frame of length
+ * 0.  Writes block while the consumer is behind, which throttles the
+ * traced program instead of buffering without bound.  If the consumer
+ * goes away tracing stops. */
+static Bool out_stream = False;
+static Int consumer_pid = -1;
+static UInt out_seq		= 0;
+static Bool out_broken	= False;
+
+static Bool write_all(const void *p, UInt len) {
+	const uint8_t *b = p;
+	while (len > 0) {
+		Int n = out_stream ? VG_(write_socket)(fd, b, len)
+						   : VG_(write)(fd, b, len);
+		if (n <= 0)
+			return False;
+		b += n;
+		len -= n;
+	}
+	return True;
+}
+
+static void flush_out(void) {
+	Bool ok = True;
+	if (out_used == 0 || out_broken) {
+		out_used = 0;
+		return;
+	}
+	if (out_stream) {
+		uint32_t frame[2] = {out_used, out_seq++};
+		ok				  = write_all(frame, sizeof(frame));
+	}
+	if (!ok || !write_all(out_buf, out_used)) {
+		VG_(umsg)("cstracer: cannot write the trace, tracing stopped\n");
+		out_broken	 = True;
+		tracing		 = False;
+		tracing_done = True;
+	}
+	out_used = 0;
+}
+
+static void write_out(const void *p, UInt len) {
+	if (out_used + len > OUT_BUF_SIZE)
+		flush_out();
+	VG_(memcpy)(out_buf + out_used, p, len);
+	out_used += len;
+}
+
+/* A forked child must not write out the records its parent buffered,
+ * and does not trace at all into its parent's stream */
+static void ct_atfork_child(ThreadId tid) {
+	out_used = 0;
+	if (out_stream) {
+		tracing		 = False;
+		tracing_done = True;
+		consumer_pid = -1;
+	}
+}
+
+static void open_trace(HChar *name, SizeT name_len) {
+	if (t_fname[0] == '|') {
+		const HChar *argv[] = {"/bin/sh", "-c", t_fname + 1, NULL};
+		Int p[2], err;
+		VG_(snprintf)(name, name_len, "%s", t_fname);
+		err = VG_(socketpair)(VKI_AF_UNIX, VKI_SOCK_STREAM, 0, p);
+		if (err < 0) {
+			VG_(fmsg)("Cannot create a socket for --trace-file (errno %d)\n",
+					  -err);
+			VG_(exit)(1);
+		}
+		consumer_pid = VG_(fork)();
+		if (consumer_pid == 0) {
+			VG_(close)(p[1]);
+			VG_(dup2)(p[0], 0);
+			VG_(close)(p[0]);
+			VG_(execv)(argv[0], argv);
+			VG_(exit)(1);
+		}
+		if (consumer_pid < 0) {
+			VG_(fmsg)("Cannot start '%s' for --trace-file (errno %d)\n",
+					  t_fname + 1, -consumer_pid);
+			VG_(exit)(1);
+		}
+		VG_(close)(p[0]);
+		fd		   = p[1];
+		out_stream = True;
+	} else if (VG_(strncmp)(t_fname, "unix:", 5) == 0) {
+		VG_(snprintf)(name, name_len, "%s", t_fname);
+		fd = VG_(connect_via_unix_socket)(t_fname + 5);
+		if (fd < 0) {
+			VG_(fmsg)("Cannot connect to '%s' for --trace-file (errno %d)\n",
+					  t_fname + 5, -fd);
+			VG_(exit)(1);
+		}
+		out_stream = True;
+	} else {
+		if (phases)
+			VG_(snprintf)(name, name_len, "%s_%u.phase%u", t_fname, pid,
+						  phase_cur);
+		else
+			VG_(snprintf)(name, name_len, "%s_%u", t_fname, pid);
+		fd = VG_(fd_open)(name, VKI_O_WRONLY | VKI_O_TRUNC | VKI_O_CREAT, 00644);
+		tl_assert(fd != -1);
+	}
+}
 
-/* For ChampSim Traces*/
-#define NUM_INSTR_DESTINATIONS 2
-#define NUM_INSTR_SOURCES 4
-#define CACHE_POW 6
-#define CACHE_LINE_SIZE 64
+/* See ct_record.h for the header */
+static void write_header(void) {
+	trace_header_t hdr;
+	VG_(memset)(&hdr, 0, sizeof(hdr));
+	VG_(strcpy)(hdr.magic, CT_HDR_MAGIC);
+	hdr.version = CT_HDR_VERSION;
+	if (trace_format == FMT_CHAMPSIM_VALUES)
+		hdr.flags |= CT_HDR_VALUES;
+	if (compress_loops)
+		hdr.flags |= CT_HDR_LOOPS;
+	if (mem_image)
+		hdr.flags |= CT_HDR_IMAGE;
+	write_out(&hdr, sizeof(hdr));
+}
 
+/*------------------------------------------------------------*/
+/*--- Loop compression                                     ---*/
+/*------------------------------------------------------------*/
 
-#define INST_IS_BRANCH_MASK 0x2000U
-#define INST_BRANCH_TAKEN_MASK 0x1000U
-#define DEST_REG_MASK 0x400U
-#define DEST_MEM_MASK 0x100U
-#define SOURCE_REG_MASK 0x10U
-#define SOURCE_MEM_MASK 0x1U
+/* With --compress-loops=yes the records of each superblock are collected
+ * into a block.  A block that differs from the previous one only in its
+ * memory addresses, by the same stride for every iteration, is not
+ * written out.  When such a run ends a single repeat record is emitted
+ * instead:
+ *
+ *   key (2) = CT_KEY_REPEAT, n_insts (2), count (4), n_strides (2),
+ *   strides (8 * n_strides)
+ *
+ * The reader replays the last n_insts records count more times, adding
+ * strides[j] to the j-th memory address of the block on each iteration.
+ * A repeat record always directly follows the block it repeats. */
+
+#define LOOP_MAX_INSTS 128
+#define LOOP_MAX_ADDRS \
+	(LOOP_MAX_INSTS * (NUM_INSTR_DESTINATIONS + NUM_INSTR_SOURCES))
+#define LOOP_MAX_BYTES 32768
 
 typedef struct {
-	uint64_t ip; // instruction pointer (program counter) value
+	UInt n_insts;
+	UInt n_bytes;
+	UInt n_addrs;
+	UShort aoff[LOOP_MAX_ADDRS]; // offsets of the addresses in bytes
+	uint8_t bytes[LOOP_MAX_BYTES];
+} loop_block_t;
+
+static loop_block_t loop_blocks[2];
+static loop_block_t *blk_cur  = &loop_blocks[0];
+static loop_block_t *blk_last = &loop_blocks[1];
+static Bool blk_last_valid	  = False;
+
+static UInt rep_count = 0;
+static Long rep_stride[LOOP_MAX_ADDRS];
+
+static uint64_t blk_addr(const loop_block_t *b, UInt j) {
+	uint64_t a;
+	VG_(memcpy)(&a, b->bytes + b->aoff[j], 8);
+	return a;
+}
 
-	uint8_t is_branch;	// is this branch
-	uint8_t branch_taken; // if so, is this taken
+/* Same records in both blocks, ignoring the memory addresses */
+static Bool blk_same_shape(const loop_block_t *a, const loop_block_t *b) {
+	UInt j, pos = 0;
+	if (a->n_insts != b->n_insts || a->n_bytes != b->n_bytes ||
+		a->n_addrs != b->n_addrs)
+		return False;
+	if (VG_(memcmp)(a->aoff, b->aoff, a->n_addrs * sizeof(UShort)) != 0)
+		return False;
+	for (j = 0; j < a->n_addrs; j++) {
+		if (VG_(memcmp)(a->bytes + pos, b->bytes + pos, a->aoff[j] - pos) != 0)
+			return False;
+		pos = a->aoff[j] + 8;
+	}
+	return VG_(memcmp)(a->bytes + pos, b->bytes + pos, a->n_bytes - pos) == 0;
+}
 
-	uint8_t destination_registers[NUM_INSTR_DESTINATIONS]; // output registers
-	uint8_t source_registers[NUM_INSTR_SOURCES];		   // input registers
+static void blk_swap(void) {
+	loop_block_t *t = blk_last;
+	blk_last		= blk_cur;
+	blk_cur			= t;
+	blk_cur->n_insts = blk_cur->n_bytes = blk_cur->n_addrs = 0;
+}
 
-	uint64_t destination_memory[NUM_INSTR_DESTINATIONS]; // output memory
-	uint64_t source_memory[NUM_INSTR_SOURCES];			 // input memory
+static void flush_repeat(void) {
+	if (rep_count == 0)
+		return;
+	uint16_t key = CT_KEY_REPEAT;
+	uint16_t n	 = blk_last->n_insts;
+	uint16_t ns	 = blk_last->n_addrs;
+	write_out(&key, 2);
+	write_out(&n, 2);
+	write_out(&rep_count, 4);
+	write_out(&ns, 2);
+	write_out(rep_stride, ns * sizeof(Long));
+	rep_count = 0;
+}
 
-#ifdef TRACE_MEM_VALUES
-	uint8_t d_valid[NUM_INSTR_DESTINATIONS];
-	uint8_t d_value[NUM_INSTR_DESTINATIONS]
-				   [CACHE_LINE_SIZE]; // data in cache block
-									  // to which store took place
-	uint8_t s_valid[NUM_INSTR_SOURCES];
-	uint8_t s_value[NUM_INSTR_SOURCES][CACHE_LINE_SIZE]; // data in cache block
-#endif
-} trace_instr_format_t;
+/* Write out everything that is pending and forget the last block */
+static void loop_flush(void) {
+	flush_repeat();
+	write_out(blk_cur->bytes, blk_cur->n_bytes);
+	blk_cur->n_insts = blk_cur->n_bytes = blk_cur->n_addrs = 0;
+	blk_last_valid = False;
+}
 
-static trace_instr_format_t inst;
+static void loop_append(const uint8_t *rec, UInt len, const UShort *aoff,
+						UInt n_addrs) {
+	UInt j;
+	if (blk_cur->n_insts == LOOP_MAX_INSTS ||
+		blk_cur->n_bytes + len > LOOP_MAX_BYTES)
+		loop_flush();
+	for (j = 0; j < n_addrs; j++)
+		blk_cur->aoff[blk_cur->n_addrs++] = blk_cur->n_bytes + aoff[j];
+	VG_(memcpy)(blk_cur->bytes + blk_cur->n_bytes, rec, len);
+	blk_cur->n_bytes += len;
+	blk_cur->n_insts++;
+}
+
+/* Called at the start of every superblock, closes the current block */
+static VG_REGPARM(0) void loop_end_block(void) {
+	UInt j;
+	if (!tracing || blk_cur->n_insts == 0)
+		return;
+	if (blk_last_valid && rep_count < 0xffffffffU &&
+		blk_same_shape(blk_cur, blk_last)) {
+		Bool same = True;
+		for (j = 0; j < blk_cur->n_addrs; j++) {
+			Long d = (Long)(blk_addr(blk_cur, j) - blk_addr(blk_last, j));
+			if (rep_count == 0) {
+				rep_stride[j] = d;
+			} else if (rep_stride[j] != d) {
+				same = False;
+				break;
+			}
+		}
+		if (same) {
+			/* The next iteration is compared against this one */
+			rep_count++;
+			blk_swap();
+			return;
+		}
+	}
+	flush_repeat();
+	write_out(blk_cur->bytes, blk_cur->n_bytes);
+	blk_swap();
+	blk_last_valid = True;
+}
+
+/*------------------------------------------------------------*/
+/*--- Memory image                                         ---*/
+/*------------------------------------------------------------*/
+
+/* With --mem-values=image loads and stores do not copy their cache line
+ * into the record.  Instead the first access to a page while tracing
+ * emits an image of that page:
+ *
+ *   key (2) = CT_KEY_PAGE, addr (8), data (CT_PAGE_SIZE)
+ *
+ * and from then on loads only carry their address, while stores carry
+ * their address, size (2) and the bytes written.  Memory written by
+ * system calls or for signal frames is logged for pages that have
+ * already been imaged:
+ *
+ *   key (2) = CT_KEY_MEMWRITE, addr (8), len (4), data (len)
+ *
+ * So are the stores of an instruction that do not fit in its record,
+ * right after the record (or the block holding it with --compress-loops),
+ * so that the loads of the instruction still see memory as it was before.
+ * Pages that are unmapped or remapped are forgotten and imaged again on
+ * their next access.  The reader keeps its copy of memory up to date with
+ * these records and rebuilds the value of any line from it. */
+
+typedef struct _page_node {
+	struct _page_node *next;
+	UWord key; // page number
+} page_node_t;
+
+static VgHashTable *pages = NULL;
+static UWord last_page	  = ~0UL;
+
+static void touch_page(Addr a) {
+	UWord pn = a >> CT_PAGE_POW;
+	if (pn == last_page)
+		return;
+	last_page = pn;
+	if (VG_(HT_lookup)(pages, pn))
+		return;
+
+	page_node_t *n = VG_(malloc)("ct.page", sizeof(page_node_t));
+	n->key		   = pn;
+	VG_(HT_add_node)(pages, n);
+
+	/* Everything recorded so far comes before the image */
+	if (compress_loops)
+		loop_flush();
+	uint16_t key  = CT_KEY_PAGE;
+	uint64_t base = pn << CT_PAGE_POW;
+	write_out(&key, 2);
+	write_out(&base, 8);
+	write_out((void *)(Addr)base, CT_PAGE_SIZE);
+}
+
+static void forget_pages(Addr a, SizeT len) {
+	UWord first, last, pn;
+	page_node_t *n;
+
+	if (pages == NULL || len == 0)
+		return;
+	first	  = a >> CT_PAGE_POW;
+	last	  = (a + len - 1) >> CT_PAGE_POW;
+	last_page = ~0UL;
+
+	if (last - first >= VG_(HT_count_nodes)(pages)) {
+		VG_(HT_ResetIter)(pages);
+		while ((n = VG_(HT_Next)(pages))) {
+			if (n->key >= first && n->key <= last) {
+				VG_(HT_remove_at_Iter)(pages);
+				VG_(free)(n);
+			}
+		}
+	} else {
+		for (pn = first; pn <= last; pn++) {
+			n = VG_(HT_remove)(pages, pn);
+			if (n)
+				VG_(free)(n);
+		}
+	}
+}
+
+static void ct_new_mem_mmap(Addr a, SizeT len, Bool rr, Bool ww, Bool xx,
+							ULong di_handle) {
+	forget_pages(a, len);
+}
+
+static void ct_new_mem_brk(Addr a, SizeT len, ThreadId tid) {
+	forget_pages(a, len);
+}
+
+static void ct_copy_mem_remap(Addr from, Addr to, SizeT len) {
+	forget_pages(from, len);
+	forget_pages(to, len);
+}
+
+/* Logs the current contents of [a, a+len) for the pages already imaged */
+static void log_mem_write(Addr a, SizeT len) {
+	Addr end = a + len, p, lo, hi;
+	Bool flushed = False;
+
+	for (p = a & ~(CT_PAGE_SIZE - 1); p < end; p += CT_PAGE_SIZE) {
+		if (!VG_(HT_lookup)(pages, p >> CT_PAGE_POW))
+			continue;
+		if (compress_loops && !flushed) {
+			loop_flush();
+			flushed = True;
+		}
+		lo = p < a ? a : p;
+		hi = p + CT_PAGE_SIZE > end ? end : p + CT_PAGE_SIZE;
+
+		uint16_t key	 = CT_KEY_MEMWRITE;
+		uint64_t addr	 = lo;
+		uint32_t n_bytes = hi - lo;
+		write_out(&key, 2);
+		write_out(&addr, 8);
+		write_out(&n_bytes, 4);
+		write_out((void *)lo, n_bytes);
+	}
+}
+
+/* The stores of the current instruction that did not fit in its record,
+ * logged once the record is written */
+#define MAX_EXTRA_STORES 16
+static Addr extra_st_addr[MAX_EXTRA_STORES];
+static SizeT extra_st_size[MAX_EXTRA_STORES];
+static UInt n_extra_st = 0;
+
+static void log_extra_stores(void) {
+	UInt i;
+	for (i = 0; i < n_extra_st; i++)
+		log_mem_write(extra_st_addr[i], extra_st_size[i]);
+	n_extra_st = 0;
+}
+
+/* Memory written by the core on behalf of the client */
+static void ct_post_mem_write(CorePart part, ThreadId tid, Addr a,
+							  SizeT len) {
+	if (!tracing || len == 0)
+		return;
+	log_mem_write(a, len);
+}
+
+static void close_trace(void) {
+	if (compress_loops)
+		loop_flush();
+	flush_out();
+	if (out_stream && !out_broken) {
+		uint32_t frame[2] = {0, out_seq};
+		write_all(frame, sizeof(frame));
+	}
+	VG_(close)(fd);
+	/* Let the consumer finish before the program exits */
+	if (consumer_pid > 0) {
+		Int status;
+		VG_(waitpid)(consumer_pid, &status, 0);
+		consumer_pid = -1;
+	}
+}
 
 static VG_REGPARM(2) void trace_instr(Addr iaddr, SizeT size) {
 	if (!tracing)
@@ -211,85 +685,101 @@ static VG_REGPARM(2) void trace_instr(Addr iaddr, SizeT size) {
 	}
 }
 
-static VG_REGPARM(2) void trace_load(Addr addr, SizeT size) {
-	if (!tracing)
-		return;
-	Int already_found = 0;
-	for (Int i = 0; i < NUM_INSTR_SOURCES; i++) {
-		if (inst.source_memory[i] == ((uint64_t)addr)) {
-			already_found = 1;
-			break;
+/* Adds addr to the first free slot unless it is already there.  Returns
+ * the slot used, or -1 if nothing was added. */
+static CT_INLINE Int add_mem(uint64_t *slots, Int n, Addr addr) {
+	Int i;
+	for (i = 0; i < n; i++) {
+		if (slots[i] == ((uint64_t)addr))
+			return -1;
+	}
+	for (i = 0; i < n; i++) {
+		if (slots[i] == 0) {
+			slots[i] = (uint64_t)addr;
+			return i;
 		}
 	}
-	if (already_found == 0) {
-		for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
-			if (inst.source_memory[i] == 0) {
-				inst.source_memory[i] = (uint64_t)addr;
-
-#ifdef TRACE_MEM_VALUES
-				char *a	= (char *)((addr >> CACHE_POW) << CACHE_POW);
-				inst.s_valid[i] = 1;
-				VG_(memcpy)((char *)&(inst.s_value[i][0]),(char *) a,CACHE_LINE_SIZE);
-#if 0
-				for (Int j = 0; j < CACHE_LINE_SIZE; j++) {
-					inst.s_value[i][j] = (uint8_t)a[j];
-				}
-#endif
-#endif
-				if (DEBUG_CT) {
-					VG_(printf)(" Load %08lx : ", addr);
+	return -1;
+}
 
-#ifdef TRACE_MEM_VALUES
-					for (Int j = 0; j < CACHE_LINE_SIZE; j++) {
-						VG_(printf)("%d ", (uint8_t)a[j]);
-					}
-#endif
-					VG_(printf)("\n");
-				}
-				break;
-			}
-		}
+static VG_REGPARM(2) void trace_load(Addr addr, SizeT size) {
+	if (!tracing) { return; }
+	add_mem(inst.source_memory, NUM_INSTR_SOURCES, addr);
+	if (DEBUG_CT) {
+		VG_(printf)(" Load %08lx\n", addr);
 	}
 }
 
 static VG_REGPARM(2) void trace_store(Addr addr, SizeT size) {
 	if (!tracing) { return; }
-	Int already_found = 0;
+	add_mem(inst.destination_memory, NUM_INSTR_DESTINATIONS, addr);
+	if (DEBUG_CT) {
+		VG_(printf)(" Store %08lx\n", addr);
+	}
+}
+
+static VG_REGPARM(2) void trace_load_line(Addr addr, SizeT size) {
+	if (!tracing) { return; }
+	Int i = add_mem(inst.source_memory, NUM_INSTR_SOURCES, addr);
+	if (i >= 0) {
+		char *a		   = (char *)((addr >> CACHE_POW) << CACHE_POW);
+		vals.s_valid[i] = 1;
+		VG_(memcpy)((char *)&(vals.s_value[i][0]), (char *)a, CACHE_LINE_SIZE);
+	}
+}
+
+static VG_REGPARM(2) void trace_store_line(Addr addr, SizeT size) {
+	if (!tracing) { return; }
+	Int i = add_mem(inst.destination_memory, NUM_INSTR_DESTINATIONS, addr);
+	if (i >= 0) {
+		char *a		   = (char *)((addr >> CACHE_POW) << CACHE_POW);
+		vals.d_valid[i] = 1;
+		VG_(memcpy)((char *)&(vals.d_value[i][0]), (char *)a, CACHE_LINE_SIZE);
+	}
+}
+
+static VG_REGPARM(2) void trace_load_image(Addr addr, SizeT size) {
+	if (!tracing) { return; }
+	touch_page(addr);
+	touch_page(addr + size - 1);
+	Int i = add_mem(inst.source_memory, NUM_INSTR_SOURCES, addr);
+	if (i >= 0)
+		vals.s_valid[i] = 1;
+}
+
+/* Called after the store, so the bytes in memory are the ones written.
+ * Stores that do not fit in the record (eg. xsave) are logged as memory
+ * writes after it so that the reader's image stays exact.  There is no
+ * guest instruction with that many, but should there be, the rest are
+ * logged at once. */
+static VG_REGPARM(2) void trace_store_image(Addr addr, SizeT size) {
+	if (!tracing) { return; }
+	touch_page(addr);
+	touch_page(addr + size - 1);
 	for (Int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
 		if (inst.destination_memory[i] == ((uint64_t)addr)) {
-			already_found = 1;
-			break;
+			if (size > vals.st_size[i])
+				vals.st_size[i] = size;
+			VG_(memcpy)(vals.st_data[i], (void *)addr, vals.st_size[i]);
+			return;
 		}
 	}
-	if (already_found == 0) {
-		for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
-			if (inst.destination_memory[i] == 0) {
-				inst.destination_memory[i] = (uint64_t)addr;
-
-#ifdef TRACE_MEM_VALUES
-				char *a			= (char *)((addr >> CACHE_POW) << CACHE_POW);
-				inst.d_valid[i] = 1;
-				VG_(memcpy)((char *)&(inst.d_value[i][0]),(char *)a,CACHE_LINE_SIZE);
-#if 0
-				for (Int j = 0; j < CACHE_LINE_SIZE; j++) {
-					inst.d_value[i][j] = (uint8_t)a[j];
-				}
-#endif
-#endif
-				break;
-
-				if (DEBUG_CT) {
-					VG_(printf)(" Load %08lx : ", addr);
-#ifdef TRACE_MEM_VALUES
-					for (Int j = 0; j < CACHE_LINE_SIZE; j++) {
-						VG_(printf)("%d ", (uint8_t)a[j]);
-					}
-#endif
-					VG_(printf)("\n");
-				}
-			}
+	for (Int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+		if (inst.destination_memory[i] == 0) {
+			inst.destination_memory[i] = (uint64_t)addr;
+			vals.d_valid[i]			   = 1;
+			VG_(memcpy)(vals.st_data[i], (void *)addr, size);
+			vals.st_size[i] = size;
+			return;
 		}
 	}
+	if (n_extra_st < MAX_EXTRA_STORES) {
+		extra_st_addr[n_extra_st] = addr;
+		extra_st_size[n_extra_st] = size;
+		n_extra_st++;
+	} else {
+		log_mem_write(addr, size);
+	}
 }
 
 static VG_REGPARM(1) void trace_reg_read(Int r) {
@@ -483,74 +973,279 @@ static VG_REGPARM(0) void zero_inst(void) {
 	VG_(memset)( &inst, 0, sizeof(inst));
 }
 
-static VG_REGPARM(0) void write_inst_to_file(void) {
+/* The values themselves are only read when they are marked valid */
+static VG_REGPARM(0) void zero_inst_values(void) {
+	if (!tracing) { return; }
+	VG_(memset)( &inst, 0, sizeof(inst));
+	VG_(memset)(vals.d_valid, 0, sizeof(vals.d_valid));
+	VG_(memset)(vals.s_valid, 0, sizeof(vals.s_valid));
+}
+
+/* Encodes inst as a keyed record.  Every writer below is an instance of
+ * this with constant arguments, so the checks on them are folded away. */
+static CT_INLINE void write_keyed(Bool values, Bool image, Bool loops) {
 	if (!tracing) { return; }
 	/* Don't Print Empty Instruction*/
-	if (inst.ip == 0)
+	if (inst.ip == 0) {
+		if (image)
+			log_extra_stores();
 		return;
-	uint8_t buffer[1152];
-	uint32_t index  = 0;
-	uint32_t encode_key = 0;
-	if(inst.is_branch) {
-		encode_key |= INST_IS_BRANCH_MASK;
-	}
-	if (inst.branch_taken) {
-		encode_key |= INST_BRANCH_TAKEN_MASK;
-	}
-	index = 2;
-	VG_(memcpy)(buffer + index, &inst.ip, 8);
-	index += 8;
-	uint32_t mask = DEST_REG_MASK;
-	for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
-		if(inst.destination_registers[i] != 0) {
-			encode_key |= mask;
-			mask = mask << 1;
-			VG_(memcpy)(buffer + index, &(inst.destination_registers[i]), 4);
-			index += 4;
-		}
 	}
-	
-	mask = DEST_MEM_MASK;
-	for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
-		
-		if (inst.d_valid[i]) {
-			encode_key |= mask;
-			mask = mask << 1;
-			VG_(memcpy)(buffer + index, &(inst.destination_memory[i]), 8);
-			index += 8;
-			VG_(memcpy)(buffer + index, &(inst.d_value[i]), 64);
-			index += 64;
-		}
+	uint8_t buffer[CT_MAX_RECORD];
+	ct_layout_t lay;
+	UInt len = ct_encode_record(buffer, &inst, &vals,
+								(values ? CT_HDR_VALUES : 0) |
+									(image ? CT_HDR_IMAGE : 0),
+								loops ? &lay : NULL);
+	if (loops) {
+		loop_append(buffer, len, lay.aoff, lay.n_addrs);
+	} else {
+		write_out(buffer, len);
+	}
+	if (image)
+		log_extra_stores();
+}
+
+#define KEYED_WRITER(name, values, image, loops) \
+	static VG_REGPARM(0) void name(void) { write_keyed(values, image, loops); }
+
+KEYED_WRITER(write_champsim, False, False, False)
+KEYED_WRITER(write_champsim_loops, False, False, True)
+KEYED_WRITER(write_lines, True, False, False)
+KEYED_WRITER(write_lines_loops, True, False, True)
+KEYED_WRITER(write_image, True, True, False)
+KEYED_WRITER(write_image_loops, True, True, True)
+
+/*------------------------------------------------------------*/
+/*--- CVP-1 records                                        ---*/
+/*------------------------------------------------------------*/
+
+/* --format=cvp writes records in the format of the CVP-1 value prediction
+ * championship traces:
+ *
+ *   pc (8), type (1),
+ *   if a load or store: address (8), size (1),
+ *   if a branch: taken (1), and if taken target (8),
+ *   n_in (1), in (n_in), n_out (1), out (n_out),
+ *   the value of each output register, 8 bytes for integer registers
+ *   (0-31) and the flags (64), 16 bytes for vector registers (32-63).
+ *
+ * The record of an instruction is written at the start of the next one,
+ * so the values are read from the guest state at that point and the
+ * target of a taken branch is the address of that instruction. */
+#define CVP_MAX_REGS 8
+#define CVP_MAX_RECORD (8 + 1 + 9 + 9 + 2 + 2 * CVP_MAX_REGS + 16 * CVP_MAX_REGS)
+
+#define CVP_REG_SIMD 32
+#define CVP_REG_FLAGS 64
+
+enum {
+	CVP_ALU,
+	CVP_LOAD,
+	CVP_STORE,
+	CVP_COND_BRANCH,
+	CVP_DIRECT_BRANCH,
+	CVP_INDIRECT_BRANCH,
+	CVP_FP,
+	CVP_SLOW_ALU,
+	CVP_UNDEF
+};
+
+typedef struct {
+	uint64_t pc;
+	uint8_t type;
+	uint8_t taken;
+	uint64_t ld_addr, st_addr;
+	uint8_t ld_size, st_size;
+	uint8_t n_in, n_out;
+	uint8_t in[CVP_MAX_REGS], out[CVP_MAX_REGS];
+} cvp_instr_t;
+
+static cvp_instr_t cvp;
+
+#if defined(VGP_arm64_linux)
+typedef VexGuestARM64State cvp_guest_t;
+#define CVP_GUEST_FIRST offsetof(VexGuestARM64State, guest_X0)
+#define CVP_GUEST_END (offsetof(VexGuestARM64State, guest_Q31) + 16)
+#elif defined(VGA_amd64)
+typedef VexGuestAMD64State cvp_guest_t;
+#define CVP_GUEST_FIRST offsetof(VexGuestAMD64State, guest_RAX)
+#define CVP_GUEST_END offsetof(VexGuestAMD64State, guest_YMM16)
+#else
+/* No register numbering for other guests, --format=cvp is rejected */
+typedef VexGuestArchState cvp_guest_t;
+#define CVP_GUEST_FIRST 0
+#define CVP_GUEST_END 0
+#endif
+
+/* Register number of a guest state offset, or -1 if it is not traced */
+static Int cvp_reg_id(Int offset, Int sz) {
+#if defined(VGP_arm64_linux)
+#define GOF(f) ((Int)offsetof(VexGuestARM64State, guest_##f))
+	if (offset >= GOF(X0) && offset < GOF(X30) + 8)
+		return (offset - GOF(X0)) / 8;
+	if (offset >= GOF(XSP) && offset < GOF(XSP) + 8)
+		return 31;
+	if (offset >= GOF(CC_OP) && offset < GOF(CC_NDEP) + 8)
+		return CVP_REG_FLAGS;
+	if (offset >= GOF(Q0) && offset < GOF(Q31) + 16)
+		return CVP_REG_SIMD + (offset - GOF(Q0)) / 16;
+#undef GOF
+#elif defined(VGA_amd64)
+#define GOF(f) ((Int)offsetof(VexGuestAMD64State, guest_##f))
+	if (offset >= GOF(RAX) && offset < GOF(R15) + 8)
+		return (offset - GOF(RAX)) / 8;
+	if ((offset >= GOF(CC_OP) && offset < GOF(DFLAG) + 8) ||
+		offset == GOF(ACFLAG) || offset == GOF(IDFLAG))
+		return CVP_REG_FLAGS;
+	if (offset >= GOF(YMM0) && offset < GOF(YMM16))
+		return CVP_REG_SIMD + (offset - GOF(YMM0)) / 32;
+#undef GOF
+#endif
+	return -1;
+}
+
+/* Appends the value of register r to buf and returns its size */
+static UInt cvp_reg_value(const cvp_guest_t *g, UInt r, uint8_t *buf) {
+	ULong v;
+#if defined(VGP_arm64_linux)
+	if (r == CVP_REG_FLAGS)
+		v = LibVEX_GuestARM64_get_nzcv(g);
+	else if (r >= CVP_REG_SIMD) {
+		VG_(memcpy)(buf, &g->guest_Q0 + (r - CVP_REG_SIMD), 16);
+		return 16;
+	} else if (r == 31)
+		v = g->guest_XSP;
+	else
+		v = (&g->guest_X0)[r];
+#elif defined(VGA_amd64)
+	if (r == CVP_REG_FLAGS)
+		v = LibVEX_GuestAMD64_get_rflags(g);
+	else if (r >= CVP_REG_SIMD) {
+		/* The low 128 bits, as in the CVP-1 traces */
+		VG_(memcpy)(buf, &g->guest_YMM0 + (r - CVP_REG_SIMD), 16);
+		return 16;
+	} else
+		v = (&g->guest_RAX)[r];
+#else
+	return 0;
+#endif
+	VG_(memcpy)(buf, &v, 8);
+	return 8;
+}
+
+static CT_INLINE void cvp_add_reg(uint8_t *regs, uint8_t *n, Int r) {
+	for (Int i = 0; i < *n; i++) {
+		if (regs[i] == r)
+			return;
 	}
+	if (*n < CVP_MAX_REGS)
+		regs[(*n)++] = r;
+}
+
+static VG_REGPARM(2) void trace_instr_cvp(Addr iaddr, SizeT size) {
+	if (!tracing) { return; }
+	cvp.pc = iaddr;
+}
+
+static VG_REGPARM(2) void trace_load_cvp(Addr addr, SizeT size) {
+	if (!tracing) { return; }
+	if (cvp.ld_addr == 0) {
+		cvp.ld_addr = addr;
+		cvp.ld_size = size > 0xff ? 0xff : size;
+	}
+}
+
+static VG_REGPARM(2) void trace_store_cvp(Addr addr, SizeT size) {
+	if (!tracing) { return; }
+	if (cvp.st_addr == 0) {
+		cvp.st_addr = addr;
+		cvp.st_size = size > 0xff ? 0xff : size;
+	}
+}
+
+static VG_REGPARM(1) void trace_reg_read_cvp(Int r) {
+	if (!tracing) { return; }
+	cvp_add_reg(cvp.in, &cvp.n_in, r);
+}
+
+static VG_REGPARM(1) void trace_reg_write_cvp(Int r) {
+	if (!tracing) { return; }
+	cvp_add_reg(cvp.out, &cvp.n_out, r);
+}
+
+static VG_REGPARM(2) void trace_branch_conditional_cvp(Bool ci, Bool guard) {
+	if (!tracing) { return; }
+	cvp.type  = CVP_COND_BRANCH;
+	cvp.taken = guard ? !ci : ci;
+	/* As for ChampSim, conditional branches always read the flags */
+	cvp_add_reg(cvp.in, &cvp.n_in, CVP_REG_FLAGS);
+}
+
+static VG_REGPARM(1) void trace_branch_direct_cvp(IRJumpKind jk) {
+	if (!tracing) { return; }
+	cvp.type  = CVP_DIRECT_BRANCH;
+	cvp.taken = 1;
+}
+
+static VG_REGPARM(1) void trace_branch_indirect_cvp(IRJumpKind jk) {
+	if (!tracing) { return; }
+	cvp.type  = CVP_INDIRECT_BRANCH;
+	cvp.taken = 1;
+}
+
+static VG_REGPARM(0) void zero_inst_cvp(void) {
+	if (!tracing) { return; }
+	VG_(memset)(&cvp, 0, sizeof(cvp));
+}
+
+static VG_REGPARM(2) void write_cvp(cvp_guest_t *g, Addr next_ip) {
+	if (!tracing) { return; }
+	/* Don't Print Empty Instruction*/
+	if (cvp.pc == 0)
+		return;
+	uint8_t buffer[CVP_MAX_RECORD];
+	UInt index = 0;
+	Int i;
 
-	mask = SOURCE_REG_MASK;
-	for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
-		if(inst.source_registers[i] != 0) {
-			encode_key |= mask;
-			mask = mask << 1;
-			VG_(memcpy)(buffer + index, &(inst.source_registers[i]), 4);
-			index += 4;
+	if (cvp.type == CVP_ALU) {
+		if (cvp.st_addr)
+			cvp.type = CVP_STORE;
+		else if (cvp.ld_addr)
+			cvp.type = CVP_LOAD;
+		else {
+			for (i = 0; i < cvp.n_out; i++) {
+				if (cvp.out[i] >= CVP_REG_SIMD && cvp.out[i] < CVP_REG_FLAGS)
+					cvp.type = CVP_FP;
+			}
 		}
 	}
-	mask = SOURCE_MEM_MASK;
-	for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
-		if (inst.s_valid[i]) {
-			encode_key |= mask;
-			mask = mask << 1;
-			VG_(memcpy)(buffer + index, &(inst.source_memory[i]), 8);
+
+	VG_(memcpy)(buffer, &cvp.pc, 8);
+	buffer[8] = cvp.type;
+	index	  = 9;
+	if (cvp.type == CVP_LOAD || cvp.type == CVP_STORE) {
+		Bool st = cvp.type == CVP_STORE;
+		VG_(memcpy)(buffer + index, st ? &cvp.st_addr : &cvp.ld_addr, 8);
+		buffer[index + 8] = st ? cvp.st_size : cvp.ld_size;
+		index += 9;
+	} else if (cvp.type >= CVP_COND_BRANCH && cvp.type <= CVP_INDIRECT_BRANCH) {
+		buffer[index++] = cvp.taken;
+		if (cvp.taken) {
+			uint64_t target = next_ip;
+			VG_(memcpy)(buffer + index, &target, 8);
 			index += 8;
-			VG_(memcpy)(buffer + index, &(inst.s_value[i]), 64);
-			index += 64;
 		}
 	}
-	tl_assert((encode_key & 0xffff0000U) == 0);
-	encode_key = encode_key & 0xffffU;
-	uint16_t encode_key_write = (uint16_t) encode_key;
-	//encode_key = (((index - 8) & 0xffffffffULL) | encode_key);
-	VG_(memcpy)(buffer, &encode_key_write, 2);
-	if (tracing) {
-		VG_(write)(fd, buffer, index);
-	}
+	buffer[index++] = cvp.n_in;
+	VG_(memcpy)(buffer + index, cvp.in, cvp.n_in);
+	index += cvp.n_in;
+	buffer[index++] = cvp.n_out;
+	VG_(memcpy)(buffer + index, cvp.out, cvp.n_out);
+	index += cvp.n_out;
+	for (i = 0; i < cvp.n_out; i++)
+		index += cvp_reg_value(g, cvp.out[i], buffer + index);
+	write_out(buffer, index);
 }
 
 static VG_REGPARM(0) void print_inst(void) {
@@ -572,15 +1267,6 @@ static VG_REGPARM(0) void print_inst(void) {
 	}
 	for (Int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
 		VG_(printf)(" %08llx :", inst.destination_memory[i]);
-#ifdef TRACE_MEM_VALUES
-		/*if( inst.destination_memory[i] != 0) {
-			for(Int j = 0; j < CACHE_LINE_SIZE; j++)
-			{
-				VG_(printf)(" %u-%u",inst.d_valid[i][j],inst.d_value[i][j]);
-			}
-			VG_(printf)(" :");
-		}*/
-#endif
 	}
 
 	for (Int i = 0; i < NUM_INSTR_SOURCES; i++) {
@@ -588,88 +1274,312 @@ static VG_REGPARM(0) void print_inst(void) {
 	}
 	for (Int i = 0; i < NUM_INSTR_SOURCES; i++) {
 		VG_(printf)(" %08llx :", inst.source_memory[i]);
-#ifdef TRACE_MEM_VALUES
-		/*if( inst.source_memory[i] != 0) {
-			for(Int j = 0; j < CACHE_LINE_SIZE; j++)
-			{
-				VG_(printf)(" %u-%u",inst.s_valid[i][j],inst.s_value[i][j]);
-			}
-			VG_(printf)(" :");
-		}*/
-#endif
 	}
 
 	VG_(printf)("\n");
 }
 
 
-static VG_REGPARM(0) void inc_inst(void) {
-	//if (!tracing) { return; }
-	instructions++;
-	
-	if(instructions % heartbeat == 0) {
-		VG_(printf)
-		("==%u== cstracer: Heartbeat : %llu instructions\n", pid, instructions);
-	}
-	
-	if (instructions == skip + 1) {
-		tracing = True;
-		VG_(printf)
-		("==%u== cstracer: Skipped %llu instructions\n", pid, instructions-1);
-		VG_(printf)("==%u== cstracer: Starting Tracing\n", pid);
-	}
-
-	if (instructions == (skip + trace_instrs + 1)) {
-		tracing = False;
-		if (!tracing_done) {
-			/* end tracing */
-			tracing_done = True;
-			VG_(printf)("==%u== cstracer: Tracing Completed\n", pid);
-			VG_(printf)
-			("==%u== cstracer: Instructions = %llu\n", pid, instructions - 1);
-
-			VG_(close)(fd);
-
-			/* Valgrind is slow at executing the program, 	*
-			 * so we don't run the program to completion		*
-			 * and exit once tracing is done to save time.	*/
-			if (exit_after_tracing) {
-				VG_(printf)("==%u== cstracer: Halting Execution\n", pid);
-				VG_(printf)("==%u== cstracer: Bye!\n", pid);
-				VG_(exit)(0);
-			}
+/*------------------------------------------------------------*/
+/*--- Windows                                              ---*/
+/*------------------------------------------------------------*/
+
+/* Instructions are counted by pub_tool_icount.h, which calls the events
+ * below at exact counts.  Outside a traced window the code is translated
+ * without any tracing helpers.  The two kinds of translation are kept
+ * apart as translation modes 0 and 1, so each block is translated at
+ * most once in each, however often tracing is switched on and off.
+ * Since a block already running carries on in the old mode, the switch
+ * to trace_mode is made VG_ICOUNT_MAX_SB_INSNS instructions ahead of the
+ * window, and the helpers check 'tracing' until it starts. */
+static void set_trace_mode(Bool on) {
+	trace_mode = on;
+	VG_(set_translation_mode)(on ? 1 : 0);
+}
+
+/* Enter trace_mode in time for a window starting at 'at' */
+static void trace_mode_event(ULong now, void *opaque) {
+	set_trace_mode(True);
+}
+
+static void prepare_window(ULong at) {
+	if (at > VG_ICOUNT_MAX_SB_INSNS)
+		VG_(icount_at)(at - VG_ICOUNT_MAX_SB_INSNS, trace_mode_event, NULL);
+	else
+		set_trace_mode(True);
+}
+
+static void heartbeat_event(ULong now, void *opaque) {
+	VG_(printf)("==%u== cstracer: Heartbeat : %llu instructions\n", pid, now);
+	VG_(icount_at)(now + heartbeat, heartbeat_event, NULL);
+}
+
+static void trace_start_event(ULong now, void *opaque) {
+	instructions = now;
+	n_extra_st	 = 0;
+	tracing		 = True;
+	VG_(printf)("==%u== cstracer: Skipped %llu instructions\n", pid, now);
+	VG_(printf)("==%u== cstracer: Starting Tracing\n", pid);
+}
+
+static void trace_stop_event(ULong now, void *opaque) {
+	instructions = now;
+	tracing		 = False;
+	if (tracing_done)
+		return;
+	/* end tracing */
+	tracing_done = True;
+	VG_(printf)("==%u== cstracer: Tracing Completed\n", pid);
+	VG_(printf)("==%u== cstracer: Instructions = %llu\n", pid, now);
+
+	close_trace();
+
+	/* Valgrind is slow at executing the program, 	*
+	 * so we don't run the program to completion		*
+	 * and exit once tracing is done to save time.	*/
+	if (exit_after_tracing) {
+		VG_(printf)("==%u== cstracer: Halting Execution\n", pid);
+		VG_(printf)("==%u== cstracer: Bye!\n", pid);
+		/* VG_(exit) skips the shutdown that prints the --stats */
+		if (VG_(clo_stats))
+			VG_(print_all_stats)(False, False);
+		VG_(exit)(0);
+	}
+	set_trace_mode(False);
+}
+
+/*------------------------------------------------------------*/
+/*--- Formats                                              ---*/
+/*------------------------------------------------------------*/
+
+/* Each format has its own set of helpers, chosen once after the command
+ * line is read, so the helpers never need to check which format is used. */
+typedef struct {
+	const HChar *name;
+	void *fn;
+} helper_t;
+
+#define HELPER(f) { #f, (void *)(f) }
+
+typedef struct {
+	const HChar *name;
+	helper_t instr, load, store, reg_read, reg_write;
+	helper_t branch_conditional, branch_direct, branch_indirect;
+	helper_t zero, write;
+	Int (*reg_id)(Int offset, Int sz); // register of a guest state offset
+	Bool line_values; // loads and stores read their cache line
+	Bool store_bytes; // stores read the bytes they wrote
+	Bool reads_guest; // write is passed the guest state and next address
+} format_t;
+
+static const format_t *fmt;
+
+/*------------------------------------------------------------*/
+/*--- Phases                                               ---*/
+/*------------------------------------------------------------*/
+
+/* With --phases=yes every superblock adds its instruction count to one of
+ * PH_DIMS buckets picked by a hash of its address, a random projection
+ * of the basic block vector.  At the end of each --phase-interval the
+ * normalised vector is compared with those of the phases seen so far by
+ * Manhattan distance (0% for the same mix of code, 100% for disjoint
+ * code).  An interval within --phase-threshold of a known phase belongs
+ * to it.  One that matches none, but is within the threshold of the
+ * interval before it, starts a new stable phase: the next --trace
+ * instructions are traced to tracefile_pid.phaseN, each trace a
+ * complete file in the chosen format. */
+#define PH_DIMS 64
+#define PH_MAX 256
+#define PH_SCALE 10000 // a normalised vector sums to this
+
+static ULong ph_sig[PH_DIMS]; // this interval
+static UShort ph_prev[PH_DIMS];
+static Bool ph_prev_unmatched = False;
+static UShort ph_known[PH_MAX][PH_DIMS];
+static ULong ph_first[PH_MAX];	   // instruction it was first seen at
+static ULong ph_intervals[PH_MAX]; // intervals that belonged to it
+static ULong ph_unmatched = 0;
+static UInt ph_count = 0;
+
+static VG_REGPARM(2) void phase_block(UWord bucket, UWord n_insts) {
+	ph_sig[bucket] += n_insts;
+}
+
+static UWord phase_bucket(Addr a) {
+	return (UWord)(((ULong)a * 0x9E3779B97F4A7C15ULL) >> 58) % PH_DIMS;
+}
+
+/* In percent */
+static UInt phase_distance(const UShort *a, const UShort *b) {
+	UInt d = 0, i;
+	for (i = 0; i < PH_DIMS; i++)
+		d += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+	return d * 100 / (2 * PH_SCALE);
+}
+
+static void phase_stop_trace(void) {
+	tracing = False;
+	close_trace();
+	VG_(printf)("==%u== cstracer: Phase %u traced\n", pid, phase_cur);
+}
+
+static void phase_stop_event(ULong now, void *opaque) {
+	instructions = now;
+	if (!tracing)
+		return;
+	phase_stop_trace();
+	if (!ph_prev_unmatched)
+		set_trace_mode(False);
+}
+
+static void phase_start_trace(void) {
+	HChar name[256];
+
+	phase_cur = ph_count - 1;
+	VG_(memset)(&inst, 0, sizeof(inst));
+	VG_(memset)(&vals, 0, sizeof(vals));
+	VG_(memset)(&cvp, 0, sizeof(cvp));
+	if (mem_image) {
+		/* Each trace images the pages it uses itself */
+		VG_(HT_destruct)(pages, VG_(free));
+		pages	  = VG_(HT_construct)("ct.pages");
+		last_page = ~0UL;
+	}
+	open_trace(name, sizeof(name));
+	if (compress_loops || mem_image)
+		write_header();
+	n_extra_st = 0;
+	tracing	   = True;
+	VG_(icount_at)(instructions + trace_instrs, phase_stop_event, NULL);
+	VG_(printf)("==%u== cstracer: Phase %u at %llu instructions, "
+				"tracing to %s\n", pid, phase_cur, instructions, name);
+}
+
+static void phase_interval_end(void) {
+	UShort cur[PH_DIMS];
+	ULong total = 0;
+	UInt i, d, best = 0, best_d = 101;
+
+	for (i = 0; i < PH_DIMS; i++)
+		total += ph_sig[i];
+	if (total == 0 || instructions <= skip) {
+		VG_(memset)(ph_sig, 0, sizeof(ph_sig));
+		return;
+	}
+	for (i = 0; i < PH_DIMS; i++)
+		cur[i] = ph_sig[i] * PH_SCALE / total;
+	VG_(memset)(ph_sig, 0, sizeof(ph_sig));
+
+	for (i = 0; i < ph_count; i++) {
+		d = phase_distance(cur, ph_known[i]);
+		if (d < best_d) {
+			best   = i;
+			best_d = d;
 		}
 	}
+
+	if (best_d <= phase_threshold) {
+		ph_intervals[best]++;
+	} else if (ph_prev_unmatched && !tracing && ph_count < PH_MAX &&
+			   phase_distance(cur, ph_prev) <= phase_threshold) {
+		/* The interval before was the first of this phase */
+		VG_(memcpy)(ph_known[ph_count], cur, sizeof(cur));
+		ph_first[ph_count]	   = instructions - 2 * phase_interval;
+		ph_intervals[ph_count] = 2;
+		ph_unmatched--;
+		ph_count++;
+		phase_start_trace();
+	} else {
+		ph_unmatched++;
+		ph_prev_unmatched = True;
+		VG_(memcpy)(ph_prev, cur, sizeof(cur));
+		return;
+	}
+	ph_prev_unmatched = False;
 }
 
-static void instrument_instruction(IRSB *sb, IRAtom *iaddr, UInt isize) {
+/* A new phase can only start at the end of an interval that follows an
+ * unmatched one, so only then are the translations made ready for it. */
+static void phase_interval_event(ULong now, void *opaque) {
+	instructions = now;
+	phase_interval_end();
+	if (ph_prev_unmatched && ph_count < PH_MAX)
+		prepare_window(now + phase_interval);
+	else if (!tracing)
+		set_trace_mode(False);
+	VG_(icount_at)(now + phase_interval, phase_interval_event, NULL);
+}
 
-	tl_assert((VG_MIN_INSTR_SZB <= isize && isize <= VG_MAX_INSTR_SZB) ||
-			  VG_CLREQ_SZB == isize);
+static void phase_fini(void) {
+	ULong total = ph_unmatched;
+	UInt i;
+
+	if (tracing)
+		phase_stop_trace();
+	for (i = 0; i < ph_count; i++)
+		total += ph_intervals[i];
+	VG_(printf)("==%u== cstracer: Phases : %u\n", pid, ph_count);
+	for (i = 0; i < ph_count; i++)
+		VG_(printf)("==%u== cstracer: Phase %u : first at %llu, "
+					"%llu intervals (%llu%%)\n", pid, i, ph_first[i],
+					ph_intervals[i], ph_intervals[i] * 100 / total);
+	VG_(printf)("==%u== cstracer: Unmatched intervals : %llu\n", pid,
+				ph_unmatched);
+}
+
+/* Writes the record of the previous instruction.  This comes before the
+ * instruction count is checked at 'iaddr', so that the last instruction
+ * of a window is written before the event closing it. */
+static void instrument_write(IRSB *sb, Addr iaddr) {
 	IRExpr **argv;
 	IRDirty *di;
 
-	di = unsafeIRDirty_0_N(0, "inc_inst", VG_(fnptr_to_fnentry)(inc_inst),
-						   mkIRExprVec_0());
+	if (fmt->reads_guest) {
+		/* The registers written by the previous instruction */
+		argv = mkIRExprVec_2(IRExpr_GSPTR(), mkIRExpr_HWord(iaddr));
+		di	 = unsafeIRDirty_0_N(2, fmt->write.name,
+								 VG_(fnptr_to_fnentry)(fmt->write.fn), argv);
+		di->nFxState			 = 1;
+		di->fxState[0].fx		 = Ifx_Read;
+		di->fxState[0].offset	 = CVP_GUEST_FIRST;
+		di->fxState[0].size		 = CVP_GUEST_END - CVP_GUEST_FIRST;
+		di->fxState[0].nRepeats	 = 0;
+		di->fxState[0].repeatLen = 0;
+	} else {
+		di = unsafeIRDirty_0_N(0, fmt->write.name,
+							   VG_(fnptr_to_fnentry)(fmt->write.fn),
+							   mkIRExprVec_0());
+	}
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
+}
 
-	di = unsafeIRDirty_0_N(0, "write_inst",
-						   VG_(fnptr_to_fnentry)(write_inst_to_file),
-						   mkIRExprVec_0());
-	addStmtToIRSB(sb, IRStmt_Dirty(di));
+static void instrument_instruction(IRSB *sb, Addr iaddr, UInt isize,
+								   Bool sb_start) {
+
+	tl_assert((VG_MIN_INSTR_SZB <= isize && isize <= VG_MAX_INSTR_SZB) ||
+			  VG_CLREQ_SZB == isize);
+	IRExpr **argv;
+	IRDirty *di;
+
+	if (compress_loops && sb_start) {
+		di = unsafeIRDirty_0_N(0, "loop_end_block",
+							   VG_(fnptr_to_fnentry)(loop_end_block),
+							   mkIRExprVec_0());
+		addStmtToIRSB(sb, IRStmt_Dirty(di));
+	}
 
 	//	di = unsafeIRDirty_0_N( 0, "print_inst",
 	//			VG_(fnptr_to_fnentry)( print_inst ),
 	//			mkIRExprVec_0() );
 	//	addStmtToIRSB( sb, IRStmt_Dirty(di) );
 
-	di = unsafeIRDirty_0_N(0, "zero_inst", VG_(fnptr_to_fnentry)(zero_inst),
-						   mkIRExprVec_0());
+	di = unsafeIRDirty_0_N(0, fmt->zero.name,
+						   VG_(fnptr_to_fnentry)(fmt->zero.fn), mkIRExprVec_0());
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
 
-	argv = mkIRExprVec_2(iaddr, mkIRExpr_HWord(isize));
-	di = unsafeIRDirty_0_N(2, "trace_instr", VG_(fnptr_to_fnentry)(trace_instr),
-						   argv);
+	argv = mkIRExprVec_2(mkIRExpr_HWord(iaddr), mkIRExpr_HWord(isize));
+	di	 = unsafeIRDirty_0_N(2, fmt->instr.name,
+							 VG_(fnptr_to_fnentry)(fmt->instr.fn), argv);
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
 }
 
@@ -692,15 +1602,15 @@ static void instrument_load(IRSB *sb, IRAtom *daddr, Int dsize, IRAtom *guard) {
 	tl_assert(dsize >= 1 && dsize <= MAX_DSIZE);
 
 	IRDirty *di_mem = emptyIRDirty();
-#ifdef TRACE_MEM_VALUES
-	di_mem->mFx   = Ifx_Read;
-	di_mem->mAddr = cache_block_addr(daddr);
-	di_mem->mSize = CACHE_LINE_SIZE;
-#endif
+	if (fmt->line_values) {
+		di_mem->mFx   = Ifx_Read;
+		di_mem->mAddr = cache_block_addr(daddr);
+		di_mem->mSize = CACHE_LINE_SIZE;
+	}
 	IRExpr **argv_mem = mkIRExprVec_2(daddr, mkIRExpr_HWord(dsize));
 	di_mem->args	  = argv_mem;
-	di_mem->cee =
-		mkIRCallee(2, "trace_load", VG_(fnptr_to_fnentry)(trace_load));
+	di_mem->cee		  = mkIRCallee(2, fmt->load.name,
+								   VG_(fnptr_to_fnentry)(fmt->load.fn));
 	di_mem->guard = IRExpr_Const(IRConst_U1(True));
 
 	// Predicated Load. Track all loads if commented
@@ -717,15 +1627,19 @@ static void instrument_store(IRSB *sb, IRAtom *daddr, Int dsize,
 	tl_assert(dsize >= 1 && dsize <= MAX_DSIZE);
 
 	IRDirty *di_mem = emptyIRDirty();
-#ifdef TRACE_MEM_VALUES
-	di_mem->mFx   = Ifx_Read;
-	di_mem->mAddr = cache_block_addr(daddr);
-	di_mem->mSize = CACHE_LINE_SIZE;
-#endif
+	if (fmt->line_values) {
+		di_mem->mFx   = Ifx_Read;
+		di_mem->mAddr = cache_block_addr(daddr);
+		di_mem->mSize = CACHE_LINE_SIZE;
+	} else if (fmt->store_bytes) {
+		di_mem->mFx   = Ifx_Read;
+		di_mem->mAddr = daddr;
+		di_mem->mSize = dsize;
+	}
 	IRExpr **argv_mem = mkIRExprVec_2(daddr, mkIRExpr_HWord(dsize));
 	di_mem->args	  = argv_mem;
-	di_mem->cee =
-		mkIRCallee(2, "trace_store", VG_(fnptr_to_fnentry)(trace_store));
+	di_mem->cee		  = mkIRCallee(2, fmt->store.name,
+								   VG_(fnptr_to_fnentry)(fmt->store.fn));
 	di_mem->guard = IRExpr_Const(IRConst_U1(True));
 
 	if (guard) {
@@ -928,38 +1842,75 @@ static PIN_REG offset_to_x86_64_register(Int offset, Int sz) {
 
 #endif
 
-static void instrument_reg_read(IRSB *sb, Int offset, Int sz) {
+/* Register number of a guest state offset, or -1 if it is not traced */
+static Int champsim_reg_id(Int offset, Int sz) {
 	int p;
 #if defined(VGP_arm64_linux)
 	p = offset_to_arm64_register(offset);
 	if (p == 0 || p == REG_PC)
-		return;
+		return -1;
 #else
 	p = offset_to_x86_64_register(offset, sz);
 	if (p == 0 || p == REG_RIP )
-		return;
+		return -1;
 #endif
+	return p;
+}
+
+#define CHAMPSIM_FORMAT(name, load, store, zero, write, line_values,        \
+						store_bytes)                                        \
+	{                                                                       \
+		name, HELPER(trace_instr), HELPER(load), HELPER(store),             \
+			HELPER(trace_reg_read), HELPER(trace_reg_write),                \
+			HELPER(trace_branch_conditional), HELPER(trace_branch_direct),  \
+			HELPER(trace_branch_indirect), HELPER(zero), HELPER(write),     \
+			champsim_reg_id, line_values, store_bytes, False                \
+	}
+
+/* The ChampSim rows are indexed by
+ * 2 * trace_format + 2 * mem_image + compress_loops, cvp comes last */
+static const format_t formats[] = {
+	CHAMPSIM_FORMAT("champsim", trace_load, trace_store, zero_inst,
+					write_champsim, False, False),
+	CHAMPSIM_FORMAT("champsim", trace_load, trace_store, zero_inst,
+					write_champsim_loops, False, False),
+	CHAMPSIM_FORMAT("champsim-values", trace_load_line, trace_store_line,
+					zero_inst_values, write_lines, True, False),
+	CHAMPSIM_FORMAT("champsim-values", trace_load_line, trace_store_line,
+					zero_inst_values, write_lines_loops, True, False),
+	CHAMPSIM_FORMAT("champsim-values (image)", trace_load_image,
+					trace_store_image, zero_inst_values, write_image, False,
+					True),
+	CHAMPSIM_FORMAT("champsim-values (image)", trace_load_image,
+					trace_store_image, zero_inst_values, write_image_loops,
+					False, True),
+	{"cvp", HELPER(trace_instr_cvp), HELPER(trace_load_cvp),
+	 HELPER(trace_store_cvp), HELPER(trace_reg_read_cvp),
+	 HELPER(trace_reg_write_cvp), HELPER(trace_branch_conditional_cvp),
+	 HELPER(trace_branch_direct_cvp), HELPER(trace_branch_indirect_cvp),
+	 HELPER(zero_inst_cvp), HELPER(write_cvp), cvp_reg_id, False, False,
+	 True},
+};
+
+static void instrument_reg_read(IRSB *sb, Int offset, Int sz) {
+	Int p = fmt->reg_id(offset, sz);
+	if (p < 0)
+		return;
 
 	IRExpr **argv = mkIRExprVec_1(mkIRExpr_HWord(p));
 	IRDirty *di   = unsafeIRDirty_0_N(
-		  1, "trace_reg_read", VG_(fnptr_to_fnentry)(trace_reg_read), argv);
+		  1, fmt->reg_read.name, VG_(fnptr_to_fnentry)(fmt->reg_read.fn), argv);
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
 }
 
 static void instrument_reg_write(IRSB *sb, Int offset, Int sz) {
-	int p;
-#if defined(VGP_arm64_linux)
-	p = offset_to_arm64_register(offset);
-	if (p == 0 || p == REG_PC)
-		return;
-#else
-	p = offset_to_x86_64_register(offset, sz);
-	if (p == 0 || p == REG_RIP )
+	Int p = fmt->reg_id(offset, sz);
+	if (p < 0)
 		return;
-#endif
+
 	IRExpr **argv = mkIRExprVec_1(mkIRExpr_HWord(p));
 	IRDirty *di   = unsafeIRDirty_0_N(
-		  1, "trace_reg_write", VG_(fnptr_to_fnentry)(trace_reg_write), argv);
+		  1, fmt->reg_write.name, VG_(fnptr_to_fnentry)(fmt->reg_write.fn), argv);
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
 }
 
@@ -977,8 +1928,8 @@ static void instrument_branch_conditional(IRSB *sb, Bool ci, IRExpr *guard) {
 	tl_assert(isIRAtom(guard2));
 	IRExpr **argv = mkIRExprVec_2(mkIRExpr_HWord(ci), guard2);
 	IRDirty *di   = unsafeIRDirty_0_N(
-		  2, "trace_branch_conditional",
-		  VG_(fnptr_to_fnentry)(trace_branch_conditional), argv);
+		  2, fmt->branch_conditional.name,
+		  VG_(fnptr_to_fnentry)(fmt->branch_conditional.fn), argv);
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
 }
 
@@ -986,16 +1937,16 @@ static void instrument_branch_direct(IRSB *sb, IRJumpKind jk) {
 
 	IRExpr **argv = mkIRExprVec_1(mkIRExpr_HWord(jk));
 	IRDirty *di =
-		unsafeIRDirty_0_N(1, "trace_branch_direct",
-						  VG_(fnptr_to_fnentry)(trace_branch_direct), argv);
+		unsafeIRDirty_0_N(1, fmt->branch_direct.name,
+						  VG_(fnptr_to_fnentry)(fmt->branch_direct.fn), argv);
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
 }
 
 static void instrument_branch_indirect(IRSB *sb, IRJumpKind jk) {
 	IRExpr **argv = mkIRExprVec_1(mkIRExpr_HWord(jk));
 	IRDirty *di =
-		unsafeIRDirty_0_N(1, "trace_branch_indirect",
-						  VG_(fnptr_to_fnentry)(trace_branch_indirect), argv);
+		unsafeIRDirty_0_N(1, fmt->branch_indirect.name,
+						  VG_(fnptr_to_fnentry)(fmt->branch_indirect.fn), argv);
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
 }
 
@@ -1007,15 +1958,67 @@ static void ct_post_clo_init(void) {
 
 	pid = VG_(getpid)();
 
-	char str[128];
-	VG_(sprintf)(str, "%s_%u", t_fname, pid);
-	VG_(printf)("==%u== cstracer: inst struct size : %u\n", pid, sizeof(inst));
+	HChar str[256];
+	/* Options are no longer fatal here, a bad combination is */
+	if (mem_image && trace_format != FMT_CHAMPSIM_VALUES) {
+		VG_(fmsg)("--mem-values=image needs --format=champsim-values\n");
+		VG_(exit)(1);
+	}
+	if (trace_format == FMT_CVP) {
+#if !defined(VGP_arm64_linux) && !defined(VGA_amd64)
+		VG_(fmsg)("--format=cvp is only supported on amd64 and arm64\n");
+		VG_(exit)(1);
+#endif
+		if (compress_loops) {
+			VG_(fmsg)("--compress-loops=yes is not supported with --format=cvp\n");
+			VG_(exit)(1);
+		}
+		fmt = &formats[sizeof(formats) / sizeof(formats[0]) - 1];
+	} else {
+		fmt = &formats[2 * trace_format + 2 * mem_image + compress_loops];
+	}
+
+	if (phases) {
+		/* A trace file is opened for each phase */
+		if (t_fname[0] == '|' || VG_(strncmp)(t_fname, "unix:", 5) == 0) {
+			VG_(fmsg)("--phases=yes traces to files only\n");
+			VG_(exit)(1);
+		}
+		if (phase_interval == 0) {
+			VG_(fmsg)("--phase-interval must be positive\n");
+			VG_(exit)(1);
+		}
+		VG_(icount_at)(phase_interval, phase_interval_event, NULL);
+		VG_(snprintf)(str, sizeof(str), "%s_%u.phaseN", t_fname, pid);
+	} else {
+		open_trace(str, sizeof(str));
+		prepare_window(skip);
+		VG_(icount_at)(skip, trace_start_event, NULL);
+		VG_(icount_at)(skip + trace_instrs, trace_stop_event, NULL);
+	}
+	VG_(icount_at)(heartbeat, heartbeat_event, NULL);
+	VG_(printf)("==%u== cstracer: Format : %s\n", pid, fmt->name);
 	VG_(printf)("==%u== cstracer: Tracefile : %s\n", pid, str);
 	VG_(printf)("==%u== cstracer: Skip : %llu\n", pid, skip);
 	VG_(printf)("==%u== cstracer: Trace : %llu\n", pid, trace_instrs);
+	if (phases)
+		VG_(printf)("==%u== cstracer: Phases : interval %llu, threshold %u%%\n",
+					pid, phase_interval, phase_threshold);
+
+	if (mem_image) {
+		pages = VG_(HT_construct)("ct.pages");
+		VG_(track_new_mem_mmap)(ct_new_mem_mmap);
+		VG_(track_die_mem_munmap)(forget_pages);
+		VG_(track_new_mem_brk)(ct_new_mem_brk);
+		VG_(track_die_mem_brk)(forget_pages);
+		VG_(track_copy_mem_remap)(ct_copy_mem_remap);
+		VG_(track_post_mem_write)(ct_post_mem_write);
+	}
+
+	if ((compress_loops || mem_image) && !phases)
+		write_header();
 
-	fd = VG_(fd_open)(str, VKI_O_WRONLY | VKI_O_TRUNC | VKI_O_CREAT, 00644);
-	tl_assert(fd != -1);
+	VG_(atfork)(NULL, NULL, ct_atfork_child);
 }
 
 static IRSB *ct_instrument(VgCallbackClosure *closure, IRSB *sbIn,
@@ -1030,6 +2033,8 @@ static IRSB *ct_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 	Addr iaddr				= 0, dst;
 	UInt ilen				= 0;
 	Bool condition_inverted = False;
+	Bool sb_start			= True;
+	VgICountSB ic;
 
 	if (gWordTy != hWordTy) {
 		/* We don't currently support this case. */
@@ -1046,19 +2051,43 @@ static IRSB *ct_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 		i++;
 	}
 
+	if (phases && i < sbIn->stmts_used) {
+		Int j, n_insts = 0;
+		for (j = i; j < sbIn->stmts_used; j++)
+			n_insts += sbIn->stmts[j]->tag == Ist_IMark;
+		IRExpr **argv = mkIRExprVec_2(
+			mkIRExpr_HWord(phase_bucket(sbIn->stmts[i]->Ist.IMark.addr)),
+			mkIRExpr_HWord(n_insts));
+		di = unsafeIRDirty_0_N(2, "phase_block",
+							   VG_(fnptr_to_fnentry)(phase_block), argv);
+		addStmtToIRSB(sbOut, IRStmt_Dirty(di));
+	}
+	VG_(icount_sb_start)(&ic, sbOut);
+
 	for (/*use current i*/; i < sbIn->stmts_used; i++) {
 
 		IRStmt *st = sbIn->stmts[i];
 		if ( !st || st->tag == Ist_NoOp )
 			continue;
+		if (st->tag == Ist_IMark) {
+			if (trace_mode)
+				instrument_write(sbOut, st->Ist.IMark.addr);
+			VG_(icount_imark)(&ic, sbOut);
+		}
+		else if (st->tag == Ist_Exit)
+			VG_(icount_exit)(&ic, sbOut);
+		if (!trace_mode) {
+			addStmtToIRSB(sbOut, st);
+			continue;
+		}
 		switch (st->tag) {
 
 		case Ist_IMark:
 			/* Needed to be able to check for inverted condition in Ist_Exit */
 			iaddr = st->Ist.IMark.addr;
 			ilen  = st->Ist.IMark.len;
-			instrument_instruction(
-				sbOut, mkIRExpr_HWord((HWord)st->Ist.IMark.addr), ilen);
+			instrument_instruction(sbOut, st->Ist.IMark.addr, ilen, sb_start);
+			sb_start = False;
 			addStmtToIRSB(sbOut, st);
 			break;
 
@@ -1226,6 +2255,10 @@ static IRSB *ct_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 		}
 	}
 
+	VG_(icount_sb_end)(&ic, sbOut);
+	if (!trace_mode)
+		return sbOut;
+
 	if ((sbIn->jumpkind == Ijk_Boring) || (sbIn->jumpkind == Ijk_Call) ||
 		(sbIn->jumpkind == Ijk_Ret)) {
 		if (0) {
@@ -1253,12 +2286,14 @@ static IRSB *ct_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 }
 
 static void ct_fini(Int exitcode) {
+	instructions = VG_(icount_now)();
 	VG_(printf)("==%u== cstracer: Program Completed\n", pid);
 	VG_(printf)("==%u== cstracer: Instructions = %llu\n", pid, instructions);
 
-	if (!tracing_done) {
-		VG_(close)(fd);
-	}
+	if (phases)
+		phase_fini();
+	else if (!tracing_done)
+		close_trace();
 	/* end tracing */
 }
 
@@ -1277,6 +2312,8 @@ static void ct_pre_clo_init(void) {
 	VG_(basic_tool_funcs)(ct_post_clo_init, ct_instrument, ct_fini);
 	VG_(needs_command_line_options)
 	(ct_process_cmd_line_option, ct_print_usage, ct_print_debug_usage);
+	VG_(needs_persistent_translations)(ct_option_is_keyed);
+	VG_(needs_no_debuginfo)();
 }
 
 VG_DETERMINE_INTERFACE_VERSION(ct_pre_clo_init)
@@ -0,0 +1,429 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Measures the speed of the trace record encoder and decoder   ---*/
+/*---                                                ct_recbench.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   Copyright (C) 2020 Siddharth Jayashankar
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+// Usage: ct_recbench [options] [trace]
+//
+// Runs the record encoder and decoder of ct_record.h, as compiled into
+// cstracer, over a stream of instructions and prints how many records and
+// bytes a second each gets through.  The stream is either a synthetic one
+// or the instruction records of a trace written by cstracer.  A trace with
+// a CSTRACE header gives its own format; the repeat, page and memory write
+// records in it are skipped, so a --compress-loops trace only gives the
+// instructions it holds literally.
+//
+// The encoder is timed as the tool runs it: each record is built in a
+// local buffer and copied to a 64KB output buffer, which is thrown away
+// instead of being written out.  The decoder finds the layout of each
+// record and unpacks it, as a reader of the trace would.
+//
+// With --check nothing is timed.  Instead every record is decoded, unpacked
+// and encoded again, and the program fails unless each time the same
+// layout comes out.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CT_MEMCPY memcpy
+#include "ct_record.h"
+
+/* As in ct_main.c */
+#define OUT_BUF_SIZE (1 << 16)
+
+typedef struct {
+	trace_instr_format_t inst;
+	uint8_t d_valid[NUM_INSTR_DESTINATIONS];
+	uint8_t s_valid[NUM_INSTR_SOURCES];
+	uint16_t st_size[NUM_INSTR_DESTINATIONS];
+} bench_instr_t;
+
+static const struct {
+	const char *name;
+	uint32_t flags;
+} formats[] = {
+	{"champsim", 0},
+	{"champsim-values", CT_HDR_VALUES},
+	{"image", CT_HDR_VALUES | CT_HDR_IMAGE},
+};
+
+static uint32_t flags = CT_HDR_VALUES;
+static const char *format_name = "champsim-values";
+
+static bench_instr_t *instrs;
+static size_t n_instrs;
+
+/* The encoded stream, which the decoder is timed on */
+static uint8_t *stream;
+static size_t stream_len;
+
+/* The values of every record, whose contents do not matter here */
+static trace_values_t vals;
+
+static uint8_t out_buf[OUT_BUF_SIZE];
+static volatile uint64_t sink;
+
+static void die(const char *msg) {
+	fprintf(stderr, "ct_recbench: %s\n", msg);
+	exit(1);
+}
+
+static void *xmalloc(size_t n) {
+	void *p = malloc(n ? n : 1);
+	if (!p)
+		die("out of memory");
+	return p;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*------------------------------------------------------------*/
+/*--- Streams                                              ---*/
+/*------------------------------------------------------------*/
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t rnd(uint32_t n) {
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return (uint32_t)(rng >> 32) % n;
+}
+
+/* A stream with a mix of operands like that of compiled integer code:
+ * about 30% of the instructions load, 12% store and 15% branch. */
+static void make_synthetic(size_t n) {
+	static const uint16_t sizes[] = {1, 2, 4, 8, 8, 8, 16, 32};
+	uint64_t ip = 0x400000, sp = 0x7ff000000ULL, heap = 0x10000000ULL;
+	size_t k;
+	int i;
+
+	instrs = xmalloc(n * sizeof(*instrs));
+	n_instrs = n;
+	for (k = 0; k < n; k++) {
+		bench_instr_t *b = &instrs[k];
+		uint32_t r		 = rnd(100);
+		memset(b, 0, sizeof(*b));
+		b->inst.ip = ip;
+		ip += 1 + rnd(7);
+		for (i = 0; i < 1 + (int)rnd(2); i++)
+			b->inst.destination_registers[i] = 1 + rnd(60);
+		for (i = 0; i < 1 + (int)rnd(3); i++)
+			b->inst.source_registers[i] = 1 + rnd(60);
+		if (r < 30) {
+			b->inst.source_memory[0] = rnd(2) ? sp - 8 * rnd(64)
+											  : heap + 8 * rnd(1 << 20);
+			b->s_valid[0] = 1;
+			if (rnd(10) == 0) {
+				b->inst.source_memory[1] = b->inst.source_memory[0] + 64;
+				b->s_valid[1]			 = 1;
+			}
+		} else if (r < 42) {
+			b->inst.destination_memory[0] = rnd(2) ? sp - 8 * rnd(64)
+												   : heap + 8 * rnd(1 << 20);
+			b->d_valid[0] = 1;
+			b->st_size[0] = sizes[rnd(8)];
+		} else if (r < 57) {
+			b->inst.is_branch	 = 1;
+			b->inst.branch_taken = rnd(10) < 6;
+			if (b->inst.branch_taken)
+				ip = 0x400000 + rnd(1 << 16);
+		}
+	}
+}
+
+/* Reads the instruction records of a trace, skipping the others */
+static void read_trace(const char *name) {
+	trace_header_t hdr;
+	ct_layout_t lay;
+	trace_values_t v;
+	uint8_t *p, *end;
+	uint16_t key;
+	size_t size, cap = 1 << 16;
+	FILE *f;
+	int n;
+
+	f = fopen(name, "rb");
+	if (!f || fseek(f, 0, SEEK_END) != 0)
+		die("cannot open the trace");
+	size = ftell(f);
+	rewind(f);
+	p = xmalloc(size);
+	if (fread(p, 1, size, f) != size)
+		die("cannot read the trace");
+	fclose(f);
+	end = p + size;
+
+	if (size >= sizeof(hdr) &&
+		memcmp(p, CT_HDR_MAGIC, sizeof(CT_HDR_MAGIC)) == 0) {
+		memcpy(&hdr, p, sizeof(hdr));
+		flags = hdr.flags & (CT_HDR_VALUES | CT_HDR_IMAGE);
+		format_name = flags & CT_HDR_IMAGE	  ? "image"
+					  : flags & CT_HDR_VALUES ? "champsim-values"
+											  : "champsim";
+		p += sizeof(hdr);
+	}
+
+	memset(&v, 0, sizeof(v));
+	instrs	 = xmalloc(cap * sizeof(*instrs));
+	n_instrs = 0;
+	while (end - p >= 2) {
+		memcpy(&key, p, 2);
+		if (key == CT_KEY_REPEAT) {
+			uint16_t ns;
+			if (end - p < 10)
+				break;
+			memcpy(&ns, p + 8, 2);
+			p += 10 + 8 * (size_t)ns;
+			continue;
+		} else if (key == CT_KEY_PAGE) {
+			p += 2 + 8 + CT_PAGE_SIZE;
+			continue;
+		} else if (key == CT_KEY_MEMWRITE) {
+			uint32_t len;
+			if (end - p < 14)
+				break;
+			memcpy(&len, p + 10, 4);
+			p += 14 + (size_t)len;
+			continue;
+		} else if (key & CT_KEY_REPEAT) {
+			die("unknown control record");
+		}
+		n = ct_decode_record(p, end - p, flags, &lay);
+		if (n == 0)
+			break;
+		if (n < 0)
+			die("bad record, is --format right?");
+		if (n_instrs == cap) {
+			cap *= 2;
+			instrs = realloc(instrs, cap * sizeof(*instrs));
+			if (!instrs)
+				die("out of memory");
+		}
+		bench_instr_t *b = &instrs[n_instrs++];
+		ct_unpack_record(p, &lay, flags, &b->inst, &v);
+		memcpy(b->d_valid, v.d_valid, sizeof(b->d_valid));
+		memcpy(b->s_valid, v.s_valid, sizeof(b->s_valid));
+		memcpy(b->st_size, v.st_size, sizeof(b->st_size));
+		p += n;
+	}
+	if (n_instrs == 0)
+		die("no instruction records in the trace");
+}
+
+/*------------------------------------------------------------*/
+/*--- Encoding and decoding                                ---*/
+/*------------------------------------------------------------*/
+
+static CT_INLINE void set_values(const bench_instr_t *b) {
+	memcpy(vals.d_valid, b->d_valid, sizeof(vals.d_valid));
+	memcpy(vals.s_valid, b->s_valid, sizeof(vals.s_valid));
+	memcpy(vals.st_size, b->st_size, sizeof(vals.st_size));
+}
+
+/* One pass of the encoder over the stream, for a format known at compile
+ * time as it is in the tool.  If keep, the records are also appended to
+ * stream. */
+static CT_INLINE size_t encode_all(uint32_t fl, int keep) {
+	uint8_t buffer[CT_MAX_RECORD];
+	size_t k, total = 0;
+	uint32_t used = 0, len;
+
+	for (k = 0; k < n_instrs; k++) {
+		if (fl & CT_HDR_VALUES)
+			set_values(&instrs[k]);
+		len = ct_encode_record(buffer, &instrs[k].inst, &vals, fl, NULL);
+		if (used + len > OUT_BUF_SIZE) {
+			sink += out_buf[used - 1];
+			used = 0;
+		}
+		memcpy(out_buf + used, buffer, len);
+		used += len;
+		if (keep)
+			memcpy(stream + total, buffer, len);
+		total += len;
+	}
+	return total;
+}
+
+static size_t encode_champsim(int keep) { return encode_all(0, keep); }
+static size_t encode_values(int keep) {
+	return encode_all(CT_HDR_VALUES, keep);
+}
+static size_t encode_image(int keep) {
+	return encode_all(CT_HDR_VALUES | CT_HDR_IMAGE, keep);
+}
+
+static size_t encode_stream(int keep) {
+	if (flags & CT_HDR_IMAGE)
+		return encode_image(keep);
+	if (flags & CT_HDR_VALUES)
+		return encode_values(keep);
+	return encode_champsim(keep);
+}
+
+static size_t decode_stream(void) {
+	trace_instr_format_t inst;
+	ct_layout_t lay;
+	size_t pos = 0, n = 0;
+	uint64_t sum = 0;
+	int len;
+
+	while (pos < stream_len) {
+		len = ct_decode_record(stream + pos, stream_len - pos, flags, &lay);
+		if (len <= 0)
+			die("cannot decode the encoded stream");
+		ct_unpack_record(stream + pos, &lay, flags, &inst, &vals);
+		sum += inst.ip;
+		pos += len;
+		n++;
+	}
+	sink += sum;
+	return n;
+}
+
+/* Each record, decoded, unpacked and encoded again, has the same layout */
+static int check_stream(void) {
+	trace_instr_format_t inst;
+	trace_values_t v;
+	ct_layout_t lay, lay2;
+	uint8_t buffer[CT_MAX_RECORD];
+	size_t pos = 0, n = 0, bad = 0;
+	int len;
+
+	memset(&v, 0, sizeof(v));
+	while (pos < stream_len) {
+		len = ct_decode_record(stream + pos, stream_len - pos, flags, &lay);
+		if (len <= 0) {
+			fprintf(stderr, "ct_recbench: record %zu does not decode\n", n);
+			return 1;
+		}
+		ct_unpack_record(stream + pos, &lay, flags, &inst, &v);
+		ct_encode_record(buffer, &inst, &v, flags, &lay2);
+		if (inst.ip != instrs[n].inst.ip || lay2.len != lay.len ||
+			lay2.n_addrs != lay.n_addrs ||
+			memcmp(lay2.aoff, lay.aoff, lay.n_addrs * sizeof(lay.aoff[0])) ||
+			memcmp(buffer, stream + pos, 10) != 0) {
+			if (bad++ < 10)
+				fprintf(stderr, "ct_recbench: record %zu differs\n", n);
+		}
+		pos += len;
+		n++;
+	}
+	if (n != n_instrs) {
+		fprintf(stderr, "ct_recbench: %zu records decoded, %zu encoded\n", n,
+				n_instrs);
+		return 1;
+	}
+	printf("ct_recbench: %zu records checked, %zu bad\n", n, bad);
+	return bad != 0;
+}
+
+static void report(const char *what, double t, size_t records) {
+	printf("%-8s %8.2f M records/s %9.1f MB/s\n", what, records / t / 1e6,
+		   stream_len / t / 1e6);
+}
+
+int main(int argc, char **argv) {
+	const char *trace = NULL;
+	size_t n_records = 1000000;
+	int reps = 5, check = 0, i;
+	unsigned int f;
+	double t, best_enc = 1e30, best_dec = 1e30;
+
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+		if (strncmp(a, "--format=", 9) == 0) {
+			for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+				if (strcmp(a + 9, formats[f].name) == 0)
+					break;
+			if (f == sizeof(formats) / sizeof(formats[0]))
+				die("unknown --format");
+			flags		= formats[f].flags;
+			format_name = formats[f].name;
+		} else if (strncmp(a, "--records=", 10) == 0) {
+			n_records = strtoull(a + 10, NULL, 0);
+		} else if (strncmp(a, "--reps=", 7) == 0) {
+			reps = atoi(a + 7);
+		} else if (strcmp(a, "--check") == 0) {
+			check = 1;
+		} else if (a[0] != '-' && !trace) {
+			trace = a;
+		} else {
+			fprintf(stderr,
+					"usage: ct_recbench [--format=champsim|champsim-values|"
+					"image]\n"
+					"                   [--records=<n>] [--reps=<n>] "
+					"[--check] [trace]\n");
+			return 1;
+		}
+	}
+	if (reps < 1 || n_records == 0)
+		die("--records and --reps must be positive");
+
+	if (trace)
+		read_trace(trace);
+	else
+		make_synthetic(n_records);
+	memset(&vals, 0x5a, sizeof(vals));
+
+	/* The first pass sizes the stream, the second fills it */
+	stream_len = encode_stream(0);
+	stream	   = xmalloc(stream_len);
+	encode_stream(1);
+
+	printf("ct_recbench: %zu %s records from %s, %.1f bytes each\n",
+		   n_instrs, format_name, trace ? trace : "a synthetic stream",
+		   (double)stream_len / n_instrs);
+	if (check)
+		return check_stream();
+
+	for (i = 0; i < reps; i++) {
+		t = now();
+		encode_stream(0);
+		t = now() - t;
+		if (t < best_enc)
+			best_enc = t;
+		t = now();
+		decode_stream();
+		t = now() - t;
+		if (t < best_dec)
+			best_dec = t;
+	}
+	report("encode", best_enc, n_instrs);
+	report("decode", best_dec, n_instrs);
+	return 0;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                            ct_recbench.c ---*/
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,356 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Encoding and decoding of cstracer trace records              ---*/
+/*---                                                  ct_record.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   Copyright (C) 2020 Siddharth Jayashankar
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+// The keyed instruction records and the trace header, shared by the
+// tool (ct_main.c), which encodes them, and by the native programs that
+// read them back (ct_expand.c, ct_recbench.c).  Everything here is
+// static inline and uses no libc, so the same code is compiled into the
+// tool and natively.  Define CT_MEMCPY before including this file, to
+// VG_(memcpy) in the tool and to memcpy elsewhere.
+//
+// An instruction record is
+//
+//   key (2), ip (8),
+//   a register (4) for each bit of DEST_REG_BITS in key,
+//   a store for each bit of DEST_MEM_BITS,
+//   a register (4) for each bit of SOURCE_REG_BITS,
+//   a load for each bit of SOURCE_MEM_BITS,
+//
+// where a store or a load is its address (8), followed with CT_HDR_VALUES
+// by the cache line it touched (64).  With CT_HDR_IMAGE a store is
+// instead followed by its size (2) and the bytes it wrote, and a load by
+// nothing.  The set bits of each field of the key are the lowest ones.
+// Keys with CT_KEY_REPEAT set are control records, see ct_main.c.
+
+#ifndef __CT_RECORD_H
+#define __CT_RECORD_H
+
+#include <stdint.h>
+
+#ifndef CT_MEMCPY
+#error "CT_MEMCPY must be defined before including ct_record.h"
+#endif
+
+#define CT_INLINE inline __attribute__((always_inline))
+
+/* For ChampSim Traces*/
+#define NUM_INSTR_DESTINATIONS 2
+#define NUM_INSTR_SOURCES 4
+#define CACHE_POW 6
+#define CACHE_LINE_SIZE 64
+
+/* Largest store whose bytes a CT_HDR_IMAGE record carries */
+#define MAX_DSIZE 512
+
+#define INST_IS_BRANCH_MASK 0x2000U
+#define INST_BRANCH_TAKEN_MASK 0x1000U
+#define DEST_REG_MASK 0x400U
+#define DEST_MEM_MASK 0x100U
+#define SOURCE_REG_MASK 0x10U
+#define SOURCE_MEM_MASK 0x1U
+
+#define DEST_REG_BITS 0x0c00U
+#define DEST_MEM_BITS 0x0300U
+#define SOURCE_REG_BITS 0x00f0U
+#define SOURCE_MEM_BITS 0x000fU
+
+#define CT_MAX_RECORD 1152
+#define CT_MAX_ADDRS (NUM_INSTR_DESTINATIONS + NUM_INSTR_SOURCES)
+
+/* Traces in any format other than the plain ChampSim one start with this
+ * header, so that ct_expand can tell how to decode them. */
+#define CT_HDR_MAGIC "CSTRACE"
+#define CT_HDR_VERSION 1
+#define CT_HDR_VALUES 0x1U
+#define CT_HDR_LOOPS 0x2U
+#define CT_HDR_IMAGE 0x4U
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+} trace_header_t;
+
+/* The keys of the control records */
+#define CT_KEY_REPEAT 0x8000U
+#define CT_KEY_PAGE 0x8001U
+#define CT_KEY_MEMWRITE 0x8002U
+#define CT_PAGE_POW 12
+#define CT_PAGE_SIZE (1UL << CT_PAGE_POW)
+
+typedef struct {
+	uint64_t ip; // instruction pointer (program counter) value
+
+	uint8_t is_branch;	// is this branch
+	uint8_t branch_taken; // if so, is this taken
+
+	uint8_t destination_registers[NUM_INSTR_DESTINATIONS]; // output registers
+	uint8_t source_registers[NUM_INSTR_SOURCES];		   // input registers
+
+	uint64_t destination_memory[NUM_INSTR_DESTINATIONS]; // output memory
+	uint64_t source_memory[NUM_INSTR_SOURCES];			 // input memory
+} trace_instr_format_t;
+
+/* Memory values of the current instruction, only used by the
+ * champsim-values format so the plain one does not have to clear them.
+ * st_size and st_data are the bytes written by the stores, used instead
+ * of d_value with CT_HDR_IMAGE. */
+typedef struct {
+	uint8_t d_valid[NUM_INSTR_DESTINATIONS];
+	uint8_t d_value[NUM_INSTR_DESTINATIONS]
+				   [CACHE_LINE_SIZE]; // data in cache block
+									  // to which store took place
+	uint8_t s_valid[NUM_INSTR_SOURCES];
+	uint8_t s_value[NUM_INSTR_SOURCES][CACHE_LINE_SIZE]; // data in cache block
+	uint16_t st_size[NUM_INSTR_DESTINATIONS];
+	uint8_t st_data[NUM_INSTR_DESTINATIONS][MAX_DSIZE];
+} trace_values_t;
+
+/* Where things are in an encoded record: its length, and the offsets of
+ * its memory addresses, stores first */
+typedef struct {
+	uint32_t len;
+	uint32_t n_addrs;
+	uint16_t aoff[CT_MAX_ADDRS];
+} ct_layout_t;
+
+/* Encodes inst into buf, which must hold CT_MAX_RECORD bytes, and returns
+ * the length of the record.  vals is only read with CT_HDR_VALUES in
+ * flags.  The offsets of the addresses are noted in lay, if it is not
+ * NULL.  With constant flags the checks on them are folded away. */
+static CT_INLINE uint32_t ct_encode_record(uint8_t *buffer,
+										   const trace_instr_format_t *inst,
+										   const trace_values_t *vals,
+										   uint32_t flags, ct_layout_t *lay) {
+	const int values = (flags & CT_HDR_VALUES) != 0;
+	const int image	 = (flags & CT_HDR_IMAGE) != 0;
+	uint32_t index	 = 0;
+	uint32_t encode_key = 0;
+	uint32_t n_addrs = 0;
+	if(inst->is_branch) {
+		encode_key |= INST_IS_BRANCH_MASK;
+	}
+	if (inst->branch_taken) {
+		encode_key |= INST_BRANCH_TAKEN_MASK;
+	}
+	index = 2;
+	CT_MEMCPY(buffer + index, &inst->ip, 8);
+	index += 8;
+	uint32_t mask = DEST_REG_MASK;
+	for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+		if(inst->destination_registers[i] != 0) {
+			encode_key |= mask;
+			mask = mask << 1;
+			CT_MEMCPY(buffer + index, &(inst->destination_registers[i]), 4);
+			index += 4;
+		}
+	}
+
+	mask = DEST_MEM_MASK;
+	for (int i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+		if (values ? vals->d_valid[i] : inst->destination_memory[i] != 0) {
+			encode_key |= mask;
+			mask = mask << 1;
+			if (lay)
+				lay->aoff[n_addrs] = index;
+			n_addrs++;
+			CT_MEMCPY(buffer + index, &(inst->destination_memory[i]), 8);
+			index += 8;
+			if (values && image) {
+				CT_MEMCPY(buffer + index, &vals->st_size[i], 2);
+				index += 2;
+				CT_MEMCPY(buffer + index, vals->st_data[i], vals->st_size[i]);
+				index += vals->st_size[i];
+			} else if (values) {
+				CT_MEMCPY(buffer + index, &(vals->d_value[i]), 64);
+				index += 64;
+			}
+		}
+	}
+
+	mask = SOURCE_REG_MASK;
+	for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
+		if(inst->source_registers[i] != 0) {
+			encode_key |= mask;
+			mask = mask << 1;
+			CT_MEMCPY(buffer + index, &(inst->source_registers[i]), 4);
+			index += 4;
+		}
+	}
+	mask = SOURCE_MEM_MASK;
+	for (int i = 0; i < NUM_INSTR_SOURCES; i++) {
+		if (values ? vals->s_valid[i] : inst->source_memory[i] != 0) {
+			encode_key |= mask;
+			mask = mask << 1;
+			if (lay)
+				lay->aoff[n_addrs] = index;
+			n_addrs++;
+			CT_MEMCPY(buffer + index, &(inst->source_memory[i]), 8);
+			index += 8;
+			if (values && !image) {
+				CT_MEMCPY(buffer + index, &(vals->s_value[i]), 64);
+				index += 64;
+			}
+		}
+	}
+	uint16_t encode_key_write = (uint16_t) encode_key;
+	CT_MEMCPY(buffer, &encode_key_write, 2);
+	if (lay) {
+		lay->len	 = index;
+		lay->n_addrs = n_addrs;
+	}
+	return index;
+}
+
+static CT_INLINE uint32_t ct_popcount(uint32_t x) {
+	uint32_t n = 0;
+	for (; x; x &= x - 1)
+		n++;
+	return n;
+}
+
+/* Finds the layout of the instruction record at p, of which avail bytes
+ * are there, and returns its length.  If avail is too short it returns 0
+ * and sets lay->len to the number of bytes needed to get further, so a
+ * reader of a stream can call it again once it has read that many.
+ * Returns -1 for a record that cannot be right. */
+static inline int ct_decode_record(const uint8_t *p, uint32_t avail,
+								   uint32_t flags, ct_layout_t *lay) {
+	const int image		  = (flags & CT_HDR_IMAGE) != 0;
+	const uint32_t l_size = (flags & CT_HDR_VALUES) && !image
+								? 8 + CACHE_LINE_SIZE
+								: 8;
+	uint16_t key;
+	uint32_t i, n, len;
+
+	lay->n_addrs = 0;
+	if (avail < 2) {
+		lay->len = 2;
+		return 0;
+	}
+	CT_MEMCPY(&key, p, 2);
+	if (key & CT_KEY_REPEAT)
+		return -1;
+	len = 2 + 8 + 4 * ct_popcount(key & DEST_REG_BITS);
+
+	n = ct_popcount(key & DEST_MEM_BITS);
+	for (i = 0; i < n; i++) {
+		lay->aoff[lay->n_addrs++] = len;
+		if (image) {
+			uint16_t size;
+			if (avail < len + 10) {
+				lay->len = len + 10;
+				return 0;
+			}
+			CT_MEMCPY(&size, p + len + 8, 2);
+			if (size > MAX_DSIZE)
+				return -1;
+			len += 10 + size;
+		} else {
+			len += l_size;
+		}
+	}
+
+	len += 4 * ct_popcount(key & SOURCE_REG_BITS);
+	n = ct_popcount(key & SOURCE_MEM_BITS);
+	for (i = 0; i < n; i++) {
+		lay->aoff[lay->n_addrs++] = len;
+		len += l_size;
+	}
+
+	lay->len = len;
+	return avail < len ? 0 : (int)len;
+}
+
+/* Fills inst, and with CT_HDR_VALUES vals, from the record at p with
+ * layout lay.  The registers and memory operands are packed into the
+ * first slots, so encoding inst again gives a record of the same layout. */
+static inline void ct_unpack_record(const uint8_t *p, const ct_layout_t *lay,
+									uint32_t flags, trace_instr_format_t *inst,
+									trace_values_t *vals) {
+	const int values = (flags & CT_HDR_VALUES) != 0;
+	const int image	 = (flags & CT_HDR_IMAGE) != 0;
+	uint16_t key;
+	uint32_t i, n, n_dmem, pos;
+
+	CT_MEMCPY(&key, p, 2);
+	CT_MEMCPY(&inst->ip, p + 2, 8);
+	inst->is_branch	   = (key & INST_IS_BRANCH_MASK) != 0;
+	inst->branch_taken = (key & INST_BRANCH_TAKEN_MASK) != 0;
+	pos				   = 10;
+
+	n = ct_popcount(key & DEST_REG_BITS);
+	for (i = 0; i < NUM_INSTR_DESTINATIONS; i++)
+		inst->destination_registers[i] = i < n ? p[pos + 4 * i] : 0;
+	n_dmem = ct_popcount(key & DEST_MEM_BITS);
+	for (i = 0; i < NUM_INSTR_DESTINATIONS; i++) {
+		inst->destination_memory[i] = 0;
+		if (values)
+			vals->d_valid[i] = i < n_dmem;
+		if (i >= n_dmem)
+			continue;
+		pos = lay->aoff[i];
+		CT_MEMCPY(&inst->destination_memory[i], p + pos, 8);
+		if (values && image) {
+			CT_MEMCPY(&vals->st_size[i], p + pos + 8, 2);
+			CT_MEMCPY(vals->st_data[i], p + pos + 10, vals->st_size[i]);
+		} else if (values) {
+			CT_MEMCPY(vals->d_value[i], p + pos + 8, CACHE_LINE_SIZE);
+		}
+	}
+
+	/* The source registers follow the last store */
+	pos = 10 + 4 * n;
+	if (n_dmem > 0) {
+		pos = lay->aoff[n_dmem - 1] + 8;
+		if (values && image)
+			pos += 2 + vals->st_size[n_dmem - 1];
+		else if (values)
+			pos += CACHE_LINE_SIZE;
+	}
+	n = ct_popcount(key & SOURCE_REG_BITS);
+	for (i = 0; i < NUM_INSTR_SOURCES; i++)
+		inst->source_registers[i] = i < n ? p[pos + 4 * i] : 0;
+	n = ct_popcount(key & SOURCE_MEM_BITS);
+	for (i = 0; i < NUM_INSTR_SOURCES; i++) {
+		inst->source_memory[i] = 0;
+		if (values)
+			vals->s_valid[i] = i < n;
+		if (i >= n)
+			continue;
+		pos = lay->aoff[n_dmem + i];
+		CT_MEMCPY(&inst->source_memory[i], p + pos, 8);
+		if (values && !image)
+			CT_MEMCPY(vals->s_value[i], p + pos + 8, CACHE_LINE_SIZE);
+	}
+}
+
+#endif /* ndef __CT_RECORD_H */
+
+/*--------------------------------------------------------------------*/
+/*--- end                                              ct_record.h ---*/
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,25 @@
+/* Loops over arrays with no data dependent branches, so that
+   --compress-loops=yes replaces most of their iterations by repeat
+   records, and with stores to be rebuilt by --mem-values=image. */
+#include <stdio.h>
+
+#define N 4096
+
+static unsigned int a[N], b[N];
+
+int main(void)
+{
+   unsigned int s = 0;
+   int i, round;
+
+   for (round = 0; round < 50; round++) {
+      for (i = 0; i < N; i++)
+         a[i] = a[i] * 7 + i + round;
+      for (i = 0; i < N - 1; i += 2)
+         b[i] = a[i] ^ b[i + 1];
+      for (i = 0; i < N; i++)
+         s += b[i];
+   }
+   printf("%08x\n", s);
+   return 0;
+}
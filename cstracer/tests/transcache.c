@@ -0,0 +1,28 @@
+/* Some deterministic work, for the --translation-cache runs to trace
+   well past the start-up code. */
+#include <stdio.h>
+
+#define N 4096
+
+static unsigned int data[N];
+
+static unsigned int mix(unsigned int h, unsigned int v)
+{
+   h ^= v;
+   h *= 16777619u;
+   return h;
+}
+
+int main(void)
+{
+   unsigned int h = 2166136261u;
+   int i, round;
+
+   for (i = 0; i < N; i++)
+      data[i] = i * 2654435761u;
+   for (round = 0; round < 100; round++)
+      for (i = 0; i < N; i++)
+         h = (data[i] & 1) ? mix(h, data[i]) : mix(h, ~data[i]);
+   printf("%08x\n", h);
+   return 0;
+}
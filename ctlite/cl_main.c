@@ -69,16 +69,27 @@
 
 #include "pub_tool_basics.h"
 #include "pub_tool_debuginfo.h"
+#include "pub_tool_gdbserver.h" // VG_(gdb_printf)
+#include "pub_tool_hashtable.h"
+#include "pub_tool_icount.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcfile.h"
 #include "pub_tool_libcproc.h"
 #include "pub_tool_libcprint.h"
 #include "pub_tool_machine.h" // VG_(fnptr_to_fnentry)
+#include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
+#include "pub_tool_sparsewa.h"
 #include "pub_tool_threadstate.h" // VG_(get_running_tid)()
 #include "pub_tool_tooliface.h"
 
+#include "ctlite.h"
+
+#if defined(VGA_arm64)
+#include "libvex_guest_arm64.h" // guest_X30
+#endif
+
 #include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -107,8 +118,26 @@ static unsigned long long int IMask = (1 << 12) - 1;
 // Print Heartbeat after --heartbeat= instructions
 static unsigned long long int heartbeat = 100000000;
 
-static unsigned int Imap[IMAP_SIZE];
-static unsigned int Mmap[MMAP_SIZE];
+// Exact line/page/2MB footprints per heartbeat --footprint=yes|no
+static Bool clo_footprint = False;
+
+// Reuse distances of 1 in --mrc-sample= lines, 0 for none
+static UInt clo_mrc_sample = 0;
+
+// Per-branch statistics and predictor MPKI --branch-stats=yes|no
+static Bool clo_branch_stats = False;
+
+// Classify load PCs by address pattern --load-strides=yes|no
+static Bool clo_load_strides = False;
+
+// Instruction mix per heartbeat --instr-mix=yes|no
+static Bool clo_instr_mix = False;
+
+// Output layout --format=raw|series
+static enum { FormatRaw, FormatSeries } clo_format = FormatRaw;
+
+// Separate counters for each thread --per-thread=yes|no
+static Bool clo_per_thread = False;
 
 static Bool cl_process_cmd_line_option(const HChar *arg) {
 	if
@@ -119,6 +148,22 @@ static Bool cl_process_cmd_line_option(const HChar *arg) {
 		VG_INT_CLO(arg, "--code-size", IShiftSize) {}
 	else if
 		VG_INT_CLO(arg, "--heartbeat", heartbeat) {}
+	else if
+		VG_BOOL_CLO(arg, "--footprint", clo_footprint) {}
+	else if
+		VG_INT_CLO(arg, "--mrc-sample", clo_mrc_sample) {}
+	else if
+		VG_BOOL_CLO(arg, "--branch-stats", clo_branch_stats) {}
+	else if
+		VG_BOOL_CLO(arg, "--load-strides", clo_load_strides) {}
+	else if
+		VG_BOOL_CLO(arg, "--instr-mix", clo_instr_mix) {}
+	else if
+		VG_XACT_CLO(arg, "--format=raw", clo_format, FormatRaw) {}
+	else if
+		VG_XACT_CLO(arg, "--format=series", clo_format, FormatSeries) {}
+	else if
+		VG_BOOL_CLO(arg, "--per-thread", clo_per_thread) {}
 	else
 		return False;
 
@@ -135,7 +180,20 @@ static void cl_print_usage(void) {
 	VG_(printf)
 	("    --trace-file=<file>        Trace File Name\n"
 	 "    --mem-size=<num>        	Log Size of Memory Region To Track\n"
-	 "    --code-size=<num>        	Log Size of Code Region To Track\n");
+	 "    --code-size=<num>        	Log Size of Code Region To Track\n"
+	 "    --footprint=no|yes        	Count the distinct lines, pages and 2MB\n"
+	 "                              	regions touched in each heartbeat [no]\n"
+	 "    --mrc-sample=<num>        	Miss ratio curve from the reuse distances\n"
+	 "                              	of 1 in <num> lines, 0 for none [0]\n"
+	 "    --branch-stats=no|yes     	Per-branch counts and bimodal/gshare\n"
+	 "                              	mispredicts per heartbeat [no]\n"
+	 "    --load-strides=no|yes     	Classify loads as strided, pointer\n"
+	 "                              	chasing or irregular [no]\n"
+	 "    --instr-mix=no|yes        	Count instructions by class [no]\n"
+	 "    --format=raw|series       	Raw arrays, or a self-describing file\n"
+	 "                              	of varint records (see cl_read.py) [raw]\n"
+	 "    --per-thread=no|yes       	Count instructions, memory, code and\n"
+	 "                              	branches of each thread apart [no]\n");
 }
 
 static void cl_print_debug_usage(void) { VG_(printf)(" (none)\n"); }
@@ -143,72 +201,1170 @@ static void cl_print_debug_usage(void) { VG_(printf)(" (none)\n"); }
 /*------------------------------------------------------------*/
 /*--- Tracing                                              ---*/
 /*------------------------------------------------------------*/
+// VG_(icount_now)() when last brought up to date by counters_sync()
 static unsigned long long int instructions = 0;
-static unsigned int TBranches = 0;
-static unsigned int UBranches = 0;
+static unsigned long long int interval_start = 0; // instructions at its start
+
+// The memory and code windows and branch counts of one thread, or of the
+// whole process without --per-thread.  The instrumentation updates the
+// set of the running thread, 'cur'.
+typedef struct _counters_t {
+	struct _counters_t *next; // in order of creation
+	ThreadId tid;
+	Bool exited; // free it at the end of the interval
+	ULong insts; // in this interval, up to the last counters_sync()
+	unsigned int Imap[IMAP_SIZE];
+	unsigned int Mmap[MMAP_SIZE];
+	unsigned int TBranches;
+	unsigned int UBranches;
+} counters_t;
+
+static counters_t process_counters;
+static counters_t *counters = &process_counters;
+static counters_t **thread_counters; // by ThreadId, with --per-thread
+static counters_t *cur = &process_counters;
 
 static int fd;
 static UInt pid;
 typedef IRExpr IRAtom;
 
-static VG_REGPARM(2) void trace_instr(Addr iaddr, SizeT size) {
-	instructions++;
-	iaddr = iaddr >> IShiftSize;
-	Imap[iaddr % IMAP_SIZE]++;
-	if(instructions % heartbeat == 0) {
-		VG_(printf)
-		("==%u== ctlite: Heartbeat : %llu instructions\n", pid, instructions);
-		VG_(write)(fd, &instructions, sizeof(instructions));
-		VG_(write)(fd, Mmap, MMAP_SIZE*sizeof(unsigned int));
-		VG_(write)(fd, Imap, IMAP_SIZE*sizeof(unsigned int));
-		VG_(write)(fd, &TBranches, sizeof(TBranches));
-		VG_(write)(fd, &UBranches, sizeof(UBranches));
-		
-		VG_(memset)( Mmap, 0, MMAP_SIZE*sizeof(unsigned int));
-		VG_(memset)( Imap, 0, IMAP_SIZE*sizeof(unsigned int));
-		VG_(memset)( &TBranches, 0, sizeof(TBranches));
-		VG_(memset)( &UBranches, 0, sizeof(UBranches));
+#if defined(VG_BIGENDIAN)
+#define END Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+#define END Iend_LE
+#else
+#error "Unknown endianness"
+#endif
+
+// What to do with the counters of the current interval.  A heartbeat does
+// all three; client requests and monitor commands can do any of them.
+#define IV_PRINT 1 // summarise them
+#define IV_WRITE 2 // append them to the trace file
+#define IV_RESET 4 // start a new interval
+
+// Summaries go to the log, or to gdb for a monitor command.
+static UInt (*cl_printf)(const HChar *format, ...) = VG_(printf);
+
+/*------------------------------------------------------------*/
+/*--- Output                                               ---*/
+/*------------------------------------------------------------*/
+
+// Everything written to the trace file goes through out_buf.
+//
+// --format=raw writes each column's array as it is in memory, so the
+// layout depends on the options and the build.  --format=series starts
+// with "CLSERIES", then a varint length and a text schema: "key value"
+// lines for the settings, and one "column <name> <u32|u64> <n>
+// <dense|sparse>" line per column in record order.  Each heartbeat is a
+// varint length and a record in which every value is an unsigned LEB128
+// varint; a sparse column is a count of nonzero entries followed by
+// (index delta, value) pairs.  The schema is written with the first
+// record, as the columns are only known once every module has emitted.
+#define OUT_BUF_SIZE (1 << 16)
+#define OUT_SCHEMA_SIZE 4096
+
+static UChar out_buf[OUT_BUF_SIZE];
+static Int out_used;
+static HChar out_schema[OUT_SCHEMA_SIZE];
+static Int out_schema_used;
+static Bool out_started;  // schema written
+static UChar *out_rec;	   // record being built, series only
+static SizeT out_rec_used, out_rec_size;
+
+static void out_flush(void) {
+	if (out_used > 0)
+		VG_(write)(fd, out_buf, out_used);
+	out_used = 0;
+}
+
+static void out_bytes(const void *p, SizeT n) {
+	const UChar *b = p;
+	while (n > 0) {
+		SizeT chunk = OUT_BUF_SIZE - out_used;
+		if (chunk > n)
+			chunk = n;
+		VG_(memcpy)(out_buf + out_used, b, chunk);
+		out_used += chunk;
+		b += chunk;
+		n -= chunk;
+		if (out_used == OUT_BUF_SIZE)
+			out_flush();
+	}
+}
+
+static UInt out_encode(UChar *p, ULong v) {
+	UInt n = 0;
+	while (v >= 0x80) {
+		p[n++] = (UChar)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (UChar)v;
+	return n;
+}
+
+static void out_varint(ULong v) {
+	UChar tmp[10];
+	out_bytes(tmp, out_encode(tmp, v));
+}
+
+static void out_rec_varint(ULong v) {
+	if (out_rec_used + 10 > out_rec_size) {
+		out_rec_size = out_rec_size ? 2 * out_rec_size : 4096;
+		out_rec = VG_(realloc)("cl.out.rec", out_rec, out_rec_size);
+	}
+	out_rec_used += out_encode(out_rec + out_rec_used, v);
+}
+
+static void out_schema_add(const HChar *line) {
+	Int len = VG_(strlen)(line);
+	tl_assert(out_schema_used + len < OUT_SCHEMA_SIZE);
+	VG_(strcpy)(out_schema + out_schema_used, line);
+	out_schema_used += len;
+}
+
+// Write the n values of width 4 or 8 bytes at vals as column name.
+static void out_column(const HChar *name, const void *vals, Int n,
+					   Int width, Bool sparse) {
+	HChar line[128];
+	Int i, nz = 0, last = 0;
+
+	if (clo_format == FormatRaw) {
+		out_bytes(vals, n * width);
+		return;
+	}
+
+#define VAL(i) (width == 8 ? ((const ULong *)vals)[i] \
+						   : (ULong)((const UInt *)vals)[i])
+	if (!out_started) {
+		VG_(snprintf)(line, sizeof(line), "column %s u%d %d %s\n", name,
+					  width * 8, n, sparse ? "sparse" : "dense");
+		out_schema_add(line);
+	}
+	if (!sparse) {
+		for (i = 0; i < n; i++)
+			out_rec_varint(VAL(i));
+		return;
+	}
+	for (i = 0; i < n; i++)
+		nz += VAL(i) != 0;
+	out_rec_varint(nz);
+	for (i = 0; i < n; i++) {
+		if (VAL(i) == 0)
+			continue;
+		out_rec_varint(i - last);
+		out_rec_varint(VAL(i));
+		last = i;
+	}
+#undef VAL
+}
+
+static void out_scalar(const HChar *name, ULong v) {
+	out_column(name, &v, 1, 8, False);
+}
+
+static void out_start(void) {
+	out_bytes("CLSERIES", 8);
+	out_varint(out_schema_used);
+	out_bytes(out_schema, out_schema_used);
+	out_started = True;
+}
+
+// End of a heartbeat's columns.
+static void out_record(void) {
+	if (clo_format == FormatRaw)
+		return;
+	if (!out_started)
+		out_start();
+	out_varint(out_rec_used);
+	out_bytes(out_rec, out_rec_used);
+	out_rec_used = 0;
+}
+
+static void out_close(void) {
+	if (clo_format == FormatSeries && !out_started)
+		out_start();
+	out_flush();
+	VG_(close)(fd);
+}
+
+/*------------------------------------------------------------*/
+/*--- Footprints                                           ---*/
+/*------------------------------------------------------------*/
+
+// The set of distinct units (lines, pages, 2MB regions) touched in the
+// current heartbeat.  Unlike Mmap/Imap these are exact: each set is a
+// SparseWA from unit / FP_WORD_BITS to a bitmask of the units seen, so
+// the lines of a page share one entry.
+#define FP_WORD_BITS (8 * sizeof(UWord))
+
+typedef struct {
+	SparseWA *bits;
+	UInt shift;
+	ULong count;
+} footprint_t;
+
+enum { FP_LINE, FP_PAGE, FP_2MB, FP_LEVELS };
+static const UInt fp_shift[FP_LEVELS] = {6, 12, 21};
+
+static footprint_t dfoot[FP_LEVELS]; // data
+static footprint_t ifoot[FP_2MB];    // code: lines and pages
+
+// Direct-mapped filters of lines already counted this interval, checked
+// before the SparseWA lookups.  Emptied (all ones) at each heartbeat.
+#define FP_FILTER_SIZE 1024
+static Addr dfilter[FP_FILTER_SIZE];
+static Addr ifilter[FP_FILTER_SIZE];
+
+static void footprint_reset(footprint_t *fp, Int levels) {
+	Int l;
+	VG_(memset)(fp == dfoot ? dfilter : ifilter, 0xff, sizeof(dfilter));
+	for (l = 0; l < levels; l++) {
+		if (fp[l].bits)
+			VG_(deleteSWA)(fp[l].bits);
+		fp[l].bits = VG_(newSWA)(VG_(malloc), "cl.footprint", VG_(free));
+		fp[l].shift = fp_shift[l];
+		fp[l].count = 0;
+	}
+}
+
+// Add the unit holding addr to fp; True if it is new.
+static Bool footprint_add(footprint_t *fp, Addr addr) {
+	UWord unit = addr >> fp->shift;
+	UWord bit = (UWord)1 << (unit % FP_WORD_BITS);
+	UWord mask;
+
+	if (!VG_(lookupSWA)(fp->bits, &mask, unit / FP_WORD_BITS))
+		mask = 0;
+	if (mask & bit)
+		return False;
+	VG_(addToSWA)(fp->bits, unit / FP_WORD_BITS, mask | bit);
+	fp->count++;
+	return True;
+}
+
+// A new line can only mean a new page, and a new page a new 2MB region,
+// if it is new itself, so most accesses stop after the first lookup.
+static inline void footprint_touch(footprint_t *fp, Int levels, Addr addr) {
+	Int l;
+	for (l = 0; l < levels && footprint_add(&fp[l], addr); l++)
+		;
+}
+
+static inline void footprint_line(footprint_t *fp, Int levels, Addr *filter,
+								  Addr line) {
+	Addr *slot = &filter[line % FP_FILTER_SIZE];
+	if (*slot != line) {
+		*slot = line;
+		footprint_touch(fp, levels, line << fp_shift[FP_LINE]);
+	}
+}
+
+static void footprint_data(Addr addr, SizeT size) {
+	Addr line = addr >> fp_shift[FP_LINE];
+	Addr last = (addr + size - 1) >> fp_shift[FP_LINE];
+
+	for (; line <= last; line++)
+		footprint_line(dfoot, FP_LEVELS, dfilter, line);
+}
+
+static void footprint_interval(UInt what) {
+	ULong counts[5] = {dfoot[FP_LINE].count, dfoot[FP_PAGE].count,
+					   dfoot[FP_2MB].count, ifoot[FP_LINE].count,
+					   ifoot[FP_PAGE].count};
+	if (what & IV_PRINT)
+		cl_printf("==%u== ctlite: Footprint : data %llu lines (%llu KB) "
+				  "%llu pages %llu 2MB, code %llu lines %llu pages\n",
+				  pid, counts[0], counts[0] * 64 / 1024, counts[1], counts[2],
+				  counts[3], counts[4]);
+	if (what & IV_WRITE) {
+		out_scalar("data_lines", counts[0]);
+		out_scalar("data_pages", counts[1]);
+		out_scalar("data_2mb", counts[2]);
+		out_scalar("code_lines", counts[3]);
+		out_scalar("code_pages", counts[4]);
+	}
+	if (what & IV_RESET) {
+		footprint_reset(dfoot, FP_LEVELS);
+		footprint_reset(ifoot, FP_2MB);
+	}
+}
+
+/*------------------------------------------------------------*/
+/*--- Reuse distances                                      ---*/
+/*------------------------------------------------------------*/
+
+// LRU stack distances of data lines, sampled SHARDS-style: a line is
+// followed iff its hash is below a threshold set by --mrc-sample, so
+// every access to a followed line is seen, and distances between sampled
+// lines are scaled back up by the rate.  The stack is a Fenwick tree
+// over the times of the sampled accesses with a 1 at the last access of
+// each line; the distance of an access is the number of 1s after the
+// line's previous access.  Times are renumbered when the tree fills up.
+//
+// Distances are binned by powers of two: bin 0 counts distance 0 and bin
+// b distances in [2^(b-1), 2^b) lines, so an LRU cache of 2^k lines hits
+// bins 0..k.  Bin RD_BINS counts first accesses.
+#define RD_BINS 40
+#define RD_MIN_TREE (1 << 16)
+#define RD_HASH_BITS 24
+
+static ULong rd_threshold; // sampled iff hash < rd_threshold
+
+static UInt *rd_tree;      // Fenwick tree, 1-based
+static UWord rd_size;      // times 1..rd_size fit in rd_tree
+static UWord rd_now;       // time of the last sampled access
+static UWord rd_live;      // sampled lines seen so far
+static SparseWA *rd_last;  // line -> time of its last access
+static ULong rd_hist[RD_BINS + 1];
+
+typedef struct {
+	UWord line;
+	UWord time;
+} rd_entry_t;
+
+static void rd_tree_add(UWord i, Int delta) {
+	for (; i <= rd_size; i += i & -i)
+		rd_tree[i] += delta;
+}
+
+static UWord rd_tree_sum(UWord i) {
+	UWord sum = 0;
+	for (; i > 0; i -= i & -i)
+		sum += rd_tree[i];
+	return sum;
+}
+
+static Int rd_cmp_time(const void *a, const void *b) {
+	UWord ta = ((const rd_entry_t *)a)->time;
+	UWord tb = ((const rd_entry_t *)b)->time;
+	return ta < tb ? -1 : ta > tb ? 1 : 0;
+}
+
+// Give the live lines times 1..rd_live, keeping their order, and grow
+// the tree if that leaves less than half of it free.
+static void rd_renumber(void) {
+	rd_entry_t *ents;
+	UWord line, time, n = 0, i;
+
+	ents = VG_(malloc)("cl.rd.renumber", (rd_live + 1) * sizeof(rd_entry_t));
+	VG_(initIterSWA)(rd_last);
+	while (VG_(nextIterSWA)(rd_last, &line, &time)) {
+		tl_assert(n < rd_live);
+		ents[n].line = line;
+		ents[n].time = time;
+		n++;
+	}
+	tl_assert(n == rd_live);
+	VG_(ssort)(ents, n, sizeof(rd_entry_t), rd_cmp_time);
+
+	if (2 * n > rd_size) {
+		VG_(free)(rd_tree);
+		rd_size *= 2;
+		rd_tree = VG_(malloc)("cl.rd.tree", (rd_size + 1) * sizeof(UInt));
+	}
+	VG_(memset)(rd_tree, 0, (rd_size + 1) * sizeof(UInt));
+	for (i = 0; i < n; i++) {
+		VG_(addToSWA)(rd_last, ents[i].line, i + 1);
+		rd_tree_add(i + 1, 1);
+	}
+	rd_now = n;
+	VG_(free)(ents);
+}
+
+static void reuse_init(void) {
+	rd_threshold =
+		((1ULL << RD_HASH_BITS) + clo_mrc_sample - 1) / clo_mrc_sample;
+	rd_size = RD_MIN_TREE;
+	rd_tree = VG_(malloc)("cl.rd.tree", (rd_size + 1) * sizeof(UInt));
+	VG_(memset)(rd_tree, 0, (rd_size + 1) * sizeof(UInt));
+	rd_last = VG_(newSWA)(VG_(malloc), "cl.rd.last", VG_(free));
+}
+
+static void reuse_line(Addr line) {
+	UWord prev;
+	ULong dist;
+	Int bin;
+
+	// Fibonacci hashing spreads neighbouring lines over the hash range.
+	if (((ULong)line * 0x9E3779B97F4A7C15ULL >> (64 - RD_HASH_BITS)) >=
+		rd_threshold)
+		return;
+
+	if (rd_now == rd_size)
+		rd_renumber();
+
+	if (VG_(lookupSWA)(rd_last, &prev, line)) {
+		dist = ((ULong)(rd_live - rd_tree_sum(prev)) << RD_HASH_BITS) /
+			   rd_threshold;
+		for (bin = 0; dist > 0 && bin < RD_BINS - 1; bin++)
+			dist >>= 1;
+		rd_hist[bin]++;
+		rd_tree_add(prev, -1);
+	} else {
+		rd_hist[RD_BINS]++;
+		rd_live++;
+	}
+	rd_now++;
+	rd_tree_add(rd_now, 1);
+	VG_(addToSWA)(rd_last, line, rd_now);
+}
+
+static void reuse_data(Addr addr, SizeT size) {
+	Addr line = addr >> fp_shift[FP_LINE];
+	Addr last = (addr + size - 1) >> fp_shift[FP_LINE];
+
+	for (; line <= last; line++)
+		reuse_line(line);
+}
+
+// Fraction of the interval's sampled accesses that miss in an LRU cache
+// of 2^k lines, in tenths of a percent.
+static ULong reuse_miss_permille(Int k) {
+	ULong total = 0, miss = rd_hist[RD_BINS];
+	Int b;
+	for (b = 0; b <= RD_BINS; b++)
+		total += rd_hist[b];
+	for (b = k + 1; b < RD_BINS; b++)
+		miss += rd_hist[b];
+	return total ? miss * 1000 / total : 0;
+}
+
+static void reuse_interval(UInt what) {
+	static const struct {
+		const HChar *name;
+		Int log_lines;
+	} sizes[] = {{"32K", 9}, {"256K", 12}, {"2M", 15}, {"8M", 17}, {"32M", 19}};
+	Int i;
+
+	if (what & IV_PRINT) {
+		cl_printf("==%u== ctlite: MRC :", pid);
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+			ULong m = reuse_miss_permille(sizes[i].log_lines);
+			cl_printf(" %s %llu.%llu%%", sizes[i].name, m / 10, m % 10);
+		}
+		cl_printf("\n");
+	}
+	if (what & IV_WRITE)
+		out_column("reuse", rd_hist, RD_BINS + 1, 8, True);
+	if (what & IV_RESET)
+		VG_(memset)(rd_hist, 0, sizeof(rd_hist));
+}
+
+/*------------------------------------------------------------*/
+/*--- Branch profile                                       ---*/
+/*------------------------------------------------------------*/
+
+// One per conditional branch PC, created when the branch is first
+// translated and passed to the helper, so the hot path does no lookup.
+typedef struct _branch_t {
+	struct _branch_t *next;
+	Addr pc; // hash key
+	ULong count;
+	ULong taken;
+	ULong transitions; // outcome differs from the previous one
+	ULong miss_bimodal;
+	ULong miss_gshare;
+	Bool last;
+} branch_t;
+
+static VgHashTable *branches;
+
+// Two reference predictors, each 2^14 2-bit saturating counters as in
+// cachegrind/cg_branchpred.c: bimodal is indexed by the PC alone, gshare
+// by the PC xor'd with the global history.
+#define BP_BITS 14
+#define BP_SIZE (1 << BP_BITS)
+#if defined(VGA_arm64)
+#define BP_PC_SHIFT 2
+#else
+#define BP_PC_SHIFT 0
+#endif
+
+static UChar bimodal[BP_SIZE];
+static UChar gshare[BP_SIZE];
+static UWord bp_history;
+static ULong miss_bimodal; // this heartbeat
+static ULong miss_gshare;
+
+static branch_t *branch_get(Addr pc) {
+	branch_t *br = VG_(HT_lookup)(branches, pc);
+	if (br == NULL) {
+		br = VG_(calloc)("cl.branch", 1, sizeof(branch_t));
+		br->pc = pc;
+		VG_(HT_add_node)(branches, br);
+	}
+	return br;
+}
+
+// Predict with the counter at *ctr, train it, and return 1 on a miss.
+static inline UInt bp_update(UChar *ctr, Bool taken) {
+	UInt miss = (*ctr >= 2) != taken;
+	if (taken) {
+		if (*ctr < 3)
+			(*ctr)++;
+	} else if (*ctr > 0)
+		(*ctr)--;
+	return miss;
+}
+
+static void branch_record(branch_t *br, Bool taken) {
+	UWord pc = br->pc >> BP_PC_SHIFT;
+	UInt miss;
+
+	br->count++;
+	br->taken += taken;
+	br->transitions += br->count > 1 && taken != br->last;
+	br->last = taken;
+
+	miss = bp_update(&bimodal[pc % BP_SIZE], taken);
+	br->miss_bimodal += miss;
+	miss_bimodal += miss;
+	miss = bp_update(&gshare[(pc ^ bp_history) % BP_SIZE], taken);
+	br->miss_gshare += miss;
+	miss_gshare += miss;
+	bp_history = (bp_history << 1) | taken;
+}
+
+static void branch_init(void) {
+	branches = VG_(HT_construct)("cl.branches");
+}
+
+// Mispredictions per thousand instructions, to two decimals
+static void branch_print_mpki(const HChar *name, ULong misses) {
+	ULong n = instructions - interval_start;
+	ULong mpki = n ? misses * 100000 / n : 0;
+	cl_printf(" %s %llu.%02llu", name, mpki / 100, mpki % 100);
+}
+
+static void branch_interval(UInt what) {
+	if (what & IV_PRINT) {
+		cl_printf("==%u== ctlite: MPKI :", pid);
+		branch_print_mpki("bimodal", miss_bimodal);
+		branch_print_mpki("gshare", miss_gshare);
+		cl_printf("\n");
+	}
+	if (what & IV_WRITE) {
+		out_scalar("miss_bimodal", miss_bimodal);
+		out_scalar("miss_gshare", miss_gshare);
+	}
+	if (what & IV_RESET)
+		miss_bimodal = miss_gshare = 0;
+}
+
+static Int branch_cmp_count(const void *a, const void *b) {
+	const branch_t *ba = *(branch_t *const *)a;
+	const branch_t *bb = *(branch_t *const *)b;
+	return ba->count > bb->count ? -1 : ba->count < bb->count ? 1 : 0;
+}
+
+static Int branch_cmp_misses(const void *a, const void *b) {
+	const branch_t *ba = *(branch_t *const *)a;
+	const branch_t *bb = *(branch_t *const *)b;
+	return ba->miss_gshare > bb->miss_gshare   ? -1
+		   : ba->miss_gshare < bb->miss_gshare ? 1
+											   : 0;
+}
+
+// Write every executed branch, most frequent first, to
+// <trace-file>_<pid>.branches and print the ten that gshare misses most.
+static void branch_fini(void) {
+	DiEpoch ep = VG_(current_DiEpoch)();
+	HChar name[160];
+	branch_t **all;
+	VgFile *fp;
+	UInt n, i;
+
+	all = (branch_t **)VG_(HT_to_array)(branches, &n);
+	VG_(ssort)(all, n, sizeof(branch_t *), branch_cmp_count);
+
+	VG_(sprintf)(name, "%s_%u.branches", t_fname, pid);
+	fp = VG_(fopen)(name, VKI_O_WRONLY | VKI_O_TRUNC | VKI_O_CREAT, 00644);
+	if (fp == NULL) {
+		VG_(umsg)("ctlite: cannot create %s\n", name);
+	} else {
+		VG_(fprintf)(fp, "# pc count taken transitions bimodal_misses "
+						 "gshare_misses location\n");
+		for (i = 0; i < n && all[i]->count > 0; i++)
+			VG_(fprintf)(fp, "%#lx %llu %llu %llu %llu %llu %s\n", all[i]->pc,
+						 all[i]->count, all[i]->taken, all[i]->transitions,
+						 all[i]->miss_bimodal, all[i]->miss_gshare,
+						 VG_(describe_IP)(ep, all[i]->pc, NULL));
+		VG_(fclose)(fp);
+		VG_(printf)("==%u== ctlite: Branches : %u in %s\n", pid, i, name);
+	}
+
+	VG_(ssort)(all, n, sizeof(branch_t *), branch_cmp_misses);
+	for (i = 0; i < n && i < 10 && all[i]->miss_gshare > 0; i++)
+		VG_(printf)("==%u== ctlite: %llu misses, %llu%% taken, "
+					"%llu%% transitions : %s\n",
+					pid, all[i]->miss_gshare,
+					all[i]->taken * 100 / all[i]->count,
+					all[i]->transitions * 100 / all[i]->count,
+					VG_(describe_IP)(ep, all[i]->pc, NULL));
+	VG_(free)(all);
+}
+
+/*------------------------------------------------------------*/
+/*--- Load strides                                         ---*/
+/*------------------------------------------------------------*/
+
+// A reference prediction table: one entry per load PC, direct mapped, with
+// the last address, the stride and a 2-bit confidence.  A load is strided
+// if it repeats a confident stride, pointer chasing if its address is the
+// value its PC loaded last time plus the same small offset as before
+// (p = p->next), and irregular otherwise.
+#define ST_SIZE 4096
+#define ST_TOP 8			  // irregular PCs reported per heartbeat
+#define ST_MAX_OFFSET 4096 // largest field offset for pointer chasing
+
+typedef struct {
+	Addr pc; // 0 if free
+	Addr last_addr;
+	Addr last_value;
+	Word stride;
+	Word offset;
+	UInt conf;
+	ULong irregular; // this heartbeat
+} stride_entry_t;
+
+enum { ST_STRIDE, ST_POINTER, ST_IRREGULAR, ST_CLASSES };
+
+static stride_entry_t *stride_table;
+static ULong stride_loads[ST_CLASSES]; // this heartbeat
+
+// Irregular loads of each PC over the whole run
+typedef struct _stride_total_t {
+	struct _stride_total_t *next;
+	Addr pc; // hash key
+	ULong irregular;
+} stride_total_t;
+
+static VgHashTable *stride_totals;
+
+static void stride_retire(stride_entry_t *e) {
+	stride_total_t *t;
+	if (e->irregular == 0)
+		return;
+	t = VG_(HT_lookup)(stride_totals, e->pc);
+	if (t == NULL) {
+		t = VG_(calloc)("cl.stride.total", 1, sizeof(stride_total_t));
+		t->pc = e->pc;
+		VG_(HT_add_node)(stride_totals, t);
+	}
+	t->irregular += e->irregular;
+	e->irregular = 0;
+}
+
+static VG_REGPARM(3) void trace_load_stride(Addr pc, Addr addr, Addr value) {
+	stride_entry_t *e = &stride_table[(pc ^ (pc >> 12)) % ST_SIZE];
+	Word stride, offset;
+	Int class;
+
+	if (e->pc != pc) {
+		stride_retire(e);
+		VG_(memset)(e, 0, sizeof(*e));
+		e->pc = pc;
+		e->last_addr = addr;
+		e->last_value = value;
+		e->offset = ST_MAX_OFFSET;
+		e->irregular++;
+		stride_loads[ST_IRREGULAR]++;
+		return;
+	}
+
+	stride = addr - e->last_addr;
+	offset = addr - e->last_value;
+	if (stride == e->stride) {
+		if (e->conf < 3)
+			e->conf++;
+	} else if (e->conf > 0) {
+		e->conf--;
+	} else {
+		e->stride = stride;
+	}
+
+	if (stride == e->stride && e->conf >= 2)
+		class = ST_STRIDE;
+	else if (offset == e->offset)
+		class = ST_POINTER;
+	else
+		class = ST_IRREGULAR;
+	stride_loads[class]++;
+	if (class == ST_IRREGULAR)
+		e->irregular++;
+
+	e->last_addr = addr;
+	e->last_value = value;
+	e->offset = (offset > -ST_MAX_OFFSET && offset < ST_MAX_OFFSET)
+					? offset
+					: ST_MAX_OFFSET;
+}
+
+static void stride_init(void) {
+	stride_table =
+		VG_(calloc)("cl.stride.table", ST_SIZE, sizeof(stride_entry_t));
+	stride_totals = VG_(HT_construct)("cl.stride.totals");
+}
+
+// The class counts and the (pc, count) of the interval's ST_TOP most
+// irregular loads.  A reset folds the interval into the totals.
+static void stride_interval(UInt what) {
+	ULong total = 0, top_rec[2 * ST_TOP];
+	stride_entry_t *top[ST_TOP];
+	Int c, i, j, ntop = 0;
+
+	for (i = 0; i < ST_SIZE; i++) {
+		stride_entry_t *e = &stride_table[i];
+		if (e->irregular == 0)
+			continue;
+		for (j = ntop; j > 0 && top[j - 1]->irregular < e->irregular; j--)
+			if (j < ST_TOP)
+				top[j] = top[j - 1];
+		if (j < ST_TOP) {
+			top[j] = e;
+			if (ntop < ST_TOP)
+				ntop++;
+		}
+	}
+
+	VG_(memset)(top_rec, 0, sizeof(top_rec));
+	for (c = 0; c < ST_CLASSES; c++)
+		total += stride_loads[c];
+	for (i = 0; i < ntop; i++) {
+		top_rec[2 * i] = top[i]->pc;
+		top_rec[2 * i + 1] = top[i]->irregular;
+	}
+	if (what & IV_PRINT)
+		cl_printf("==%u== ctlite: Loads : %llu stride %llu%% pointer %llu%% "
+				  "irregular %llu%%\n", pid, total,
+				  total ? stride_loads[ST_STRIDE] * 100 / total : 0,
+				  total ? stride_loads[ST_POINTER] * 100 / total : 0,
+				  total ? stride_loads[ST_IRREGULAR] * 100 / total : 0);
+	if (what & IV_WRITE) {
+		out_scalar("loads_stride", stride_loads[ST_STRIDE]);
+		out_scalar("loads_pointer", stride_loads[ST_POINTER]);
+		out_scalar("loads_irregular", stride_loads[ST_IRREGULAR]);
+		out_column("irregular_top", top_rec, 2 * ST_TOP, 8, False);
+	}
+	if (what & IV_RESET) {
+		VG_(memset)(stride_loads, 0, sizeof(stride_loads));
+		for (i = 0; i < ST_SIZE; i++)
+			stride_retire(&stride_table[i]);
 	}
+}
+
+static Int stride_cmp_irregular(const void *a, const void *b) {
+	const stride_total_t *ta = *(stride_total_t *const *)a;
+	const stride_total_t *tb = *(stride_total_t *const *)b;
+	return ta->irregular > tb->irregular   ? -1
+		   : ta->irregular < tb->irregular ? 1
+										   : 0;
+}
+
+// Print the ten most irregular loads of the run.
+static void stride_fini(void) {
+	DiEpoch ep = VG_(current_DiEpoch)();
+	stride_total_t **all;
+	UInt n, i;
+
+	for (i = 0; i < ST_SIZE; i++)
+		stride_retire(&stride_table[i]);
+	all = (stride_total_t **)VG_(HT_to_array)(stride_totals, &n);
+	VG_(ssort)(all, n, sizeof(stride_total_t *), stride_cmp_irregular);
+	for (i = 0; i < n && i < 10; i++)
+		VG_(printf)("==%u== ctlite: %llu irregular loads : %s\n", pid,
+					all[i]->irregular, VG_(describe_IP)(ep, all[i]->pc, NULL));
+	VG_(free)(all);
+}
 
+/*------------------------------------------------------------*/
+/*--- Instruction mix                                      ---*/
+/*------------------------------------------------------------*/
+
+// Each instruction is classified once, when it is translated, from the IR
+// it expands to.  The counts of a run of instructions are added to mix[]
+// by inline IR at the next side exit and at the end of the superblock,
+// so there is no helper call.  The additions land at the end of a run,
+// so a few instructions may be counted in the neighbouring heartbeat.
+enum {
+	MIX_INSTR,
+	MIX_LOAD,
+	MIX_STORE,
+	MIX_COND,
+	MIX_INDIRECT,
+	MIX_CALL,
+	MIX_RET,
+	MIX_FP,
+	MIX_SIMD,
+	MIX_ATOMIC,
+	MIX_CLASSES
+};
+static const HChar *mix_names[MIX_CLASSES] = {
+	"instr", "load", "store", "cond", "indirect",
+	"call",	 "ret",	 "fp",	  "simd", "atomic"};
+
+static ULong mix[MIX_CLASSES]; // this heartbeat
+
+typedef struct {
+	UInt flags;			   // classes of the current instruction
+	UInt seg[MIX_CLASSES]; // instructions since the last flush
+	Addr fallthrough;	   // address after the current instruction
+} mix_state_t;
+
+// Direct calls are usually chased into the callee rather than ending the
+// superblock with Ijk_Call, so a call is recognised by its saving of the
+// return address: a push of it, or on arm64 a write of it to X30.
+static Bool mix_is_return_address(mix_state_t *mx, IRExpr *e) {
+	if (e->tag != Iex_Const)
+		return False;
+	if (sizeof(Addr) == 8)
+		return e->Iex.Const.con->tag == Ico_U64 &&
+			   e->Iex.Const.con->Ico.U64 == mx->fallthrough;
+	return e->Iex.Const.con->tag == Ico_U32 &&
+		   e->Iex.Const.con->Ico.U32 == mx->fallthrough;
+}
+
+static void mix_end_instr(mix_state_t *mx) {
+	Int c;
+	for (c = 0; c < MIX_CLASSES; c++)
+		if (mx->flags & (1 << c))
+			mx->seg[c]++;
+	mx->flags = 0;
+}
+
+static UInt mix_type_class(IRType ty) {
+	switch (ty) {
+	case Ity_F16:
+	case Ity_F32:
+	case Ity_F64:
+	case Ity_F128:
+	case Ity_D32:
+	case Ity_D64:
+	case Ity_D128:
+		return 1 << MIX_FP;
+	case Ity_V128:
+	case Ity_V256:
+		return 1 << MIX_SIMD;
+	default:
+		return 0;
+	}
+}
+
+// Note the classes st adds to the current instruction.
+static void mix_stmt(mix_state_t *mx, IRTypeEnv *tyenv, IRStmt *st) {
+	switch (st->tag) {
+	case Ist_IMark:
+		if (mx->flags)
+			mix_end_instr(mx);
+		mx->flags = 1 << MIX_INSTR;
+		mx->fallthrough = st->Ist.IMark.addr + st->Ist.IMark.len;
+		break;
+	case Ist_WrTmp:
+		if (st->Ist.WrTmp.data->tag == Iex_Load)
+			mx->flags |= 1 << MIX_LOAD;
+		mx->flags |= mix_type_class(typeOfIRTemp(tyenv, st->Ist.WrTmp.tmp));
+		break;
+	case Ist_LoadG:
+		mx->flags |= 1 << MIX_LOAD;
+		break;
+	case Ist_Store:
+		mx->flags |= 1 << MIX_STORE;
+#if defined(VGA_x86) || defined(VGA_amd64)
+		if (mix_is_return_address(mx, st->Ist.Store.data))
+			mx->flags |= 1 << MIX_CALL;
+#endif
+		break;
+	case Ist_StoreG:
+		mx->flags |= 1 << MIX_STORE;
+		break;
+#if defined(VGA_arm64)
+	case Ist_Put:
+		if (st->Ist.Put.offset == offsetof(VexGuestARM64State, guest_X30) &&
+			mix_is_return_address(mx, st->Ist.Put.data))
+			mx->flags |= 1 << MIX_CALL;
+		break;
+#endif
+	case Ist_CAS:
+		mx->flags |= 1 << MIX_ATOMIC | 1 << MIX_LOAD | 1 << MIX_STORE;
+		break;
+	case Ist_LLSC:
+		mx->flags |= 1 << MIX_ATOMIC;
+		mx->flags |= st->Ist.LLSC.storedata ? 1 << MIX_STORE : 1 << MIX_LOAD;
+		break;
+	case Ist_Dirty: {
+		IRDirty *d = st->Ist.Dirty.details;
+		if (d->mFx == Ifx_Read || d->mFx == Ifx_Modify)
+			mx->flags |= 1 << MIX_LOAD;
+		if (d->mFx == Ifx_Write || d->mFx == Ifx_Modify)
+			mx->flags |= 1 << MIX_STORE;
+		break;
+	}
+	case Ist_Exit:
+		if (st->Ist.Exit.jk == Ijk_Boring || st->Ist.Exit.jk == Ijk_Call ||
+			st->Ist.Exit.jk == Ijk_Ret)
+			mx->flags |= 1 << MIX_COND;
+		break;
+	default:
+		break;
+	}
+}
+
+// Note how the superblock ends, against its last instruction.
+static void mix_sb_end(mix_state_t *mx, IRSB *sbIn) {
+	Bool indirect = sbIn->next->tag != Iex_Const;
+	switch (sbIn->jumpkind) {
+	case Ijk_Call:
+		mx->flags |= 1 << MIX_CALL | (indirect ? 1 << MIX_INDIRECT : 0);
+		break;
+	case Ijk_Ret:
+		mx->flags |= 1 << MIX_RET;
+		break;
+	case Ijk_Boring:
+		if (indirect)
+			mx->flags |= 1 << MIX_INDIRECT;
+		break;
+	default:
+		break;
+	}
+}
+
+// Add the counts since the last flush to mix[], as in massif's
+// add_counter_update:
+//   WrTmp(t1, Load64(&mix[c]))
+//   WrTmp(t2, Add64(RdTmp(t1), Const(n)))
+//   Store(&mix[c], t2)
+static void mix_flush(IRSB *sb, mix_state_t *mx) {
+	Int c;
+
+	mix_end_instr(mx);
+	for (c = 0; c < MIX_CLASSES; c++) {
+		IRTemp t1, t2;
+		IRExpr *addr;
+		if (mx->seg[c] == 0)
+			continue;
+		t1 = newIRTemp(sb->tyenv, Ity_I64);
+		t2 = newIRTemp(sb->tyenv, Ity_I64);
+		addr = mkIRExpr_HWord((HWord)&mix[c]);
+		addStmtToIRSB(sb, IRStmt_WrTmp(t1, IRExpr_Load(END, Ity_I64, addr)));
+		addStmtToIRSB(
+			sb, IRStmt_WrTmp(t2, IRExpr_Binop(Iop_Add64, IRExpr_RdTmp(t1),
+											  IRExpr_Const(IRConst_U64(
+												  mx->seg[c])))));
+		addStmtToIRSB(sb, IRStmt_Store(END, addr, IRExpr_RdTmp(t2)));
+		mx->seg[c] = 0;
+	}
+}
+
+static void mix_interval(UInt what) {
+	Int c;
+
+	if (what & IV_PRINT) {
+		cl_printf("==%u== ctlite: Mix :", pid);
+		for (c = MIX_LOAD; c < MIX_CLASSES; c++) {
+			ULong pm = mix[MIX_INSTR] ? mix[c] * 1000 / mix[MIX_INSTR] : 0;
+			cl_printf(" %s %llu.%llu%%", mix_names[c], pm / 10, pm % 10);
+		}
+		cl_printf("\n");
+	}
+	if (what & IV_WRITE) {
+		for (c = 0; c < MIX_CLASSES; c++) {
+			HChar name[32];
+			VG_(sprintf)(name, "mix_%s", mix_names[c]);
+			out_scalar(name, mix[c]);
+		}
+	}
+	if (what & IV_RESET)
+		VG_(memset)(mix, 0, sizeof(mix));
+}
+
+// Bring 'instructions' up to date, giving the instructions since the
+// last call to the running thread.
+static void counters_sync(void) {
+	ULong now = VG_(icount_now)();
+	cur->insts += now - instructions;
+	instructions = now;
+}
+
+static void modules_interval(UInt what) {
+	if (clo_footprint)
+		footprint_interval(what);
+	if (clo_mrc_sample)
+		reuse_interval(what);
+	if (clo_branch_stats)
+		branch_interval(what);
+	if (clo_load_strides)
+		stride_interval(what);
+	if (clo_instr_mix)
+		mix_interval(what);
+}
+
+static void counters_write(counters_t *c) {
+	out_column("instructions", &instructions, 1, sizeof(instructions), False);
+	if (clo_per_thread) {
+		ULong tid = c->tid;
+		out_column("thread", &tid, 1, sizeof(tid), False);
+		out_column("thread_instructions", &c->insts, 1, sizeof(c->insts),
+				   False);
+	}
+	out_column("mmap", c->Mmap, MMAP_SIZE, sizeof(unsigned int), True);
+	out_column("imap", c->Imap, IMAP_SIZE, sizeof(unsigned int), True);
+	out_column("taken", &c->TBranches, 1, sizeof(c->TBranches), False);
+	out_column("not_taken", &c->UBranches, 1, sizeof(c->UBranches), False);
+}
+
+// End the current interval: 'what' is any of IV_PRINT, IV_WRITE and
+// IV_RESET.  'why' names the record in the log.  With --per-thread each
+// thread that ran in the interval gets a record, or the current thread if
+// none did; the process-wide profiles are repeated in each of them.
+static void end_interval(UInt what, const HChar *why) {
+	counters_t *c, **prev;
+	Bool ran = False;
+
+	counters_sync();
+	if (what & IV_PRINT)
+		cl_printf("==%u== ctlite: %s : %llu instructions\n", pid, why,
+				  instructions);
+	for (c = counters; c; c = c->next)
+		ran |= c->insts > 0;
+	for (c = counters; c; c = c->next) {
+		if (ran ? c->insts == 0 : c != cur)
+			continue;
+		if ((what & IV_PRINT) && clo_per_thread)
+			cl_printf("==%u== ctlite: Thread %u : %llu instructions\n", pid,
+					  c->tid, c->insts);
+		if (what & IV_WRITE) {
+			counters_write(c);
+			modules_interval(IV_WRITE);
+			out_record();
+		}
+	}
+	modules_interval(what & ~IV_WRITE);
+
+	if (what & IV_RESET) {
+		prev = &counters;
+		while ((c = *prev)) {
+			if (c->exited) {
+				*prev = c->next;
+				if (c == cur)
+					cur = &process_counters;
+				VG_(free)(c);
+				continue;
+			}
+			VG_(memset)(c->Mmap, 0, sizeof(c->Mmap));
+			VG_(memset)(c->Imap, 0, sizeof(c->Imap));
+			c->TBranches = c->UBranches = 0;
+			c->insts = 0;
+			prev = &c->next;
+		}
+		interval_start = instructions;
+	}
+}
+
+static void heartbeat_event(ULong now, void *opaque) {
+	end_interval(IV_PRINT | IV_WRITE | IV_RESET, "Heartbeat");
+	VG_(icount_at)(now + heartbeat, heartbeat_event, NULL);
+}
+
+static VG_REGPARM(1) void trace_instr_fp(Addr iaddr) {
+	footprint_line(ifoot, FP_2MB, ifilter, iaddr >> fp_shift[FP_LINE]);
 }
 
 static VG_REGPARM(2) void trace_load(Addr addr, SizeT size) {
 	addr = addr >> MShiftSize;
-	Mmap[addr % MMAP_SIZE]++;
+	cur->Mmap[addr % MMAP_SIZE]++;
 }
 
 static VG_REGPARM(2) void trace_store(Addr addr, SizeT size) {
 	addr = addr >> MShiftSize;
-	Mmap[addr % MMAP_SIZE]++;
+	cur->Mmap[addr % MMAP_SIZE]++;
+}
+
+// Loads and stores when --footprint or --mrc-sample needs them
+static void profile_data(Addr addr, SizeT size) {
+	if (clo_footprint)
+		footprint_data(addr, size);
+	if (clo_mrc_sample)
+		reuse_data(addr, size);
+}
+
+static VG_REGPARM(2) void trace_load_prof(Addr addr, SizeT size) {
+	profile_data(addr, size);
+	trace_load(addr, size);
+}
+
+static VG_REGPARM(2) void trace_store_prof(Addr addr, SizeT size) {
+	profile_data(addr, size);
+	trace_store(addr, size);
 }
 
 
 static VG_REGPARM(2) void trace_branch_conditional(Bool ci, Bool guard) {
 	if (guard) {
 		if(ci)
-			UBranches++;
+			cur->UBranches++;
 		else
-			TBranches++;
+			cur->TBranches++;
 	} else {
 		if(ci)
-			TBranches++;
+			cur->TBranches++;
 		else
-			UBranches++;
+			cur->UBranches++;
 	}
 }
 
+static VG_REGPARM(3) void trace_branch_prof(branch_t *br, Bool ci,
+											Bool guard) {
+	branch_record(br, guard ? !ci : ci);
+	trace_branch_conditional(ci, guard);
+}
+
 
-static void instrument_instruction(IRSB *sb, IRAtom *iaddr, UInt isize) {
+// Instructions are counted by pub_tool_icount.h, and the code window is
+// updated inline:
+//   WrTmp(c, Load(&cur))                         (only with --per-thread)
+//   WrTmp(a, Add(RdTmp(c), Const(offset of Imap[i])))
+//   WrTmp(t1, Load32(a)), WrTmp(t2, Add32(t1, 1)), Store(a, t2)
+// Only the code footprint needs a helper call.
+static void instrument_instruction(IRSB *sb, Addr iaddr, UInt isize) {
 
 	tl_assert((VG_MIN_INSTR_SZB <= isize && isize <= VG_MAX_INSTR_SZB) ||
 			  VG_CLREQ_SZB == isize);
-	IRExpr **argv;
+	IRType hWordTy = integerIRTypeOfSize(sizeof(HWord));
+	HWord off	   = offsetof(counters_t, Imap) +
+				 (iaddr >> IShiftSize) % IMAP_SIZE * sizeof(unsigned int);
+	IRExpr *addr;
+	IRTemp t1, t2;
 	IRDirty *di;
 
-	argv = mkIRExprVec_2(iaddr, mkIRExpr_HWord(isize));
-	di = unsafeIRDirty_0_N(2, "trace_instr", VG_(fnptr_to_fnentry)(trace_instr),
-						   argv);
-	addStmtToIRSB(sb, IRStmt_Dirty(di));
+	if (clo_per_thread) {
+		IRTemp c = newIRTemp(sb->tyenv, hWordTy);
+		IRTemp a = newIRTemp(sb->tyenv, hWordTy);
+		addStmtToIRSB(sb, IRStmt_WrTmp(c, IRExpr_Load(END, hWordTy,
+													   mkIRExpr_HWord(
+														   (HWord)&cur))));
+		addStmtToIRSB(sb, IRStmt_WrTmp(a, IRExpr_Binop(hWordTy == Ity_I32
+															? Iop_Add32
+															: Iop_Add64,
+														IRExpr_RdTmp(c),
+														mkIRExpr_HWord(off))));
+		addr = IRExpr_RdTmp(a);
+	} else {
+		addr = mkIRExpr_HWord((HWord)&process_counters + off);
+	}
+	t1 = newIRTemp(sb->tyenv, Ity_I32);
+	t2 = newIRTemp(sb->tyenv, Ity_I32);
+	addStmtToIRSB(sb, IRStmt_WrTmp(t1, IRExpr_Load(END, Ity_I32, addr)));
+	addStmtToIRSB(sb, IRStmt_WrTmp(t2, IRExpr_Binop(Iop_Add32, IRExpr_RdTmp(t1),
+													IRExpr_Const(
+														IRConst_U32(1)))));
+	addStmtToIRSB(sb, IRStmt_Store(END, addr, IRExpr_RdTmp(t2)));
+
+	if (clo_footprint) {
+		di = unsafeIRDirty_0_N(1, "trace_instr_fp",
+							   VG_(fnptr_to_fnentry)(trace_instr_fp),
+							   mkIRExprVec_1(mkIRExpr_HWord(iaddr)));
+		addStmtToIRSB(sb, IRStmt_Dirty(di));
+	}
 }
 
 static void instrument_load(IRSB *sb, IRAtom *daddr, Int dsize, IRAtom *guard) {
@@ -218,12 +1374,31 @@ static void instrument_load(IRSB *sb, IRAtom *daddr, Int dsize, IRAtom *guard) {
 	IRDirty *di_mem = emptyIRDirty();
 	IRExpr **argv_mem = mkIRExprVec_2(daddr, mkIRExpr_HWord(dsize));
 	di_mem->args	  = argv_mem;
-	di_mem->cee =
-		mkIRCallee(2, "trace_load", VG_(fnptr_to_fnentry)(trace_load));
+	if (clo_footprint || clo_mrc_sample)
+		di_mem->cee = mkIRCallee(2, "trace_load_prof",
+								 VG_(fnptr_to_fnentry)(trace_load_prof));
+	else
+		di_mem->cee =
+			mkIRCallee(2, "trace_load", VG_(fnptr_to_fnentry)(trace_load));
 	di_mem->guard = IRExpr_Const(IRConst_U1(True));
 	addStmtToIRSB(sb, IRStmt_Dirty(di_mem));
 }
 
+// Feed the load of st, which writes a temporary, to the stride table.
+// Only word-sized loads can be pointers; narrower ones pass a value of 0.
+static void instrument_load_stride(IRSB *sb, Addr pc, IRStmt *st) {
+	IRExpr *load = st->Ist.WrTmp.data;
+	IRType hWordTy = integerIRTypeOfSize(sizeof(Addr));
+	IRExpr *value = load->Iex.Load.ty == hWordTy
+						? IRExpr_RdTmp(st->Ist.WrTmp.tmp)
+						: mkIRExpr_HWord(0);
+	IRExpr **argv =
+		mkIRExprVec_3(mkIRExpr_HWord(pc), load->Iex.Load.addr, value);
+	IRDirty *di = unsafeIRDirty_0_N(
+		3, "trace_load_stride", VG_(fnptr_to_fnentry)(trace_load_stride), argv);
+	addStmtToIRSB(sb, IRStmt_Dirty(di));
+}
+
 static void instrument_store(IRSB *sb, IRAtom *daddr, Int dsize,
 							 IRAtom *guard) {
 	tl_assert(isIRAtom(daddr));
@@ -232,8 +1407,12 @@ static void instrument_store(IRSB *sb, IRAtom *daddr, Int dsize,
 	IRDirty *di_mem = emptyIRDirty();
 	IRExpr **argv_mem = mkIRExprVec_2(daddr, mkIRExpr_HWord(dsize));
 	di_mem->args	  = argv_mem;
-	di_mem->cee =
-		mkIRCallee(2, "trace_store", VG_(fnptr_to_fnentry)(trace_store));
+	if (clo_footprint || clo_mrc_sample)
+		di_mem->cee = mkIRCallee(2, "trace_store_prof",
+								 VG_(fnptr_to_fnentry)(trace_store_prof));
+	else
+		di_mem->cee =
+			mkIRCallee(2, "trace_store", VG_(fnptr_to_fnentry)(trace_store));
 	di_mem->guard = IRExpr_Const(IRConst_U1(True));
 
 	if (guard) {
@@ -242,7 +1421,8 @@ static void instrument_store(IRSB *sb, IRAtom *daddr, Int dsize,
 
 	addStmtToIRSB(sb, IRStmt_Dirty(di_mem));
 }
-static void instrument_branch_conditional(IRSB *sb, Bool ci, IRExpr *guard) {
+static void instrument_branch_conditional(IRSB *sb, Addr pc, Bool ci,
+										  IRExpr *guard) {
 	IRType hWordTy = integerIRTypeOfSize(sizeof(Addr));
 	IRTemp guard1  = newIRTemp(sb->tyenv, Ity_I1);
 	IRTemp guardW  = newIRTemp(sb->tyenv, hWordTy);
@@ -254,14 +1434,53 @@ static void instrument_branch_conditional(IRSB *sb, Bool ci, IRExpr *guard) {
 
 	IRAtom *guard2 = IRExpr_RdTmp(guardW);
 	tl_assert(isIRAtom(guard2));
-	IRExpr **argv = mkIRExprVec_2(mkIRExpr_HWord(ci), guard2);
-	IRDirty *di   = unsafeIRDirty_0_N(
-		  2, "trace_branch_conditional",
-		  VG_(fnptr_to_fnentry)(trace_branch_conditional), argv);
+	IRExpr **argv;
+	IRDirty *di;
+	if (clo_branch_stats) {
+		argv = mkIRExprVec_3(mkIRExpr_HWord((HWord)branch_get(pc)),
+							 mkIRExpr_HWord(ci), guard2);
+		di = unsafeIRDirty_0_N(3, "trace_branch_prof",
+							   VG_(fnptr_to_fnentry)(trace_branch_prof), argv);
+	} else {
+		argv = mkIRExprVec_2(mkIRExpr_HWord(ci), guard2);
+		di = unsafeIRDirty_0_N(
+			2, "trace_branch_conditional",
+			VG_(fnptr_to_fnentry)(trace_branch_conditional), argv);
+	}
 	addStmtToIRSB(sb, IRStmt_Dirty(di));
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Threads                                              ---*/
+/*------------------------------------------------------------*/
+
+static void cl_thread_create(ThreadId parent, ThreadId child) {
+	counters_t *c = VG_(calloc)("cl.counters", 1, sizeof(counters_t));
+	counters_t **prev;
+
+	c->tid = child;
+	for (prev = &counters; *prev; prev = &(*prev)->next)
+		;
+	*prev = c;
+	if (thread_counters[child])
+		thread_counters[child]->exited = True;
+	thread_counters[child] = c;
+}
+
+static void cl_thread_exit(ThreadId tid) {
+	if (thread_counters[tid]) {
+		thread_counters[tid]->exited = True;
+		thread_counters[tid] = NULL;
+	}
+}
+
+static void cl_start_client_code(ThreadId tid, ULong blocks_done) {
+	counters_sync();
+	cur = thread_counters[tid];
+	tl_assert(cur);
+}
+
 /*------------------------------------------------------------*/
 /*--- Basic tool functions                                 ---*/
 /*------------------------------------------------------------*/
@@ -284,6 +1503,46 @@ static void cl_post_clo_init(void) {
 
 	fd = VG_(fd_open)(str, VKI_O_WRONLY | VKI_O_TRUNC | VKI_O_CREAT, 00644);
 	tl_assert(fd != -1);
+
+	if (clo_format == FormatSeries) {
+		HChar line[128];
+		VG_(snprintf)(line, sizeof(line),
+					  "version 1\npid %u\nheartbeat %llu\nmem-size %u\n"
+					  "code-size %u\nmrc-sample %u\n", pid, heartbeat,
+					  MShiftSize + 10, IShiftSize + 10, clo_mrc_sample);
+		out_schema_add(line);
+	}
+
+	if (clo_footprint) {
+		VG_(printf)("==%u== ctlite: footprint : yes\n", pid);
+		footprint_reset(dfoot, FP_LEVELS);
+		footprint_reset(ifoot, FP_2MB);
+	}
+	if (clo_mrc_sample) {
+		VG_(printf)("==%u== ctlite: mrc-sample : 1 in %u lines\n", pid,
+					clo_mrc_sample);
+		reuse_init();
+	}
+	if (clo_branch_stats) {
+		VG_(printf)("==%u== ctlite: branch-stats : yes\n", pid);
+		branch_init();
+	}
+	if (clo_load_strides) {
+		VG_(printf)("==%u== ctlite: load-strides : yes\n", pid);
+		stride_init();
+	}
+	if (clo_instr_mix)
+		VG_(printf)("==%u== ctlite: instr-mix : yes\n", pid);
+	if (clo_per_thread) {
+		VG_(printf)("==%u== ctlite: per-thread : yes\n", pid);
+		counters		= NULL;
+		thread_counters = VG_(calloc)("cl.thread_counters", VG_N_THREADS,
+									  sizeof(counters_t *));
+		VG_(track_pre_thread_ll_create)(cl_thread_create);
+		VG_(track_pre_thread_ll_exit)(cl_thread_exit);
+		VG_(track_start_client_code)(cl_start_client_code);
+	}
+	VG_(icount_at)(heartbeat, heartbeat_event, NULL);
 }
 
 static IRSB *cl_instrument(VgCallbackClosure *closure, IRSB *sbIn,
@@ -298,6 +1557,8 @@ static IRSB *cl_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 	Addr iaddr				= 0, dst;
 	UInt ilen				= 0;
 	Bool condition_inverted = False;
+	mix_state_t mx;
+	VgICountSB ic;
 
 	if (gWordTy != hWordTy) {
 		/* We don't currently support this case. */
@@ -306,6 +1567,7 @@ static IRSB *cl_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 
 	/* Set up SB */
 	sbOut = deepCopyIRSBExceptStmts(sbIn);
+	VG_(memset)(&mx, 0, sizeof(mx));
 
 	// Copy verbatim any IR preamble preceding the first IMark
 	i = 0;
@@ -313,20 +1575,23 @@ static IRSB *cl_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 		addStmtToIRSB(sbOut, sbIn->stmts[i]);
 		i++;
 	}
+	VG_(icount_sb_start)(&ic, sbOut);
 
 	for (/*use current i*/; i < sbIn->stmts_used; i++) {
 
 		IRStmt *st = sbIn->stmts[i];
 		if ( !st || st->tag == Ist_NoOp )
 			continue;
+		if (clo_instr_mix)
+			mix_stmt(&mx, tyenv, st);
 		switch (st->tag) {
 
 		case Ist_IMark:
 			/* Needed to be able to check for inverted condition in Ist_Exit */
 			iaddr = st->Ist.IMark.addr;
 			ilen  = st->Ist.IMark.len;
-			instrument_instruction(
-				sbOut, mkIRExpr_HWord((HWord)st->Ist.IMark.addr), ilen);
+			VG_(icount_imark)(&ic, sbOut);
+			instrument_instruction(sbOut, iaddr, ilen);
 			addStmtToIRSB(sbOut, st);
 			break;
 
@@ -346,6 +1611,8 @@ static IRSB *cl_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 			if (data->tag == Iex_Load) {
 				instrument_load(sbOut, data->Iex.Load.addr,
 								sizeofIRType(data->Iex.Load.ty), NULL);
+				if (clo_load_strides)
+					instrument_load_stride(sbOut, iaddr, st);
 			}
 
 			switch (data->tag) {
@@ -457,10 +1724,13 @@ static IRSB *cl_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 			// instrument only if it is branch in guest code
 			if ((st->Ist.Exit.jk == Ijk_Boring) ||
 				(st->Ist.Exit.jk == Ijk_Call) || (st->Ist.Exit.jk == Ijk_Ret)) {
-				instrument_branch_conditional(sbOut, condition_inverted,
+				instrument_branch_conditional(sbOut, iaddr, condition_inverted,
 											  st->Ist.Exit.guard);
 			}
 
+			if (clo_instr_mix)
+				mix_flush(sbOut, &mx);
+			VG_(icount_exit)(&ic, sbOut);
 			addStmtToIRSB(sbOut, st); // Original statement
 
 			break;
@@ -470,6 +1740,11 @@ static IRSB *cl_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 			tl_assert(0);
 		}
 	}
+	if (clo_instr_mix) {
+		mix_sb_end(&mx, sbIn);
+		mix_flush(sbOut, &mx);
+	}
+	VG_(icount_sb_end)(&ic, sbOut);
 #if 0
 	if ((sbIn->jumpkind == Ijk_Boring) || (sbIn->jumpkind == Ijk_Call) ||
 		(sbIn->jumpkind == Ijk_Ret)) {
@@ -494,11 +1769,98 @@ static IRSB *cl_instrument(VgCallbackClosure *closure, IRSB *sbIn,
 	return sbOut;
 }
 
+/*------------------------------------------------------------*/
+/*--- Client requests and monitor commands                 ---*/
+/*------------------------------------------------------------*/
+
+static void cl_print_monitor_help(void) {
+	VG_(gdb_printf)("\n");
+	VG_(gdb_printf)("ctlite monitor commands:\n");
+	VG_(gdb_printf)("  flush [<label>]\n");
+	VG_(gdb_printf)("        print and write the counters of the current "
+					"interval, and start a new one\n");
+	VG_(gdb_printf)("  zero\n");
+	VG_(gdb_printf)("        discard the counters of the current interval\n");
+	VG_(gdb_printf)("  snapshot [<label>]\n");
+	VG_(gdb_printf)("        print the counters of the current interval\n");
+	VG_(gdb_printf)("\n");
+}
+
+// 'what' of flush, zero and snapshot
+static const UInt cl_request_what[3] = {IV_PRINT | IV_WRITE | IV_RESET,
+										IV_RESET, IV_PRINT};
+
+static void cl_request(Int req, const HChar *label) {
+	static const HChar *names[3] = {"Flush", "Zero", "Snapshot"};
+	HChar why[128];
+
+	counters_sync();
+	if (label && *label)
+		VG_(snprintf)(why, sizeof(why), "%s %s", names[req], label);
+	else
+		VG_(snprintf)(why, sizeof(why), "%s", names[req]);
+	if (req == 1)
+		cl_printf("==%u== ctlite: %s : %llu instructions\n", pid, why,
+				  instructions);
+	end_interval(cl_request_what[req], why);
+}
+
+static Bool cl_handle_gdb_monitor_command(ThreadId tid, HChar *req) {
+	HChar s[VG_(strlen)(req) + 1];
+	HChar *wcmd;
+	HChar *ssaveptr;
+	Int kwdid;
+
+	VG_(strcpy)(s, req);
+	wcmd  = VG_(strtok_r)(s, " ", &ssaveptr);
+	kwdid = VG_(keyword_id)("help flush zero snapshot", wcmd,
+							kwd_report_duplicated_matches);
+	switch (kwdid) {
+	case -2: /* multiple matches */
+		return True;
+	case -1: /* not found */
+		return False;
+	case 0: /* help */
+		cl_print_monitor_help();
+		return True;
+	default:
+		cl_printf = VG_(gdb_printf);
+		cl_request(kwdid - 1, VG_(strtok_r)(NULL, "", &ssaveptr));
+		cl_printf = VG_(printf);
+		return True;
+	}
+}
+
+static Bool cl_handle_client_request(ThreadId tid, UWord *args, UWord *ret) {
+	switch (args[0]) {
+	case VG_USERREQ__CTLITE_FLUSH:
+	case VG_USERREQ__CTLITE_ZERO:
+	case VG_USERREQ__CTLITE_SNAPSHOT:
+		cl_request(args[0] - VG_USERREQ__CTLITE_FLUSH,
+				   (const HChar *)args[1]);
+		*ret = 0;
+		return True;
+	case VG_USERREQ__GDB_MONITOR_COMMAND:
+		*ret = cl_handle_gdb_monitor_command(tid, (HChar *)args[1]);
+		return (Bool)*ret;
+	default:
+		return False;
+	}
+}
+
 static void cl_fini(Int exitcode) {
+	// The instructions since the last heartbeat
+	counters_sync();
+	if (instructions > interval_start)
+		end_interval(IV_PRINT | IV_WRITE | IV_RESET, "Final");
 	VG_(printf)("==%u== ctlite: Program Completed\n", pid);
 	VG_(printf)("==%u== ctlite: Instructions = %llu\n", pid, instructions);
+	if (clo_branch_stats)
+		branch_fini();
+	if (clo_load_strides)
+		stride_fini();
 
-	VG_(close)(fd);
+	out_close();
 	/* end tracing */
 }
 
@@ -517,6 +1879,8 @@ static void cl_pre_clo_init(void) {
 	VG_(basic_tool_funcs)(cl_post_clo_init, cl_instrument, cl_fini);
 	VG_(needs_command_line_options)
 	(cl_process_cmd_line_option, cl_print_usage, cl_print_debug_usage);
+	VG_(needs_client_requests)(cl_handle_client_request);
+	VG_(needs_no_debuginfo)();
 }
 
 VG_DETERMINE_INTERFACE_VERSION(cl_pre_clo_init)
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+#
+# Read the output of ctlite --format=series.
+#
+#   import cl_read
+#   meta, cols = cl_read.load("tracefile_1234")
+#   cols["instructions"]        # one value per heartbeat
+#   cols["mmap"]                # one row of 1024 per heartbeat
+#   df = cl_read.dataframe("tracefile_1234")   # scalar columns, pandas
+#
+# From the shell, print the scalar columns as CSV:
+#
+#   cl_read.py tracefile_1234 > profile.csv
+#
+# The file may have been compressed with gzip, bzip2 or xz afterwards.
+#
+# Layout: "CLSERIES", a varint length and a text schema ("key value" lines
+# and "column <name> <u32|u64> <n> <dense|sparse>" lines), then one record
+# per heartbeat: a varint length and the columns in schema order.  Values
+# are unsigned LEB128 varints; a sparse column is a count of nonzero
+# entries followed by (index delta, value) pairs.
+
+import bz2
+import gzip
+import lzma
+import sys
+
+MAGIC = b"CLSERIES"
+
+
+def _open(path):
+    with open(path, "rb") as f:
+        head = f.read(6)
+    if head.startswith(b"\x1f\x8b"):
+        return gzip.open(path, "rb")
+    if head.startswith(b"BZh"):
+        return bz2.open(path, "rb")
+    if head.startswith(b"\xfd7zXZ"):
+        return lzma.open(path, "rb")
+    return open(path, "rb")
+
+
+def _varint(buf, pos):
+    v = shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        v |= (b & 0x7F) << shift
+        if b < 0x80:
+            return v, pos
+        shift += 7
+
+
+def _parse_schema(text):
+    meta = {"columns": []}
+    for line in text.splitlines():
+        words = line.split()
+        if not words:
+            continue
+        if words[0] == "column":
+            name, ty, n, kind = words[1:5]
+            meta["columns"].append((name, ty, int(n), kind == "sparse"))
+        else:
+            value = " ".join(words[1:])
+            meta[words[0]] = int(value) if value.isdigit() else value
+    return meta
+
+
+def read(path):
+    """Return (meta, rows): the settings and column list, and for each
+    heartbeat a list with one value (scalars) or list (vectors) per
+    column."""
+    with _open(path) as f:
+        buf = f.read()
+    if not buf.startswith(MAGIC):
+        raise ValueError("%s: not a ctlite --format=series file" % path)
+    n, pos = _varint(buf, len(MAGIC))
+    meta = _parse_schema(buf[pos:pos + n].decode())
+    pos += n
+
+    rows = []
+    while pos < len(buf):
+        n, pos = _varint(buf, pos)
+        end = pos + n
+        row = []
+        for _, _, width, sparse in meta["columns"]:
+            if sparse:
+                vals = [0] * width
+                nz, pos = _varint(buf, pos)
+                i = 0
+                for _ in range(nz):
+                    d, pos = _varint(buf, pos)
+                    i += d
+                    vals[i], pos = _varint(buf, pos)
+            else:
+                vals = []
+                for _ in range(width):
+                    v, pos = _varint(buf, pos)
+                    vals.append(v)
+            row.append(vals[0] if width == 1 else vals)
+        if pos != end:
+            raise ValueError("%s: record length mismatch" % path)
+        rows.append(row)
+    return meta, rows
+
+
+def load(path):
+    """Return (meta, cols) with one array per column: shape (heartbeats,)
+    for scalars and (heartbeats, n) for vectors.  Uses numpy if it is
+    installed, lists otherwise."""
+    meta, rows = read(path)
+    try:
+        import numpy as np
+    except ImportError:
+        np = None
+    cols = {}
+    for i, (name, ty, width, _) in enumerate(meta["columns"]):
+        data = [row[i] for row in rows]
+        if np is not None:
+            dtype = np.uint32 if ty == "u32" else np.uint64
+            data = np.array(data, dtype=dtype)
+            if width > 1:
+                data = data.reshape(len(rows), width)
+        cols[name] = data
+    return meta, cols
+
+
+def dataframe(path):
+    """A pandas DataFrame of the scalar columns, one row per heartbeat."""
+    import pandas as pd
+    meta, cols = load(path)
+    scalars = [c[0] for c in meta["columns"] if c[2] == 1]
+    return pd.DataFrame({name: cols[name] for name in scalars})
+
+
+def main(argv):
+    if len(argv) != 2:
+        sys.stderr.write("usage: cl_read.py FILE\n")
+        return 1
+    meta, rows = read(argv[1])
+    scalars = [i for i, c in enumerate(meta["columns"]) if c[2] == 1]
+    for key, value in meta.items():
+        if key != "columns":
+            print("# %s %s" % (key, value))
+    print(",".join(meta["columns"][i][0] for i in scalars))
+    for row in rows:
+        print(",".join(str(row[i]) for i in scalars))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,95 @@
+
+/*
+   ----------------------------------------------------------------
+
+   Notice that the following BSD-style license applies to this one
+   file (ctlite.h) only.  The rest of Valgrind is licensed under the
+   terms of the GNU General Public License, version 2, unless
+   otherwise indicated.  See the COPYING file in the source
+   distribution for details.
+
+   ----------------------------------------------------------------
+
+   This file is part of ctlite, a valgrind tool that profiles the
+   memory, code and branch behaviour of a program.
+
+   Copyright (C) 2020 Siddharth Jayashankar.  All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+   2. The origin of this software must not be misrepresented; you must
+      not claim that you wrote the original software.  If you use this
+      software in a product, an acknowledgment in the product
+      documentation would be appreciated but is not required.
+
+   3. Altered source versions must be plainly marked as such, and must
+      not be misrepresented as being the original software.
+
+   4. The name of the author may not be used to endorse or promote
+      products derived from this software without specific prior written
+      permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+   OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+   WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   ----------------------------------------------------------------
+
+   Notice that the above BSD-style license applies to this one file
+   (ctlite.h) only.  The entire rest of Valgrind is licensed under
+   the terms of the GNU General Public License, version 2.  See the
+   COPYING file in the source distribution for details.
+
+   ----------------------------------------------------------------
+*/
+
+#ifndef __CTLITE_H
+#define __CTLITE_H
+
+#include "valgrind.h"
+
+/* !! ABIWARNING !! ABIWARNING !! ABIWARNING !! ABIWARNING !!
+   This enum comprises an ABI exported by Valgrind to programs
+   which use client requests.  DO NOT CHANGE THE ORDER OF THESE
+   ENTRIES, NOR DELETE ANY -- add new ones at the end.
+ */
+
+typedef
+   enum {
+      VG_USERREQ__CTLITE_FLUSH = VG_USERREQ_TOOL_BASE('C','L'),
+      VG_USERREQ__CTLITE_ZERO,
+      VG_USERREQ__CTLITE_SNAPSHOT
+   } Vg_CtliteClientRequest;
+
+/* End the current interval now, as a heartbeat would: print its
+   counters, write them to the trace file and start a new interval.
+   The label, which may be NULL, is printed with the counters. */
+#define CTLITE_FLUSH(label)                                     \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__CTLITE_FLUSH,     \
+                                  label, 0, 0, 0, 0)
+
+/* Discard the counters of the current interval and start a new one. */
+#define CTLITE_ZERO                                             \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__CTLITE_ZERO,      \
+                                  0, 0, 0, 0, 0)
+
+/* Print the counters of the current interval, leaving them as they
+   are. */
+#define CTLITE_SNAPSHOT(label)                                  \
+  VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__CTLITE_SNAPSHOT,  \
+                                  label, 0, 0, 0, 0)
+
+#endif /* __CTLITE_H */
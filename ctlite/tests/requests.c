@@ -0,0 +1,31 @@
+/* The ctlite client requests and monitor commands around loops of
+   100000 taken branches, so that each interval written to the trace
+   file holds one loop, or none for the flush straight after a zero. */
+#include <stdio.h>
+#include "../ctlite.h"
+
+int main(void)
+{
+   volatile unsigned int s = 0;
+   unsigned int i;
+
+   for (i = 0; i < 100000; i++)
+      s += i;
+   CTLITE_SNAPSHOT("startup");
+   CTLITE_ZERO;
+   CTLITE_SNAPSHOT("after zero");
+   for (i = 0; i < 100000; i++)
+      s += i;
+   CTLITE_FLUSH(NULL);
+   CTLITE_SNAPSHOT("after flush");
+   VALGRIND_MONITOR_COMMAND("help");
+   for (i = 0; i < 100000; i++)
+      s += i;
+   VALGRIND_MONITOR_COMMAND("snapshot monitor");
+   VALGRIND_MONITOR_COMMAND("zero");
+   VALGRIND_MONITOR_COMMAND("flush monitor");
+   for (i = 0; i < 100000; i++)
+      s += i;
+   printf("%u\n", s);
+   return 0;
+}
@@ -0,0 +1,69 @@
+/* A short, deterministic workload for ctlite: a sequential walk over an
+   array, a pointer chase, and a branch taken four times out of eight,
+   in the main thread between client requests, then in two threads. */
+#include <pthread.h>
+#include <stdio.h>
+#include "../ctlite.h"
+
+#define N 16384
+
+static unsigned int a[N];      // 64 KB
+static unsigned int next[N];   // 64 KB
+
+static unsigned int __attribute__((noinline)) bump(unsigned int s)
+{
+   return s * 3 + 1;
+}
+
+// Out of line so that the branch is a single one the compiler cannot
+// duplicate or thread.
+static unsigned int __attribute__((noinline)) step(unsigned int s,
+                                                   unsigned int x)
+{
+   if (x & 4)
+      s = bump(s);
+   return s;
+}
+
+static unsigned int __attribute__((noinline)) walk(void)
+{
+   unsigned int s = 0, i, p;
+
+   for (i = 0; i < N; i++)
+      s += a[i];
+   for (i = 0, p = 0; i < N; i++) {
+      s ^= p;
+      p = next[p];
+   }
+   for (i = 0; i < N; i++)
+      s = step(s, a[i]);
+   return s;
+}
+
+static void *thread(void *arg)
+{
+   *(unsigned int *)arg = walk();
+   return NULL;
+}
+
+int main(void)
+{
+   pthread_t t[2];
+   unsigned int r[2], s, i;
+
+   for (i = 0; i < N; i++) {
+      a[i] = i * 2654435761u;   // bit 2 is bit 2 of i
+      next[i] = (i * 4099 + 1) % N;
+   }
+   CTLITE_ZERO;
+   s = walk();
+   CTLITE_SNAPSHOT("walked");
+   CTLITE_FLUSH("main");
+   for (i = 0; i < 2; i++)
+      pthread_create(&t[i], NULL, thread, &r[i]);
+   for (i = 0; i < 2; i++)
+      pthread_join(t[i], NULL);
+   VALGRIND_MONITOR_COMMAND("flush threads");
+   printf("%08x %08x %08x\n", s, r[0], r[1]);
+   return 0;
+}
@@ -0,0 +1,95 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Counting guest instructions, with events at given counts.   ---*/
+/*---                                            pub_tool_icount.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_TOOL_ICOUNT_H
+#define __PUB_TOOL_ICOUNT_H
+
+#include "pub_tool_basics.h"
+#include "libvex_ir.h"
+
+//--------------------------------------------------------------------
+// PURPOSE: count the guest instructions executed by all threads, and
+// call back when the count reaches a number scheduled in advance.
+//
+// The count is kept by inline code, stored once per superblock exit
+// rather than added to at each instruction.  Before each instruction
+// the next scheduled count is compared with the current one, and only
+// when it has been reached is a helper called, which runs the
+// callbacks that are due.  A callback runs after exactly 'at'
+// instructions have completed, before the next one starts.
+//
+// A tool that uses this module calls the VG_(icount_*) instrumentation
+// functions from its instrument function, in the order of the
+// statements of the superblock:
+//
+//    VgICountSB ic;
+//    VG_(icount_sb_start)(&ic, sbOut);       // before the first IMark
+//    ...
+//    case Ist_IMark: VG_(icount_imark)(&ic, sbOut); ...
+//    case Ist_Exit:  VG_(icount_exit)(&ic, sbOut); ... the Exit itself
+//    ...
+//    VG_(icount_sb_end)(&ic, sbOut);
+//--------------------------------------------------------------------
+
+/* Called when the count reaches the number it was scheduled at. */
+typedef void (*VgICountFn)(ULong now, void* opaque);
+
+/* Call fn(now, opaque) once 'at' instructions have completed.  If the
+   count is past 'at' already, it is called before the next
+   instruction.  Callbacks may schedule further events, and may call
+   VG_(discard_translations_safely) and VG_(set_translation_mode). */
+extern void VG_(icount_at) ( ULong at, VgICountFn fn, void* opaque );
+
+/* The instructions completed so far.  Exact inside a callback and
+   between superblocks (in client requests, syscalls, thread switches
+   and at exit); inside a superblock it lags by the instructions run
+   since the superblock started. */
+extern ULong VG_(icount_now) ( void );
+
+/* The most instructions in a superblock (see --vex-guest-max-insns).
+   A tool that changes how it instruments at count N can schedule the
+   change at N - VG_ICOUNT_MAX_SB_INSNS: every translation that runs an
+   instruction past N is then made after the change. */
+#define VG_ICOUNT_MAX_SB_INSNS 100
+
+/* Per-superblock instrumentation state. */
+typedef
+   struct {
+      IRTemp base;   // the count when the superblock was entered
+      UInt   n;      // IMarks seen so far
+   }
+   VgICountSB;
+
+extern void VG_(icount_sb_start) ( VgICountSB* ic, IRSB* sbOut );
+extern void VG_(icount_imark)    ( VgICountSB* ic, IRSB* sbOut );
+extern void VG_(icount_exit)     ( VgICountSB* ic, IRSB* sbOut );
+extern void VG_(icount_sb_end)   ( VgICountSB* ic, IRSB* sbOut );
+
+#endif   // __PUB_TOOL_ICOUNT_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                        pub_tool_icount.h ---*/
+/*--------------------------------------------------------------------*/
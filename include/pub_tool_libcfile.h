@@ -89,6 +89,13 @@ extern Int    VG_(unlink) ( const HChar* file_name );
 
 extern SysRes VG_(poll) (struct vki_pollfd *fds, Int nfds, Int timeout);
 
+/* Returns 0 and the two ends in sv, or minus the error number */
+extern Int VG_(socketpair) ( Int domain, Int type, Int protocol, Int sv[2] );
+/* Returns the connected socket, or minus the error number */
+extern Int VG_(connect_via_unix_socket)( const HChar* path );
+/* send() with SIGPIPE suppressed, so a closed peer just gives an error */
+extern Int VG_(write_socket)( Int sd, const void *msg, Int count );
+
 extern SSizeT VG_(readlink)( const HChar* path, HChar* buf, SizeT bufsiz);
 
 #if defined(VGO_linux) || defined(VGO_solaris)
@@ -467,6 +467,11 @@ extern void VG_(needs_info_location) (
 /* Do we need to see variable type and location information? */
 extern void VG_(needs_var_info) ( void );
 
+/* Does the tool make no use of symbols, line numbers or unwind info,
+   bar the odd report?  Then an object's debug info is only read when
+   something first asks about it (--lazy-debuginfo defaults to yes). */
+extern void VG_(needs_no_debuginfo) ( void );
+
 /* Does the tool replace malloc() and friends with its own versions?
    This has to be combined with the use of a vgpreload_<tool>.so module
    or it won't work.  See massif/Makefile.am for how to build it. */
@@ -495,6 +500,18 @@ extern void VG_(needs_xml_output) ( void );
    function here. */
 extern void VG_(needs_final_IR_tidy_pass) ( IRSB*(*final_tidy)(IRSB*) );
 
+/* May the tool's translations be kept on disk (--translation-cache) and
+   reused by a later run?  Only if its instrumentation of a block
+   depends on nothing but the guest code, the command line and the
+   translation mode (see pub_tool_transtab.h), and refers to no
+   memory allocated at run time.  Kept translations are only used by
+   runs with the same options, bar those for which option_is_keyed
+   returns False: options that only name output files, say.  It should
+   return True for options it does not know. */
+extern void VG_(needs_persistent_translations) (
+   Bool (*option_is_keyed)(const HChar* arg)
+);
+
 
 /* ------------------------------------------------------------------ */
 /* Core events to track */
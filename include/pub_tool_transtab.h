@@ -34,6 +34,18 @@
 void VG_(discard_translations_safely) ( Addr  start, SizeT len,
                                         const HChar* who );
 
+/* Translation modes let a tool keep more than one translation of the
+   same code, instrumented differently -- say, one that only counts and
+   one that traces -- and switch between them cheaply.  Each
+   translation is tagged with the mode that was current when it was
+   made, and only translations of the current mode are run.  The mode
+   starts as 0.  A tool that instruments according to some state of its
+   own sets the mode to match whenever that state changes, instead of
+   discarding translations.  It may do so before the client starts and
+   wherever it may call VG_(discard_translations_safely). */
+extern void VG_(set_translation_mode) ( UInt mode );
+extern UInt VG_(get_translation_mode) ( void );
+
 #endif   // __PUB_TOOL_TRANSTAB_H
 
 /*--------------------------------------------------------------------*/
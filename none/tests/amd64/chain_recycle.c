@@ -0,0 +1,49 @@
+/* A hot loop whose conditional exits each lead to new code, so that
+   the translation made when such an exit is first chained can recycle
+   the sector holding the loop, and move the loop within it when its
+   hot translations are kept.  Chaining must then not patch the code
+   at the loop's old address. */
+#include <stdio.h>
+
+#define N "6000"
+
+extern unsigned int run ( void );
+
+/* Round i runs the compares for j = 0 .. N-1-i, then block N-1-i,
+   each block taking 512 bytes. */
+__asm__(
+".text\n"
+".globl run\n"
+"run:\n"
+"   movl $1, %eax\n"
+"   movl $" N "-1, %edi\n"
+"1: .set j, 0\n"
+"   .rept " N "\n"
+"   cmpl $j, %edi\n"
+"   je 3f + 512*j\n"
+"   .set j, j+1\n"
+"   .endr\n"
+"   ud2\n"
+"2: decl %edi\n"
+"   jns 1b\n"
+"   ret\n"
+"   .p2align 9\n"
+"3: .set j, 0\n"
+"   .rept " N "\n"
+"   .rept 11\n"
+"   addl %eax, -4(%rsp)\n"
+"   movl -4(%rsp), %ecx\n"
+"   imull $(2*j+1), %ecx, %eax\n"
+"   rorl $3, %eax\n"
+"   .endr\n"
+"   jmp 2b\n"
+"   .p2align 9\n"
+"   .set j, j+1\n"
+"   .endr\n"
+);
+
+int main ( void )
+{
+   printf("%08x\n", run());
+   return 0;
+}
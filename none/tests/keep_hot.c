@@ -0,0 +1,44 @@
+/* Runs more distinct code than a small translation cache holds, so
+   that its sectors are recycled while a few hot blocks stay in use. */
+#include <stdio.h>
+
+#define C1(n)  case (n): acc = acc * 31 + ((n) ^ (acc >> 7)); \
+               acc ^= (acc << 3) + (n); acc = acc * 17 + ((n) >> 2); \
+               acc ^= acc >> 11; acc += (n) * 7; break;
+#define C2(n)  C1(n) C1((n) + 1)
+#define C4(n)  C2(n) C2((n) + 2)
+#define C8(n)  C4(n) C4((n) + 4)
+#define C16(n) C8(n) C8((n) + 8)
+#define C32(n) C16(n) C16((n) + 16)
+#define C64(n) C32(n) C32((n) + 32)
+#define C128(n) C64(n) C64((n) + 64)
+#define C256(n) C128(n) C128((n) + 128)
+#define C512(n) C256(n) C256((n) + 256)
+#define C1K(n) C512(n) C512((n) + 512)
+#define C2K(n) C1K(n) C1K((n) + 1024)
+#define C4K(n) C2K(n) C2K((n) + 2048)
+#define C8K(n) C4K(n) C4K((n) + 4096)
+#define C16K(n) C8K(n) C8K((n) + 8192)
+#define C32K(n) C16K(n) C16K((n) + 16384)
+
+#define N_CASES 16384
+
+static unsigned int step(unsigned int i, unsigned int acc)
+{
+   switch (i) {
+      C16K(0)
+   }
+   return acc;
+}
+
+int main(void)
+{
+   unsigned int acc = 1, i;
+   int round;
+
+   for (round = 0; round < 3; round++)
+      for (i = 0; i < N_CASES; i++)
+         acc = step(i, acc);
+   printf("%08x\n", acc);
+   return 0;
+}
@@ -0,0 +1,10 @@
+/* The first stack trace needed is taken in lazy_di_so.so, whose debug
+   info --lazy-debuginfo=yes has not read yet. */
+
+extern void lazy_di_outer(int *p);
+
+int main(void)
+{
+   lazy_di_outer(0);
+   return 0;
+}
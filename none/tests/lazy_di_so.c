@@ -0,0 +1,12 @@
+/* Loaded by lazy_di, and where it crashes. */
+
+static void __attribute__((noinline)) lazy_di_inner(int *p)
+{
+   *p = 1;
+}
+
+void __attribute__((noinline)) lazy_di_outer(int *p)
+{
+   lazy_di_inner(p);
+   __asm__ __volatile__("" ::: "memory");
+}
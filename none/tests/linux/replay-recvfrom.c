@@ -0,0 +1,53 @@
+/* Recorded by replay-recvfrom-record and replayed by
+   replay-recvfrom-replay: the replay has to restore the source address
+   recvfrom wrote, and its length, as well as the data. */
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define RECV_PATH "replay-recvfrom.r"
+#define SEND_PATH "replay-recvfrom.s"
+
+static int bound_socket(const char *path, struct sockaddr_un *addr)
+{
+   int sd = socket(AF_UNIX, SOCK_DGRAM, 0);
+   memset(addr, 0, sizeof(*addr));
+   addr->sun_family = AF_UNIX;
+   strcpy(addr->sun_path, path);
+   unlink(path);
+   if (sd < 0 || bind(sd, (struct sockaddr *)addr, sizeof(*addr)) != 0) {
+      perror("socket");
+      return -1;
+   }
+   return sd;
+}
+
+int main(void)
+{
+   struct sockaddr_un raddr, saddr, from;
+   socklen_t len = sizeof(from);
+   char buf[16];
+   int r, s, n;
+
+   r = bound_socket(RECV_PATH, &raddr);
+   s = bound_socket(SEND_PATH, &saddr);
+   if (r < 0 || s < 0)
+      return 1;
+   sendto(s, "hello", 5, 0, (struct sockaddr *)&raddr, sizeof(raddr));
+   memset(&from, 0, sizeof(from));
+   n = recvfrom(r, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+
+   /* A replay that did not restore the address makes a syscall the
+      recording did not, and so stops following the log. */
+   if (len != offsetof(struct sockaddr_un, sun_path) + sizeof(SEND_PATH)
+       || strcmp(from.sun_path, SEND_PATH) != 0)
+      close(s);
+
+   printf("received %d bytes \"%.*s\" from %s\n", n, n, buf, from.sun_path);
+   unlink(RECV_PATH);
+   unlink(SEND_PATH);
+   return 0;
+}